@@ -0,0 +1,263 @@
+// A C++ consumer for the load test (`bench/load_test.py`).
+//
+// Attaches to a producer like `CvMmapClient` does: maps the object, registers
+// in the consumer table and waits for synchronization messages. Every announced
+// frame is copied out of the latest slot under its seqlock, as a consumer that
+// keeps frames would. When it stops (`--duration`, SIGINT or SIGTERM) it prints
+// one JSON line: frames read, frames missed, torn reads and the latency from
+// `published_ns` to the end of the copy.
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+#include <CLI/CLI.hpp>
+#include <zmq.hpp>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "common.hpp"
+#include "shm_layout.hpp"
+
+namespace {
+std::atomic_bool is_running{true};
+
+/// the producer's object, mapped whole; remapped when the producer lays out the ring again
+class mapping_t {
+public:
+	explicit mapping_t(std::string name) : name_(std::move(name)) {}
+
+	~mapping_t() {
+		unmap();
+	}
+
+	mapping_t(const mapping_t &)            = delete;
+	mapping_t &operator=(const mapping_t &) = delete;
+
+	/// map the object if it exists and has a valid header
+	bool map() {
+		unmap();
+		const auto fd = shm_open(name_.c_str(), O_RDWR, 0);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat st{};
+		if (fstat(fd, &st) != 0 or static_cast<size_t>(st.st_size) <= app::shm_data_offset()) {
+			close(fd);
+			return false;
+		}
+		size_ = static_cast<size_t>(st.st_size);
+		base_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (base_ == MAP_FAILED) {
+			base_ = nullptr;
+			return false;
+		}
+		if (const auto &h = header(); h.magic != app::SHM_MAGIC or h.version != app::SHM_VERSION) {
+			unmap();
+			return false;
+		}
+		generation_ = header().generation.load(std::memory_order::acquire);
+		// mid-layout, or the object hasn't grown to the new ring yet
+		if (generation_ % 2 != 0 or header().data_offset + header().frames_offset + header().slot_count * header().frame_stride > size_) {
+			unmap();
+			return false;
+		}
+		return true;
+	}
+
+	void unmap() {
+		if (base_ != nullptr) {
+			munmap(base_, size_);
+			base_ = nullptr;
+		}
+	}
+
+	[[nodiscard]]
+	bool is_mapped() const {
+		return base_ != nullptr;
+	}
+
+	/// whether the ring changed since `map`
+	[[nodiscard]]
+	bool is_stale() {
+		return header().generation.load(std::memory_order::acquire) != generation_;
+	}
+
+	app::shm_header_t &header() {
+		return *static_cast<app::shm_header_t *>(base_);
+	}
+
+	void *ring() {
+		return static_cast<uint8_t *>(base_) + header().data_offset;
+	}
+
+private:
+	std::string name_;
+	void *base_          = nullptr;
+	size_t size_         = 0;
+	uint32_t generation_ = 0;
+};
+
+struct stats_t {
+	uint64_t frames = 0;
+	/// gaps in the sequence of the synchronization messages
+	uint64_t dropped = 0;
+	/// frames the producer rewrote while they were copied
+	uint64_t torn = 0;
+	std::vector<uint64_t> latency_ns;
+};
+
+double percentile_us(const std::vector<uint64_t> &sorted, double q) {
+	if (sorted.empty()) {
+		return 0;
+	}
+	const auto i = std::min(sorted.size() - 1, static_cast<size_t>(q * static_cast<double>(sorted.size())));
+	return static_cast<double>(sorted[i]) / 1000.0;
+}
+}
+
+int main(int argc, char **argv) {
+	CLI::App app{"cv-mmap load test consumer"};
+	std::string name;
+	std::string address;
+	std::string consumer_name = "load-cpp";
+	double duration           = 10;
+	double warmup             = 0;
+	app.add_option("-n,--name", name, "Shared memory name of the producer")->required();
+	app.add_option("-a,--address", address, "ZMQ address of the producer")->required();
+	app.add_option("--consumer-name", consumer_name, "Name in the producer's consumer table");
+	app.add_option("-t,--duration", duration, "Seconds to measure for");
+	app.add_option("-w,--warmup", warmup, "Seconds to consume before measuring");
+	CLI11_PARSE(app, argc, argv);
+
+	constexpr auto stop = [](int) {
+		is_running.store(false, std::memory_order::relaxed);
+	};
+	std::signal(SIGINT, stop);
+	std::signal(SIGTERM, stop);
+
+	auto ctx  = zmq::context_t{};
+	auto sock = zmq::socket_t{ctx, zmq::socket_type::sub};
+	sock.set(zmq::sockopt::linger, 0);
+	// wake up for the heartbeat while the producer is paused
+	sock.set(zmq::sockopt::rcvtimeo, 100);
+	sock.set(zmq::sockopt::subscribe, std::string{static_cast<char>(app::FRAME_TOPIC_MAGIC)});
+	sock.connect(address);
+
+	const auto pid           = static_cast<uint32_t>(getpid());
+	auto mapping             = mapping_t{name};
+	auto stats               = stats_t{};
+	auto buffer              = std::vector<uint8_t>{};
+	app::consumer_slot_t *me = nullptr;
+	std::optional<uint64_t> last_sequence;
+	const auto attach = [&] {
+		me = nullptr;
+		if (not mapping.map()) {
+			return false;
+		}
+		me = app::register_consumer(mapping.header(), pid, consumer_name);
+		if (me == nullptr) {
+			std::cerr << std::format("consumer table of `{}` is full\n", name);
+		}
+		return true;
+	};
+
+	const auto measure_from = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(warmup));
+	const auto deadline     = measure_from + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(duration));
+	auto started_at         = std::optional<std::chrono::steady_clock::time_point>{};
+	while (is_running.load(std::memory_order::relaxed) and std::chrono::steady_clock::now() < deadline) {
+		if (not mapping.is_mapped() or mapping.is_stale()) {
+			if (me != nullptr) {
+				app::unregister_consumer(*me);
+			}
+			if (not attach()) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+				continue;
+			}
+		}
+		auto topic = zmq::message_t{};
+		if (not sock.recv(topic)) {
+			if (me != nullptr) {
+				app::heartbeat(*me, pid, last_sequence.value_or(0));
+			}
+			continue;
+		}
+		auto payload = zmq::message_t{};
+		if (not topic.more() or not sock.recv(payload)) {
+			continue;
+		}
+		const auto msg = app::sync_message_v2_t::unmarshal(std::span{payload.data<uint8_t>(), payload.size()});
+		if (not msg) {
+			std::cerr << "not a synchronization message of wire format 2; set wire_version = 2\n";
+			continue;
+		}
+		const uint64_t sequence = msg->sequence;
+		const auto missed       = last_sequence and sequence > *last_sequence + 1 ? sequence - *last_sequence - 1 : 0;
+		last_sequence           = sequence;
+		const bool is_measuring = std::chrono::steady_clock::now() >= measure_from;
+		if (mapping.is_stale()) {
+			continue;
+		}
+
+		auto &header     = mapping.header();
+		const auto index = header.latest_slot.load(std::memory_order::acquire);
+		auto &slot       = app::ring_slot(mapping.ring(), index);
+		const auto seq   = slot.seq.load(std::memory_order::acquire);
+		const auto bytes = static_cast<size_t>(header.row_stride) * header.shape.height;
+		if (seq % 2 != 0) {
+			stats.torn += is_measuring ? 1 : 0;
+			continue;
+		}
+		buffer.resize(bytes);
+		std::memcpy(buffer.data(), app::frame_data(header, mapping.ring(), index), bytes);
+		const auto published_ns = slot.published_ns.load(std::memory_order::relaxed);
+		const auto frame_count  = slot.frame_count.load(std::memory_order::relaxed);
+		std::atomic_thread_fence(std::memory_order::acquire);
+		if (slot.seq.load(std::memory_order::relaxed) != seq) {
+			stats.torn += is_measuring ? 1 : 0;
+			continue;
+		}
+		const auto now = app::monotonic_ns();
+		if (me != nullptr and not app::heartbeat(*me, pid, frame_count)) {
+			// pruned, e.g. after a stall longer than `consumer_timeout_ms`
+			me = app::register_consumer(header, pid, consumer_name);
+			if (me != nullptr) {
+				app::heartbeat(*me, pid, frame_count);
+			}
+		}
+		if (not is_measuring) {
+			continue;
+		}
+		if (not started_at) {
+			started_at = std::chrono::steady_clock::now();
+		}
+		stats.frames += 1;
+		stats.dropped += missed;
+		stats.latency_ns.push_back(now > published_ns ? now - published_ns : 0);
+	}
+	if (me != nullptr and mapping.is_mapped()) {
+		app::unregister_consumer(*me);
+	}
+
+	const auto elapsed = started_at ? std::chrono::duration<double>(std::chrono::steady_clock::now() - *started_at).count() : 0.0;
+	std::ranges::sort(stats.latency_ns);
+	std::cout << std::format(R"({{"kind": "cpp", "name": "{}", "producer": "{}", "frames": {}, "dropped": {}, "torn": {}, "elapsed_s": {:.3f}, )"
+							 R"("latency_us": {{"p50": {:.1f}, "p90": {:.1f}, "p99": {:.1f}, "p999": {:.1f}, "max": {:.1f}}}}})",
+							 consumer_name, name, stats.frames, stats.dropped, stats.torn, elapsed,
+							 percentile_us(stats.latency_ns, 0.5), percentile_us(stats.latency_ns, 0.9),
+							 percentile_us(stats.latency_ns, 0.99), percentile_us(stats.latency_ns, 0.999),
+							 stats.latency_ns.empty() ? 0.0 : static_cast<double>(stats.latency_ns.back()) / 1000.0)
+			  << std::endl;
+	return 0;
+}
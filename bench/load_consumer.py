@@ -0,0 +1,124 @@
+"""
+A Python consumer for the load test (`bench/load_test.py`).
+
+Reads the frames of one producer with `CvMmapClient` and copies each of them,
+as a consumer that keeps frames would. When it stops it prints one JSON line
+in the format of `cv-mmap-load-consumer`: frames read, frames missed and the
+latency from `published_ns` to the end of the copy.
+"""
+
+from argparse import ArgumentParser
+import asyncio
+import json
+import signal
+import time
+
+import numpy as np
+
+from cvmmap import CvMmapClient, synthetic
+
+
+def percentile_us(latencies: list[int], q: float) -> float:
+    if not latencies:
+        return 0.0
+    return latencies[min(len(latencies) - 1, int(q * len(latencies)))] / 1000
+
+
+async def consume(args, stats: dict):
+    client = CvMmapClient(args.name, args.address, consumer_name=args.consumer_name)
+    measure_from = time.monotonic() + args.warmup
+    last_frame_count = None
+    try:
+        async for image in client:
+            frame = np.copy(image)
+            now = time.monotonic_ns()
+            message = client.last_message
+            assert message is not None
+            if (
+                last_frame_count is not None
+                and message.frame_count > last_frame_count + 1
+            ):
+                missed = message.frame_count - last_frame_count - 1
+            else:
+                missed = 0
+            last_frame_count = message.frame_count
+            if time.monotonic() < measure_from:
+                continue
+            if stats["started_at"] is None:
+                stats["started_at"] = time.monotonic()
+            stats["frames"] += 1
+            stats["dropped"] += missed
+            stats["latency_ns"].append(max(0, now - message.published_ns))
+            if args.verify and not synthetic.verify(frame, client.channel_order):
+                stats["invalid"] += 1
+    finally:
+        client.close()
+
+
+async def main():
+    parser = ArgumentParser(description="cv-mmap load test consumer")
+    parser.add_argument(
+        "-n", "--name", required=True, help="shared memory name of the producer"
+    )
+    parser.add_argument(
+        "-a", "--address", required=True, help="ZMQ address of the producer"
+    )
+    parser.add_argument(
+        "--consumer-name",
+        default="load-py",
+        help="name in the producer's consumer table",
+    )
+    parser.add_argument(
+        "-t", "--duration", type=float, default=10, help="seconds to measure for"
+    )
+    parser.add_argument(
+        "-w", "--warmup", type=float, default=0, help="seconds before measuring"
+    )
+    parser.add_argument(
+        "--verify",
+        action="store_true",
+        help="check the frames of a synthetic source bit for bit",
+    )
+    args = parser.parse_args()
+
+    stats = {
+        "frames": 0,
+        "dropped": 0,
+        "invalid": 0,
+        "started_at": None,
+        "latency_ns": [],
+    }
+    task = asyncio.create_task(consume(args, stats))
+    loop = asyncio.get_running_loop()
+    for signum in (signal.SIGINT, signal.SIGTERM):
+        loop.add_signal_handler(signum, task.cancel)
+    try:
+        await asyncio.wait_for(task, args.warmup + args.duration)
+    except (asyncio.TimeoutError, asyncio.CancelledError):
+        pass
+
+    started_at = stats["started_at"]
+    latencies = sorted(stats["latency_ns"])
+    result = {
+        "kind": "python",
+        "name": args.consumer_name,
+        "producer": args.name,
+        "frames": stats["frames"],
+        "dropped": stats["dropped"],
+        "torn": 0,
+        "elapsed_s": 0.0 if started_at is None else time.monotonic() - started_at,
+        "latency_us": {
+            "p50": percentile_us(latencies, 0.5),
+            "p90": percentile_us(latencies, 0.9),
+            "p99": percentile_us(latencies, 0.99),
+            "p999": percentile_us(latencies, 0.999),
+            "max": latencies[-1] / 1000 if latencies else 0.0,
+        },
+    }
+    if args.verify:
+        result["invalid"] = stats["invalid"]
+    print(json.dumps(result), flush=True)
+
+
+if __name__ == "__main__":
+    asyncio.run(main())
@@ -0,0 +1,368 @@
+"""
+End-to-end load test: N producers with a synthetic source, each read by C++
+and Python consumers, on one Linux host.
+
+    python bench/load_test.py --producer build/cv-mmap \\
+        --consumer build/cv-mmap-load-consumer -p 8 -c 2 -y 1 -t 30
+
+Every consumer reports its achieved fps, missed frames and the latency from
+`published_ns` to having copied the frame; the producers report what they
+published and dropped over their control endpoint. CPU time of every process
+comes from `/proc/<pid>/stat`. Prints a table, and writes everything as JSON
+with `--json`.
+"""
+
+from argparse import ArgumentParser, Namespace
+from dataclasses import dataclass, field
+from pathlib import Path
+from typing import Any, Optional
+import json
+import os
+import signal
+import subprocess
+import sys
+import tempfile
+import time
+
+import zmq
+
+CLIENT_DIR = Path(__file__).resolve().parent.parent / "client"
+PYTHON_CONSUMER = Path(__file__).resolve().parent / "load_consumer.py"
+CLOCK_TICKS = os.sysconf("SC_CLK_TCK")
+
+
+@dataclass
+class Process:
+    role: str
+    """
+    `producer`, `cpp` or `python`
+    """
+    name: str
+    popen: subprocess.Popen
+    cpu_ticks: list[int] = field(default_factory=list)
+    sampled_at: list[float] = field(default_factory=list)
+    result: dict[str, Any] = field(default_factory=dict)
+
+    def sample_cpu(self):
+        """
+        note the user and system time of the process so far
+        """
+        try:
+            stat = Path(f"/proc/{self.popen.pid}/stat").read_text()
+        except OSError:
+            return
+        # the fields after the command name, which may contain spaces
+        fields = stat[stat.rindex(")") + 2 :].split()
+        self.cpu_ticks.append(int(fields[11]) + int(fields[12]))
+        self.sampled_at.append(time.monotonic())
+
+    @property
+    def cpu_percent(self) -> Optional[float]:
+        if len(self.cpu_ticks) < 2:
+            return None
+        wall = self.sampled_at[-1] - self.sampled_at[0]
+        return (self.cpu_ticks[-1] - self.cpu_ticks[0]) / CLOCK_TICKS / wall * 100
+
+
+def producer_config(args: Namespace, name: str, directory: Path, index: int) -> str:
+    return f"""name = "{name}"
+api = "synthetic"
+zmq_address = "ipc://{directory}/sync_{index}"
+control_address = "ipc://{directory}/control_{index}"
+slot_count = {args.slot_count}
+copy_threads = {args.copy_threads}
+
+[synthetic]
+width = {args.width}
+height = {args.height}
+depth = "{args.depth}"
+channels = {args.channels}
+fps = {args.fps}
+"""
+
+
+def producer_stats(address: str) -> Optional[dict[str, Any]]:
+    ctx = zmq.Context.instance()
+    sock = ctx.socket(zmq.REQ)
+    sock.setsockopt(zmq.LINGER, 0)
+    sock.setsockopt(zmq.RCVTIMEO, 1000)
+    sock.connect(address)
+    try:
+        sock.send_string("stats")
+        reply = json.loads(sock.recv_string())
+        return reply if reply.get("ok", False) else None
+    except zmq.ZMQError:
+        return None
+    finally:
+        sock.close()
+
+
+def wait_for_object(name: str, timeout: float) -> bool:
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        if Path("/dev/shm", name).exists():
+            return True
+        time.sleep(0.05)
+    return False
+
+
+def fmt(value: Optional[float], digits: int = 1) -> str:
+    return "-" if value is None else f"{value:.{digits}f}"
+
+
+COLUMNS = [
+    ("role", 9),
+    ("name", 22),
+    ("fps", 8),
+    ("p50 us", 9),
+    ("p99 us", 9),
+    ("p99.9 us", 9),
+    ("max us", 9),
+    ("dropped", 8),
+    ("torn", 6),
+    ("CPU %", 7),
+]
+
+
+def format_row(cells: list[str]) -> str:
+    return " ".join(
+        f"{cell:<{width}}" if i < 2 else f"{cell:>{width}}"
+        for i, (cell, (_, width)) in enumerate(zip(cells, COLUMNS))
+    )
+
+
+def print_table(processes: list[Process], duration: float):
+    header = format_row([title for title, _ in COLUMNS])
+    print(header)
+    print("-" * len(header))
+    for p in processes:
+        r = p.result
+        latency: dict[str, float] = r.get("latency_us", {})
+        if p.role == "producer":
+            fps = r["published"] / duration if r else None
+        else:
+            fps = r["frames"] / r["elapsed_s"] if r and r["elapsed_s"] > 0 else None
+        cells = [p.role, p.name, fmt(fps)]
+        cells += [fmt(latency.get(q)) for q in ("p50", "p99", "p999", "max")]
+        cells += [str(r.get(k, "-")) for k in ("dropped", "torn")]
+        cells.append(fmt(p.cpu_percent))
+        print(format_row(cells))
+    print("-" * len(header))
+    for role in ("producer", "cpp", "python"):
+        group = [p for p in processes if p.role == role]
+        if not group:
+            continue
+        cpu = sum(p.cpu_percent or 0 for p in group)
+        worst_p99 = max(
+            (p.result.get("latency_us", {}).get("p99", 0) for p in group if p.result),
+            default=0,
+        )
+        print(
+            f"{role:<9} {len(group):>3} processes, {cpu:.1f}% CPU in total,"
+            f" worst p99 {worst_p99:.1f} us"
+        )
+
+
+def main():
+    parser = ArgumentParser(
+        description="cv-mmap load test: N producers x M consumers on one host"
+    )
+    parser.add_argument("--producer", required=True, help="path of cv-mmap")
+    parser.add_argument(
+        "--consumer", help="path of cv-mmap-load-consumer; no C++ consumers without it"
+    )
+    parser.add_argument("-p", "--producers", type=int, default=1)
+    parser.add_argument(
+        "-c", "--cpp-consumers", type=int, default=1, help="C++ consumers per producer"
+    )
+    parser.add_argument(
+        "-y",
+        "--python-consumers",
+        type=int,
+        default=1,
+        help="Python consumers per producer",
+    )
+    parser.add_argument("--width", type=int, default=1920)
+    parser.add_argument("--height", type=int, default=1080)
+    parser.add_argument(
+        "--depth", default="CV_8U", choices=["CV_8U", "CV_16U", "CV_32F"]
+    )
+    parser.add_argument("--channels", type=int, default=3)
+    parser.add_argument(
+        "--fps", type=float, default=30, help="per producer; 0 as fast as possible"
+    )
+    parser.add_argument("--slot-count", type=int, default=4)
+    parser.add_argument("--copy-threads", type=int, default=1)
+    parser.add_argument(
+        "-w", "--warmup", type=float, default=2, help="seconds before measuring"
+    )
+    parser.add_argument(
+        "-t", "--duration", type=float, default=10, help="seconds to measure for"
+    )
+    parser.add_argument(
+        "--json", type=Path, help="write the configuration and every result here"
+    )
+    args = parser.parse_args()
+    if args.cpp_consumers > 0 and args.consumer is None:
+        parser.error(
+            "--consumer is required for C++ consumers; pass -c 0 to run without"
+        )
+
+    processes: list[Process] = []
+    with tempfile.TemporaryDirectory(prefix="cv-mmap-load-") as tmp:
+        directory = Path(tmp)
+        producers: list[tuple[Process, str, str]] = []
+        try:
+            for i in range(args.producers):
+                name = f"cvmmap_load_{os.getpid()}_{i}"
+                config = directory / f"producer_{i}.toml"
+                config.write_text(producer_config(args, name, directory, i))
+                log = open(directory / f"producer_{i}.log", "wb")
+                popen = subprocess.Popen(
+                    [args.producer, "-c", str(config)],
+                    stdout=log,
+                    stderr=subprocess.STDOUT,
+                )
+                process = Process("producer", name, popen)
+                processes.append(process)
+                producers.append(
+                    (
+                        process,
+                        f"ipc://{directory}/sync_{i}",
+                        f"ipc://{directory}/control_{i}",
+                    )
+                )
+            for process, _, _ in producers:
+                if (
+                    not wait_for_object(process.name, 10)
+                    or process.popen.poll() is not None
+                ):
+                    log = (
+                        directory / f"producer_{processes.index(process)}.log"
+                    ).read_text(errors="replace")
+                    sys.exit(f"producer {process.name} didn't start:\n{log}")
+
+            env = dict(
+                os.environ,
+                PYTHONPATH=os.pathsep.join(
+                    filter(None, [str(CLIENT_DIR), os.environ.get("PYTHONPATH")])
+                ),
+            )
+            # consumers outlive the measurement a little, so that their CPU time
+            # can still be read at its end
+            consumer_duration = str(args.duration + 1)
+            for i, (producer, address, _) in enumerate(producers):
+                for j in range(args.cpp_consumers):
+                    name = f"cpp{i}.{j}"
+                    command = [
+                        args.consumer,
+                        "--name",
+                        producer.name,
+                        "--address",
+                        address,
+                        "--consumer-name",
+                        name,
+                        "--warmup",
+                        str(args.warmup),
+                        "--duration",
+                        consumer_duration,
+                    ]
+                    processes.append(
+                        Process(
+                            "cpp",
+                            name,
+                            subprocess.Popen(command, stdout=subprocess.PIPE),
+                        )
+                    )
+                for j in range(args.python_consumers):
+                    name = f"py{i}.{j}"
+                    command = [
+                        sys.executable,
+                        str(PYTHON_CONSUMER),
+                        "--name",
+                        producer.name,
+                        "--address",
+                        address,
+                        "--consumer-name",
+                        name,
+                        "--warmup",
+                        str(args.warmup),
+                        "--duration",
+                        consumer_duration,
+                    ]
+                    processes.append(
+                        Process(
+                            "python",
+                            name,
+                            subprocess.Popen(command, stdout=subprocess.PIPE, env=env),
+                        )
+                    )
+
+            time.sleep(args.warmup)
+            before = {p.name: producer_stats(control) for p, _, control in producers}
+            for p in processes:
+                p.sample_cpu()
+            time.sleep(args.duration)
+            for p in processes:
+                p.sample_cpu()
+            for p, _, control in producers:
+                after = producer_stats(control)
+                if before[p.name] is not None and after is not None:
+                    p.result = {
+                        "published": after["published"] - before[p.name]["published"],
+                        "dropped": after["dropped"] - before[p.name]["dropped"],
+                        "fps": after["fps"],
+                    }
+
+            for p in processes:
+                if p.role == "producer":
+                    continue
+                stdout, _ = p.popen.communicate(
+                    timeout=args.warmup + args.duration + 30
+                )
+                lines = stdout.decode(errors="replace").strip().splitlines()
+                if lines:
+                    p.result = json.loads(lines[-1])
+        finally:
+            for p in processes:
+                if p.popen.poll() is None:
+                    p.popen.send_signal(signal.SIGINT)
+            for p in processes:
+                try:
+                    p.popen.wait(timeout=10)
+                except subprocess.TimeoutExpired:
+                    p.popen.kill()
+
+    pacing = "unpaced" if args.fps == 0 else f"{args.fps:g} fps"
+    print(
+        f"{args.producers} producer(s) of {args.width}x{args.height}"
+        f" {args.depth}C{args.channels} at {pacing}; {args.cpp_consumers} C++ and"
+        f" {args.python_consumers} Python consumer(s) each;"
+        f" {args.duration:g} s after {args.warmup:g} s of warmup\n"
+    )
+    print_table(processes, args.duration)
+    if args.json is not None:
+        args.json.write_text(
+            json.dumps(
+                {
+                    "config": {
+                        k: str(v) if isinstance(v, Path) else v
+                        for k, v in vars(args).items()
+                    },
+                    "processes": [
+                        {
+                            "role": p.role,
+                            "name": p.name,
+                            "cpu_percent": p.cpu_percent,
+                            **p.result,
+                        }
+                        for p in processes
+                    ],
+                },
+                indent=2,
+            )
+        )
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,474 @@
+// Microbenchmarks of the producer's hot path, to track regressions between versions.
+//
+// `set_frame` writes a synthetic frame into a ring laid out like the producer's
+// (4 slots, so the destination is cold as in the shared memory ring), with the
+// config variants that change how: cached or streaming stores, copy threads,
+// padded rows, channel swap, crop, scale and undistortion. Around it are the
+// seqlock updates alone, with and without a consumer pinning concurrently, the
+// synchronization message, and the pixel kernels of every SIMD level the CPU has.
+//
+// Keep the results with `--benchmark_out=<file> --benchmark_out_format=json`;
+// the context records the revision, SIMD level and OpenCV version they belong to.
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <opencv2/core.hpp>
+#include <zmq.hpp>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "common.hpp"
+#include "copy.hpp"
+#include "dispatch.hpp"
+#include "shm_layout.hpp"
+#include "synthetic.hpp"
+#include "transform.hpp"
+#include "worker_pool.hpp"
+
+#ifndef GIT_REV
+#define GIT_REV "N/A"
+#endif
+
+#define STRR(X) #X
+#define STR(X)  STRR(X)
+
+namespace {
+using clock_type = std::chrono::steady_clock;
+
+struct resolution_t {
+	const char *name;
+	int width;
+	int height;
+};
+
+constexpr resolution_t RESOLUTIONS[] = {
+	{"720p", 1280, 720},
+	{"1080p", 1920, 1080},
+	{"4K", 3840, 2160},
+};
+
+/// the common formats; 8-bit BGR and BGRA take the SIMD channel swap
+constexpr int FORMATS[] = {CV_8UC1, CV_8UC3, CV_8UC4, CV_16UC3, CV_32FC1};
+
+struct frame_size_t {
+	const char *name;
+	size_t bytes;
+};
+
+constexpr frame_size_t FRAME_SIZES[] = {
+	{"720p_8UC1", 1280 * 720},
+	{"1080p_8UC3", 1920 * 1080 * 3},
+	{"4K_8UC3", 3840 * 2160 * 3},
+	{"8K_8UC3", 7680 * 4320 * 3},
+	{"8K_16UC3", 7680 * 4320 * 3 * 2},
+};
+
+constexpr uint32_t RING_SLOTS     = 4;
+constexpr size_t WORKING_SET_SIZE = 1 << 20;
+
+std::string format_name(const int type) {
+	// "CV_8U" -> "8UC3"
+	return std::format("{}C{}", app::depth_to_string(CV_MAT_DEPTH(type)).substr(3), CV_MAT_CN(type));
+}
+
+/// a frame of `api = "synthetic"`, so every run copies the same bytes
+cv::Mat synthetic_frame(const resolution_t &resolution, const int type) {
+	auto capture = app::synthetic_capture{app::synthetic_options_t{
+		.width    = static_cast<uint32_t>(resolution.width),
+		.height   = static_cast<uint32_t>(resolution.height),
+		.depth    = CV_MAT_DEPTH(type),
+		.channels = static_cast<uint32_t>(CV_MAT_CN(type)),
+		.fps      = 0,
+	}};
+	cv::Mat frame;
+	capture.read(frame);
+	return frame;
+}
+
+/// the producer's object, anonymous: the header, then the ring, prefaulted like `memory.prefault`
+class ring_t {
+public:
+	ring_t(const app::frame_info_t &info, uint32_t row_alignment, uint32_t max_pinned = 0) {
+		const auto row_bytes = uint64_t{info.width} * info.channels * info.pixelWidth();
+		const auto geometry  = app::make_ring_geometry(RING_SLOTS, max_pinned, row_bytes, info.height, row_alignment, 64);
+		size_                = app::shm_data_offset() + geometry.size();
+		base_                = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+		if (base_ == MAP_FAILED) {
+			throw std::runtime_error(std::format("failed to map a ring of {} bytes; {}", size_, strerror(errno)));
+		}
+		header_ = new (base_) app::shm_header_t{};
+		ring_   = static_cast<uint8_t *>(base_) + app::shm_data_offset();
+		app::init_ring(*header_, ring_, geometry,
+					   app::frame_shape_t{
+						   .width         = info.width,
+						   .height        = info.height,
+						   .channels      = info.channels,
+						   .depth         = info.depth,
+						   .channel_order = 0,
+						   .reserved      = 0,
+						   .reserved2     = 0,
+						   .buffer_size   = info.buffer_size,
+					   });
+	}
+
+	~ring_t() {
+		munmap(base_, size_);
+	}
+
+	ring_t(const ring_t &)            = delete;
+	ring_t &operator=(const ring_t &) = delete;
+
+	app::shm_header_t &header() {
+		return *header_;
+	}
+
+	void *ring() {
+		return ring_;
+	}
+
+private:
+	void *base_                = nullptr;
+	size_t size_               = 0;
+	app::shm_header_t *header_ = nullptr;
+	void *ring_                = nullptr;
+};
+
+enum class stage_t : uint8_t {
+	none,
+	/// the centered half of the frame
+	crop,
+	/// the whole frame at half the size, with area interpolation
+	scale,
+	/// a typical wide-angle lens, at the source size
+	undistort,
+};
+
+app::transform_options_t transform_of(const stage_t stage, const cv::Size size) {
+	auto transform = app::transform_options_t{};
+	switch (stage) {
+	case stage_t::none:
+		break;
+	case stage_t::crop:
+		transform.roi = cv::Rect{size.width / 4, size.height / 4, size.width / 2, size.height / 2};
+		break;
+	case stage_t::scale:
+		transform.output_size   = cv::Size{size.width / 2, size.height / 2};
+		transform.interpolation = cv::INTER_AREA;
+		break;
+	case stage_t::undistort:
+		transform.undistort = app::undistort_options_t{
+			.intrinsics = {0.5 * size.width, 0.5 * size.width, 0.5 * size.width, 0.5 * size.height},
+			.distortion = {-0.3, 0.1, 0, 0, -0.02},
+			.fisheye    = false,
+		};
+		break;
+	}
+	return transform;
+}
+
+/// what `set_frame` does differently with a config
+struct set_frame_variant_t {
+	const char *name;
+	/// `non_temporal_threshold` reached
+	bool is_streaming;
+	/// `copy_threads`, each taking a band of rows
+	uint32_t copy_threads;
+	/// `row_alignment`; 4096 pads every row, so the copy goes row by row
+	uint32_t row_alignment;
+	/// `channel_order = "rgb"`
+	bool swap_rb;
+	stage_t stage;
+};
+
+constexpr set_frame_variant_t BASE_VARIANTS[] = {
+	{"cached", false, 1, 1, false, stage_t::none},
+	{"streaming", true, 1, 1, false, stage_t::none},
+};
+
+/// only for `CV_8UC3`, the format most sources deliver
+constexpr set_frame_variant_t BGR_VARIANTS[] = {
+	{"threads:4", true, 4, 1, false, stage_t::none},
+	{"padded", true, 1, 4096, false, stage_t::none},
+	{"rgb", false, 1, 1, true, stage_t::none},
+	{"crop", true, 1, 1, false, stage_t::crop},
+	{"scale", false, 1, 1, false, stage_t::scale},
+	{"undistort", false, 1, 1, false, stage_t::undistort},
+};
+
+/// `set_frame` of `main`, without the side data: claim a slot, write the frame and publish it
+void bm_set_frame(benchmark::State &state, const cv::Mat &frame, const set_frame_variant_t &variant) {
+	const auto transform = transform_of(variant.stage, frame.size());
+	const auto info      = transform.info_of(frame);
+	auto ring            = ring_t{info, variant.row_alignment};
+	auto pool            = variant.copy_threads > 1 ? std::make_unique<app::worker_pool>(variant.copy_threads) : nullptr;
+	const auto options   = app::copy_options_t{
+		.non_temporal_threshold = variant.is_streaming ? 1u : 0u,
+		.pool                   = pool.get(),
+		.parallel_threshold     = 0,
+		.swap_rb                = variant.swap_rb,
+	};
+	auto stage         = app::frame_transform{};
+	auto times         = app::frame_times_t{};
+	uint64_t published = 0;
+	for (auto _ : state) {
+		auto &header     = ring.header();
+		const auto index = app::begin_write(header, ring.ring());
+		if (not index) {
+			state.SkipWithError("every slot is pinned");
+			break;
+		}
+		stage.write(frame, transform, app::frame_data(header, ring.ring(), *index), header.row_stride, options);
+		times.published_ns = app::monotonic_ns();
+		app::end_write(header, ring.ring(), *index, ++published, times);
+	}
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * info.buffer_size));
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+
+/// `begin_write` and `end_write` of a tiny frame; the cost of the seqlock and header stores alone
+void bm_publish(benchmark::State &state) {
+	auto ring          = ring_t{app::frame_info_t{.width = 64, .height = 1, .channels = 1, .depth = CV_8U, .buffer_size = 64}, 1, 1};
+	auto times         = app::frame_times_t{};
+	uint64_t published = 0;
+	for (auto _ : state) {
+		const auto index = app::begin_write(ring.header(), ring.ring());
+		benchmark::DoNotOptimize(index);
+		app::end_write(ring.header(), ring.ring(), index.value_or(0), ++published, times);
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+
+/// `bm_publish` while a consumer leases the latest slot in a loop on another thread,
+/// so the slot headers and the header bounce between the cores
+void bm_publish_contended(benchmark::State &state) {
+	auto ring          = ring_t{app::frame_info_t{.width = 64, .height = 1, .channels = 1, .depth = CV_8U, .buffer_size = 64}, 1, 1};
+	auto times         = app::frame_times_t{};
+	uint64_t published = 0;
+	auto *consumer     = app::register_consumer(ring.header(), static_cast<uint32_t>(getpid()), "bench");
+	auto leases        = std::atomic<uint64_t>{0};
+	auto is_running    = std::atomic_bool{true};
+	auto reader        = std::thread{[&] {
+		while (is_running.load(std::memory_order::relaxed)) {
+			if (const auto index = app::pin_latest(ring.header(), ring.ring(), *consumer); index) {
+				app::unpin_slot(ring.header(), ring.ring(), *consumer, *index);
+				leases.fetch_add(1, std::memory_order::relaxed);
+			}
+		}
+	}};
+	uint64_t dropped = 0;
+	for (auto _ : state) {
+		if (const auto index = app::begin_write(ring.header(), ring.ring()); index) {
+			app::end_write(ring.header(), ring.ring(), *index, ++published, times);
+		} else {
+			++dropped;
+		}
+	}
+	is_running.store(false, std::memory_order::relaxed);
+	reader.join();
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+	state.counters["dropped"] = benchmark::Counter(static_cast<double>(dropped));
+	state.counters["leases"]  = benchmark::Counter(static_cast<double>(leases.load()), benchmark::Counter::kIsRate);
+}
+
+/// `send_sync_msg` of `main` for a 1080p BGR frame, over IPC
+void bm_send_sync_msg(benchmark::State &state, uint32_t wire_version, bool has_subscriber) {
+	const auto address = std::format("ipc:///tmp/cv-mmap-bench-{}", getpid());
+	auto ctx           = zmq::context_t{};
+	auto sock          = zmq::socket_t{ctx, zmq::socket_type::pub};
+	sock.set(zmq::sockopt::linger, 0);
+	sock.bind(address);
+	auto is_running = std::atomic_bool{true};
+	auto received   = std::atomic<uint64_t>{0};
+	auto drain      = std::thread{};
+	auto sub        = zmq::socket_t{ctx, zmq::socket_type::sub};
+	if (has_subscriber) {
+		sub.set(zmq::sockopt::linger, 0);
+		sub.set(zmq::sockopt::rcvtimeo, 10);
+		sub.set(zmq::sockopt::subscribe, "");
+		sub.connect(address);
+		// a PUB socket drops everything until the subscription arrived
+		while (true) {
+			sock.send(zmq::str_buffer("probe"), zmq::send_flags::none);
+			if (auto probe = zmq::message_t{}; sub.recv(probe)) {
+				break;
+			}
+		}
+		drain = std::thread{[&] {
+			while (is_running.load(std::memory_order::relaxed)) {
+				if (auto part = zmq::message_t{}; sub.recv(part)) {
+					received.fetch_add(1, std::memory_order::relaxed);
+				}
+			}
+		}};
+	}
+
+	constexpr auto magic_payload = std::array<uint8_t, 1>{app::FRAME_TOPIC_MAGIC};
+	const auto info              = app::frame_info_t{.width = 1920, .height = 1080, .channels = 3, .depth = CV_8U, .buffer_size = 1920 * 1080 * 3};
+	uint64_t frame_count         = 0;
+	for (auto _ : state) {
+		const auto now = app::monotonic_ns();
+		++frame_count;
+		sock.send(zmq::buffer(magic_payload), zmq::send_flags::sndmore);
+		if (wire_version == 1) {
+			const auto msg = app::sync_message_t{
+				.frame_count = static_cast<uint32_t>(frame_count),
+				.info        = *app::frame_info_v1_t::from(info),
+			};
+			sock.send(zmq::buffer(reinterpret_cast<const uint8_t *>(&msg), sizeof(msg)), zmq::send_flags::none);
+		} else {
+			const auto msg = app::sync_message_v2_t{
+				.sequence     = frame_count,
+				.info         = info,
+				.capture_ns   = now,
+				.grabbed_ns   = now,
+				.published_ns = now,
+			};
+			sock.send(zmq::buffer(reinterpret_cast<const uint8_t *>(&msg), sizeof(msg)), zmq::send_flags::none);
+		}
+	}
+	is_running.store(false, std::memory_order::relaxed);
+	if (drain.joinable()) {
+		drain.join();
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+	if (has_subscriber) {
+		// two parts per message; fewer than sent when the subscriber fell behind the high-water mark
+		state.counters["received"] = benchmark::Counter(static_cast<double>(received.load() / 2));
+	}
+}
+
+/// `stream_copy` and `fence` into a ring of a few frames. a cache-polluting copy shows up as
+/// a slower read of a small, previously warmed working set that stands in for the decoder's state
+void bm_stream_copy(benchmark::State &state, const app::kernel_table_t &kernels, size_t bytes) {
+	static std::vector<uint8_t> working_set(WORKING_SET_SIZE, 1);
+	std::vector<uint8_t> src(bytes, 0x5a);
+	std::vector<uint8_t> ring(bytes * RING_SLOTS);
+	// fault the pages in before timing
+	std::fill(ring.begin(), ring.end(), 0);
+
+	auto working_set_ns = std::chrono::nanoseconds{0};
+	size_t i            = 0;
+	for (auto _ : state) {
+		state.PauseTiming();
+		benchmark::DoNotOptimize(std::accumulate(working_set.begin(), working_set.end(), uint64_t{0}));
+		state.ResumeTiming();
+		kernels.stream_copy(ring.data() + (i++ % RING_SLOTS) * bytes, src.data(), bytes);
+		kernels.fence();
+		state.PauseTiming();
+		const auto t0 = clock_type::now();
+		benchmark::DoNotOptimize(std::accumulate(working_set.begin(), working_set.end(), uint64_t{0}));
+		working_set_ns += clock_type::now() - t0;
+		state.ResumeTiming();
+	}
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+	state.counters["working_set_us"] = benchmark::Counter(
+		std::chrono::duration<double, std::micro>(working_set_ns).count(), benchmark::Counter::kAvgIterations);
+}
+
+/// `swap_rb_8uc3` or `swap_rb_8uc4` over a frame, as a `channel_order = "rgb"` copy does
+void bm_swap_rb(benchmark::State &state, const app::kernel_table_t &kernels, const int channels, const resolution_t &resolution) {
+	const auto pixels = static_cast<size_t>(resolution.width) * resolution.height;
+	const auto bytes  = pixels * channels;
+	const auto kernel = channels == 3 ? kernels.swap_rb_8uc3 : kernels.swap_rb_8uc4;
+	std::vector<uint8_t> src(bytes, 0x5a);
+	std::vector<uint8_t> dst(bytes, 0);
+	for (auto _ : state) {
+		kernel(dst.data(), src.data(), pixels);
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+}
+
+/// `xor_bytes` of two frames in place, as the delta frames of the network stream do
+void bm_xor_bytes(benchmark::State &state, const app::kernel_table_t &kernels, size_t bytes) {
+	std::vector<uint8_t> a(bytes, 0x5a);
+	std::vector<uint8_t> b(bytes, 0xa5);
+	for (auto _ : state) {
+		kernels.xor_bytes(a.data(), a.data(), b.data(), bytes);
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+}
+
+void register_benchmarks() {
+	for (const auto &resolution : RESOLUTIONS) {
+		for (const auto type : FORMATS) {
+			const auto frame = synthetic_frame(resolution, type);
+			for (const auto &variant : BASE_VARIANTS) {
+				benchmark::RegisterBenchmark(std::format("set_frame/{}/{}/{}", resolution.name, format_name(type), variant.name).c_str(),
+											 bm_set_frame, frame, variant)
+					->Unit(benchmark::kMicrosecond)
+					->UseRealTime();
+			}
+			if (type != CV_8UC3) {
+				continue;
+			}
+			for (const auto &variant : BGR_VARIANTS) {
+				benchmark::RegisterBenchmark(std::format("set_frame/{}/{}/{}", resolution.name, format_name(type), variant.name).c_str(),
+											 bm_set_frame, frame, variant)
+					->Unit(benchmark::kMicrosecond)
+					->UseRealTime();
+			}
+		}
+	}
+
+	benchmark::RegisterBenchmark("seqlock/publish", bm_publish);
+	benchmark::RegisterBenchmark("seqlock/publish_contended", bm_publish_contended)->UseRealTime();
+	for (const auto wire_version : {1u, 2u}) {
+		for (const auto has_subscriber : {false, true}) {
+			benchmark::RegisterBenchmark(std::format("send_sync_msg/v{}/{}", wire_version, has_subscriber ? "subscriber" : "no_subscriber").c_str(),
+										 bm_send_sync_msg, wire_version, has_subscriber)
+				->UseRealTime();
+		}
+	}
+
+	// every level up to what the CPU supports, to compare them with the scalar `memcpy` on this machine
+	const auto detected = app::detect_simd_level();
+	for (auto l = static_cast<uint8_t>(app::simd_level_t::scalar); l <= static_cast<uint8_t>(detected); ++l) {
+		const auto &kernels = app::kernels_for(static_cast<app::simd_level_t>(l));
+		const auto level    = app::simd_level_to_string(kernels.level);
+		for (const auto &[name, bytes] : FRAME_SIZES) {
+			benchmark::RegisterBenchmark(std::format("kernel/stream_copy/{}/{}", level, name).c_str(), bm_stream_copy, std::cref(kernels), bytes)
+				->Unit(benchmark::kMicrosecond);
+			benchmark::RegisterBenchmark(std::format("kernel/xor_bytes/{}/{}", level, name).c_str(), bm_xor_bytes, std::cref(kernels), bytes)
+				->Unit(benchmark::kMicrosecond);
+		}
+		for (const auto &resolution : RESOLUTIONS) {
+			for (const auto channels : {3, 4}) {
+				benchmark::RegisterBenchmark(std::format("kernel/swap_rb_8uc{}/{}/{}", channels, level, resolution.name).c_str(),
+											 bm_swap_rb, std::cref(kernels), channels, std::cref(resolution))
+					->Unit(benchmark::kMicrosecond);
+			}
+		}
+	}
+}
+}
+
+int main(int argc, char **argv) {
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+		return 1;
+	}
+	// `set_frame` runs on the kernels the producer would bind on this machine
+	const auto level = app::bind_kernels();
+	benchmark::AddCustomContext("cv_mmap_revision", STR(GIT_REV));
+	benchmark::AddCustomContext("simd_level", std::string{app::simd_level_to_string(level)});
+	benchmark::AddCustomContext("opencv_version", CV_VERSION);
+	benchmark::AddCustomContext("opencv_threads", std::to_string(cv::getNumThreads()));
+	register_benchmarks();
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
@@ -1,5 +1,6 @@
 from pathlib import Path
 from struct import error as StructError
+import sys
 from typing import AsyncContextManager, AsyncGenerator, Generator, Optional, cast
 
 import numpy as np
@@ -8,11 +9,88 @@ from logging import getLogger
 from zmq import Socket
 from zmq.asyncio import Context, Poller
 
-from .msg import SyncMessage
-from .shm import SharedMemory
+from .msg import SyncMessage, depth_to_dtype
+from .net import NetReceiver
+from .control import ControlClient, ControlError
+from .shm import MappedFile, SharedMemory
+from . import layout
+from .layout import ConsumerRegistration, ShmHeader
 
 NDArray = np.ndarray
 FRAME_TOPIC_MAGIC = 0x7d
+ROI_TOPIC_MAGIC = 0x7f
+HEARTBEAT_INTERVAL_MS = 1000
+
+
+def roi_topic(name: str) -> bytes:
+    """
+    topic the producer announces the frames of subscription `name` on,
+    see `ControlClient.subscribe`
+    """
+    return bytes([ROI_TOPIC_MAGIC]) + name.encode() + b"\0"
+
+
+def roi_fd_socket(fd_socket: str, name: str) -> str:
+    """
+    socket serving the object of subscription `name` when the producer's
+    `memory.fd_socket` is `fd_socket`
+    """
+    return f"{fd_socket}_roi_{name}"
+
+
+class FrameLease:
+    """
+    A ring slot leased with `CvMmapClient.pin`. The producer doesn't
+    overwrite it until `release`, so `image` stays valid without a copy.
+    """
+
+    image: NDArray
+    frame_count: int
+    capture_ns: int
+    """
+    `CLOCK_MONOTONIC` timestamps of the frame, see `SyncMessage`
+    """
+    grabbed_ns: int
+    published_ns: int
+    side_data: list[tuple[int, memoryview]]
+    """
+    `(type, value)` side data records of the frame, see `layout.SideDataType`
+    """
+    _client: "CvMmapClient"
+    _header: ShmHeader
+    _index: int
+    _released: bool
+
+    def __init__(
+        self,
+        client: "CvMmapClient",
+        header: ShmHeader,
+        index: int,
+        image: NDArray,
+        frame_count: int,
+        times: tuple[int, int, int],
+        side_data: list[tuple[int, memoryview]],
+    ):
+        self.image = image
+        self.frame_count = frame_count
+        self.capture_ns, self.grabbed_ns, self.published_ns = times
+        self.side_data = side_data
+        self._client = client
+        self._header = header
+        self._index = index
+        self._released = False
+
+    def release(self):
+        if self._released:
+            return
+        self._released = True
+        self._client._unpin(self._header, self._index)
+
+    def __enter__(self) -> "FrameLease":
+        return self
+
+    def __exit__(self, *_):
+        self.release()
 
 
 class CvMmapClient:
@@ -23,22 +101,72 @@ class CvMmapClient:
     _sock: Socket
     _poller: Poller
 
-    _image_buffer: Optional[NDArray] = None
-    _shm: Optional[SharedMemory] = None
+    _images: list[NDArray]
+    """
+    one view per ring slot
+    """
+    _shm: Optional[SharedMemory | MappedFile] = None
+    _hugetlbfs_path: Optional[str] = None
+    _fd_socket: Optional[str] = None
+    _info: Optional[tuple[int, int, int, int, int]] = None
+    _retired: list[SharedMemory | MappedFile]
+    _header: Optional[ShmHeader] = None
+    _consumer_name: Optional[str] = None
+    _registration: Optional[ConsumerRegistration] = None
+    _leases: set[tuple[int, int]]
+    """
+    `(generation, index)` of the slots leased and not released yet
+    """
+    _max_age_ns: Optional[int] = None
+    _topic: bytes
+    last_message: Optional[SyncMessage] = None
+    """
+    the message of the frame yielded last, with its timestamps
+    """
 
-    def __init__(self, shm_name: str, zmq_addr: str):
+    def __init__(
+        self,
+        shm_name: str,
+        zmq_addr: str,
+        consumer_name: Optional[str] = Path(sys.argv[0]).name,
+        hugetlbfs_path: Optional[str] = None,
+        fd_socket: Optional[str] = None,
+        max_age_ms: Optional[float] = None,
+        topic: Optional[bytes] = None,
+    ):
+        """
+        :param consumer_name: name shown in the producer's consumer table;
+            `None` to read without registering (the producer then can't see this consumer)
+        :param hugetlbfs_path: the producer's `memory.hugetlbfs_path`, if it runs
+            with `huge_pages = "hugetlbfs"`
+        :param fd_socket: the producer's `memory.fd_socket`; `shm_name` is ignored then
+        :param max_age_ms: skip frames captured longer ago than this, e.g. after
+            a stall of the consumer; frames without a capture time are never skipped
+        :param topic: `roi_topic` when `shm_name` is the object of a subscription
+        """
         self._shm_name = shm_name
         self._zmq_addr = zmq_addr
+        self._consumer_name = consumer_name
+        self._hugetlbfs_path = hugetlbfs_path
+        self._fd_socket = fd_socket
+        self._max_age_ns = None if max_age_ms is None else int(max_age_ms * 1e6)
+        self._topic = bytes([FRAME_TOPIC_MAGIC]) if topic is None else topic
+        self.last_message = None
 
         self._ctx = Context.instance()
         self._sock = self._ctx.socket(zmq.SUB)
         self._sock.connect(self._zmq_addr)
-        self._sock.subscribe(bytes([FRAME_TOPIC_MAGIC]))
+        self._sock.subscribe(self._topic)
         self._poller = Poller()
         self._poller.register(self._sock, zmq.POLLIN)
 
-        self._image_buffer = None
+        self._images = []
         self._shm = None
+        self._info = None
+        self._retired = []
+        self._header = None
+        self._registration = None
+        self._leases = set()
 
     def _init_shm(self, size: int):
         """
@@ -47,42 +175,281 @@ class CvMmapClient:
         Initialize shared memory buffer.
         """
         # disable tracking
-        if self._shm is None:
+        if self._shm is None and self._fd_socket is not None:
+            self._shm = MappedFile(layout.receive_fd(self._fd_socket), self._fd_socket)
+        elif self._shm is None and self._hugetlbfs_path is not None:
+            self._shm = MappedFile.open(
+                str(Path(self._hugetlbfs_path) / self._shm_name.lstrip("/"))
+            )
+        elif self._shm is None:
             self._shm = SharedMemory(  # pylint: disable=unexpected-keyword-arg
                 name=self._shm_name, create=False, size=size, track=False
             )
         else:
             raise ValueError("Shared memory already initialized")
+        self._header = ShmHeader.unmarshal(self._shm.buf)
+        if self._header is None:
+            raise ValueError(f"`{self._shm_name}` has no valid cv-mmap header")
+        if self._consumer_name is not None:
+            self._registration = ConsumerRegistration(
+                self._shm.buf, self._consumer_name
+            )
+            if not self._registration.register():
+                getLogger(__name__).warning(
+                    "consumer table of `%s` is full", self._shm_name
+                )
+
+    def _try_attach(self) -> bool:
+        """
+        Interal use only.
+
+        Map the buffer and register before any message arrives, so that a
+        producer with `pause_when_idle` sees this consumer and starts publishing.
+        The header describes the ring, so the frames are mapped right away.
+
+        :return: `True` if the buffer was attached by this call
+        """
+        if self._shm is not None:
+            return False
+        try:
+            self._init_shm(0)
+        except (FileNotFoundError, ConnectionRefusedError, ValueError):
+            # no producer yet, or it's still writing the header
+            if self._shm is not None:
+                self._shm.close()
+                self._shm = None
+            return False
+        self._remap()
+        return True
+
+    def close(self):
+        """
+        Leave the consumer table and release the mapping. Ends every lease.
+        """
+        if self._registration is not None:
+            if self._header is not None:
+                for gen, index in self._leases:
+                    if gen == self._header.generation:
+                        self._registration.unpin(self._header, index)
+            self._registration.unregister()
+            self._registration = None
+        self._leases.clear()
+        self._images = []
+        if self._shm is not None:
+            try:
+                self._shm.close()
+            except BufferError:
+                # the caller still holds an image of the mapping
+                self._retired.append(self._shm)
+            self._shm = None
+        self._info = None
+
+    def _remap(self) -> bool:
+        """
+        Interal use only.
+
+        (Re)create the per-slot image views for the frame geometry and the
+        ring layout in the header.
+
+        The producer only ever grows the shared memory object, so the existing
+        mapping is kept unless it is too small for the new ring.
+
+        :return: `False` while the producer is laying out the ring; skip the message
+        """
+        if self._shm is None:
+            self._init_shm(0)
+        assert self._shm is not None
+        header = ShmHeader.unmarshal(self._shm.buf)
+        if header is not None and self._shm.size < header.size:
+            self.close()
+            self._init_shm(header.size)
+            assert self._shm is not None
+            header = ShmHeader.unmarshal(self._shm.buf)
+        if header is None or not header.has_ring:
+            return False
+        self._header = header
+        dtype = depth_to_dtype(header.depth)
+        self._images = [
+            np.ndarray(
+                (header.height, header.width, header.channels),
+                dtype=dtype,
+                buffer=self._shm.buf,
+                offset=header.frame_offset(i),
+                # rows may be padded
+                strides=(
+                    header.row_stride,
+                    header.channels * dtype.itemsize,
+                    dtype.itemsize,
+                ),
+            )
+            for i in range(header.slot_count)
+        ]
+        self._info = header.info
+        return True
+
+    def _is_stale(self, sync_message: SyncMessage) -> bool:
+        """
+        Interal use only.
+        """
+        return (
+            self._shm is None
+            or self._header is None
+            or self._info != sync_message.info
+            or layout.generation(self._shm.buf) != self._header.generation
+        )
+
+    def _latest_message(self) -> Optional[SyncMessage]:
+        """
+        Interal use only.
+
+        The latest frame as the producer announced it, read from the header;
+        `None` if nothing has been published into the current ring yet.
+        """
+        if self._shm is None or self._header is None:
+            return None
+        if layout.latest_frame_count(self._shm.buf) is None:
+            return None
+        index = layout.latest_slot(self._shm.buf)
+        capture_ns, grabbed_ns, published_ns = layout.slot_times(
+            self._shm.buf, self._header, index
+        )
+        width, height, channels, depth, buffer_size = self._header.info
+        return SyncMessage(
+            frame_count=layout.slot_frame_count(self._shm.buf, self._header, index),
+            width=width,
+            height=height,
+            channels=channels,
+            depth=depth,
+            buffer_size=buffer_size,
+            capture_ns=capture_ns,
+            grabbed_ns=grabbed_ns,
+            published_ns=published_ns,
+        )
+
+    def pin(self) -> Optional[FrameLease]:
+        """
+        Lease the latest frame, so that it stays valid while it's processed.
+
+        Needs a registered consumer and a producer with `max_pinned` above 0.
+        `None` if no lease is available right now; the producer caps the
+        leases of all consumers together at `max_pinned`.
+        Release the lease as soon as possible, or use it as a context manager.
+        """
+        if self._registration is None or self._header is None or self._shm is None:
+            return None
+        index = self._registration.pin_latest(self._header)
+        if index is None:
+            return None
+        self._leases.add((self._header.generation, index))
+        frame_count = layout.slot_frame_count(self._shm.buf, self._header, index)
+        times = layout.slot_times(self._shm.buf, self._header, index)
+        side_data = layout.slot_side_data(self._shm.buf, self._header, index)
+        return FrameLease(
+            self,
+            self._header,
+            index,
+            self._images[index],
+            frame_count,
+            times,
+            side_data,
+        )
+
+    def side_data(self) -> list[tuple[int, memoryview]]:
+        """
+        `(type, value)` side data records of the latest frame, see `layout.SideDataType`.
+        Like the yielded image, the values are only valid until the producer
+        overwrites the slot; `pin` the frame to keep them.
+        """
+        if self._header is None or self._shm is None:
+            return []
+        return layout.slot_side_data(
+            self._shm.buf, self._header, layout.latest_slot(self._shm.buf)
+        )
+
+    @property
+    def channel_order(self) -> layout.ChannelOrder:
+        """
+        order of the channels of the yielded images; `RGB` if the producer
+        runs with `channel_order = "rgb"`, so no `[..., ::-1]` is needed
+        """
+        if self._header is None:
+            return layout.ChannelOrder.BGR
+        return self._header.channel_order
+
+    def _unpin(self, header: ShmHeader, index: int):
+        """
+        Interal use only.
+        """
+        key = (header.generation, index)
+        if key not in self._leases:
+            # released by `close` already
+            return
+        self._leases.discard(key)
+        if self._registration is not None:
+            self._registration.unpin(header, index)
 
     async def __aiter__(self) -> AsyncGenerator[NDArray, None]:
         """
         Asynchronous generator that yields numpy array of image.
         """
+        attached = self._try_attach()
         while True:
-            events = await self._poller.poll()
+            if attached:
+                attached = False
+                # the producer may have published a while ago; don't wait for its next message
+                latest = self._latest_message()
+                if latest is not None and (
+                    self._max_age_ns is None or latest.age_ns() <= self._max_age_ns
+                ):
+                    assert self._shm is not None and self._header is not None
+                    index = layout.slot_of(
+                        self._shm.buf, self._header, latest.frame_count
+                    )
+                    if index is not None:
+                        if self._registration is not None:
+                            self._registration.heartbeat(latest.frame_count)
+                        self.last_message = latest
+                        yield self._images[index]
+            events = await self._poller.poll(timeout=HEARTBEAT_INTERVAL_MS)
+            if not events:
+                attached = self._try_attach()
+                if self._registration is not None:
+                    # keep the registration alive while the producer is paused
+                    self._registration.heartbeat()
             for socket, event in events:
                 if event & zmq.POLLIN:
                     message = await socket.recv()
                     message = cast(bytes, message)
                     # it's the frame topic, ignore it
-                    if len(message) == 1:
+                    if message == self._topic:
                         continue
 
                     try:
                         sync_message = SyncMessage.unmarshal(message)
-                        if self._image_buffer is None:
-                            self._init_shm(sync_message.buffer_size)
-                            assert self._shm is not None
-                            self._image_buffer = np.ndarray(
-                                (
-                                    sync_message.height,
-                                    sync_message.width,
-                                    sync_message.channels,
-                                ),
-                                dtype=np.uint8,
-                                buffer=self._shm.buf,
-                            )
-                        yield self._image_buffer
+                        if (
+                            self._max_age_ns is not None
+                            and sync_message.age_ns() > self._max_age_ns
+                        ):
+                            continue
+                        if self._is_stale(sync_message):
+                            # first frame, or the producer laid out a new ring
+                            if (
+                                not self._remap()
+                                or self._info != sync_message.info
+                            ):
+                                continue
+                        assert self._shm is not None and self._header is not None
+                        # the slot of this message; `latest_slot` may have moved on already
+                        index = layout.slot_of(
+                            self._shm.buf, self._header, sync_message.frame_count
+                        )
+                        if index is None:
+                            # overwritten before we got to it
+                            continue
+                        if self._registration is not None:
+                            self._registration.heartbeat(sync_message.frame_count)
+                        self.last_message = sync_message
+                        yield self._images[index]
                     except StructError as e:
                         getLogger(__name__).exception(e)
                         continue
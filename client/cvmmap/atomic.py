@@ -0,0 +1,112 @@
+"""
+Atomic operations on shared memory through libatomic.
+
+Python has no atomics of its own; the `__atomic_*` entry points of libatomic
+are what the C++ compiler would emit for `std::atomic` on the same memory,
+so both sides agree on the semantics.
+"""
+
+import ctypes
+import ctypes.util
+
+# https://gcc.gnu.org/onlinedocs/gcc/_005f_005fatomic-Builtins.html
+RELAXED = 0
+ACQUIRE = 2
+RELEASE = 3
+ACQ_REL = 4
+SEQ_CST = 5
+
+_lib = ctypes.CDLL(ctypes.util.find_library("atomic") or "libatomic.so.1")
+
+_load_4 = _lib.__atomic_load_4
+_load_4.argtypes = [ctypes.c_void_p, ctypes.c_int]
+_load_4.restype = ctypes.c_uint32
+_load_8 = _lib.__atomic_load_8
+_load_8.argtypes = [ctypes.c_void_p, ctypes.c_int]
+_load_8.restype = ctypes.c_uint64
+_store_4 = _lib.__atomic_store_4
+_store_4.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_int]
+_store_4.restype = None
+_store_8 = _lib.__atomic_store_8
+_store_8.argtypes = [ctypes.c_void_p, ctypes.c_uint64, ctypes.c_int]
+_store_8.restype = None
+_cas_4 = _lib.__atomic_compare_exchange_4
+_cas_4.argtypes = [
+    ctypes.c_void_p,
+    ctypes.POINTER(ctypes.c_uint32),
+    ctypes.c_uint32,
+    ctypes.c_int,
+    ctypes.c_int,
+]
+_cas_4.restype = ctypes.c_bool
+_cas_8 = _lib.__atomic_compare_exchange_8
+_cas_8.argtypes = [
+    ctypes.c_void_p,
+    ctypes.POINTER(ctypes.c_uint64),
+    ctypes.c_uint64,
+    ctypes.c_int,
+    ctypes.c_int,
+]
+_cas_8.restype = ctypes.c_bool
+_fetch_add_4 = _lib.__atomic_fetch_add_4
+_fetch_add_4.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_int]
+_fetch_add_4.restype = ctypes.c_uint32
+_fetch_sub_4 = _lib.__atomic_fetch_sub_4
+_fetch_sub_4.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_int]
+_fetch_sub_4.restype = ctypes.c_uint32
+_fetch_or_8 = _lib.__atomic_fetch_or_8
+_fetch_or_8.argtypes = [ctypes.c_void_p, ctypes.c_uint64, ctypes.c_int]
+_fetch_or_8.restype = ctypes.c_uint64
+_fetch_and_8 = _lib.__atomic_fetch_and_8
+_fetch_and_8.argtypes = [ctypes.c_void_p, ctypes.c_uint64, ctypes.c_int]
+_fetch_and_8.restype = ctypes.c_uint64
+
+
+def address_of(buf: memoryview, offset: int = 0) -> int:
+    """
+    Address of `buf[offset]`. `buf` must be writable and outlive every use of the address.
+    """
+    # the temporary ctypes object releases its export of `buf` right away
+    return ctypes.addressof(ctypes.c_char.from_buffer(buf, offset))
+
+
+def load_u32(addr: int, order: int = ACQUIRE) -> int:
+    return _load_4(addr, order)
+
+
+def load_u64(addr: int, order: int = ACQUIRE) -> int:
+    return _load_8(addr, order)
+
+
+def store_u32(addr: int, value: int, order: int = RELEASE):
+    _store_4(addr, value, order)
+
+
+def store_u64(addr: int, value: int, order: int = RELEASE):
+    _store_8(addr, value, order)
+
+
+def compare_exchange_u32(addr: int, expected: int, desired: int) -> bool:
+    e = ctypes.c_uint32(expected)
+    return _cas_4(addr, ctypes.byref(e), desired, ACQ_REL, ACQUIRE)
+
+
+def compare_exchange_u64(addr: int, expected: int, desired: int) -> bool:
+    e = ctypes.c_uint64(expected)
+    return _cas_8(addr, ctypes.byref(e), desired, ACQ_REL, ACQUIRE)
+
+
+def fetch_add_u32(addr: int, value: int, order: int = SEQ_CST) -> int:
+    return _fetch_add_4(addr, value, order)
+
+
+def fetch_sub_u32(addr: int, value: int, order: int = SEQ_CST) -> int:
+    return _fetch_sub_4(addr, value, order)
+
+
+def fetch_or_u64(addr: int, value: int, order: int = ACQ_REL) -> int:
+    return _fetch_or_8(addr, value, order)
+
+
+def fetch_and_u64(addr: int, value: int, order: int = ACQ_REL) -> int:
+    return _fetch_and_8(addr, value, order)
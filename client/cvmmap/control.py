@@ -0,0 +1,86 @@
+import json
+from typing import Any, Optional, cast
+
+import zmq
+from zmq.asyncio import Context
+
+
+class ControlError(RuntimeError):
+    pass
+
+
+class ControlClient:
+    """
+    Client of the producer's request/reply control endpoint (`control_address`).
+    """
+
+    _address: str
+    _ctx: Context
+    _sock: zmq.asyncio.Socket
+
+    def __init__(self, address: str):
+        self._address = address
+        self._ctx = Context.instance()
+        self._sock = self._ctx.socket(zmq.REQ)
+        self._sock.connect(self._address)
+
+    async def request(self, command: str) -> dict[str, Any]:
+        """
+        Send a command (e.g. `"stats"`, `"seek 120"`) and return the decoded reply.
+
+        Raises `ControlError` if the producer rejects the command.
+        """
+        await self._sock.send_string(command)
+        reply = json.loads(cast(str, await self._sock.recv_string()))
+        if not reply.get("ok", False):
+            raise ControlError(reply.get("error", "unknown error"))
+        return reply
+
+    async def stats(self) -> dict[str, Any]:
+        return await self.request("stats")
+
+    async def pause(self):
+        await self.request("pause")
+
+    async def resume(self):
+        await self.request("resume")
+
+    async def seek(self, frame: int):
+        await self.request(f"seek {frame}")
+
+    async def speed(self, factor: float):
+        await self.request(f"speed {factor}")
+
+    async def request_keyframe(self):
+        await self.request("keyframe")
+
+    async def subscribe(
+        self,
+        name: str,
+        roi: tuple[int, int, int, int],
+        size: Optional[tuple[int, int]] = None,
+        interpolation: Optional[str] = None,
+    ) -> str:
+        """
+        Ask the producer to publish region `roi` (x, y, width, height) of its
+        source frames, scaled to `size` (width, height) if given, into an
+        object of its own. Subscribing again under the same name changes the
+        region. Fails if the region doesn't lie within the frame.
+
+        :return: the object name; pass it to `CvMmapClient` with `topic=roi_topic(name)`,
+            and `fd_socket=roi_fd_socket(fd_socket, name)` if the producer has `memory.fd_socket`
+        """
+        command = f"subscribe {name} {' '.join(map(str, roi))}"
+        if size is not None:
+            command += f" {size[0]} {size[1]}"
+            if interpolation is not None:
+                command += f" {interpolation}"
+        reply = await self.request(command)
+        return cast(str, reply["name"])
+
+    async def unsubscribe(self, name: str):
+        await self.request(f"unsubscribe {name}")
+
+    async def subscriptions(self) -> list[dict[str, Any]]:
+        reply = await self.request("subscriptions")
+        return cast(list[dict[str, Any]], reply["subscriptions"])
@@ -0,0 +1,655 @@
+"""
+Layout of the shared memory object; mirrors `src/shm_layout.hpp`.
+
+    [shm_header_t, padded to a page] [ring]
+
+where the header describes the frames and the ring, so a consumer can map
+the frames as soon as the header is valid, and the ring is
+
+    [frame_slot_t * slot_count] [side data * slot_count, padded] [frame 0] [frame 1] ... [frame n-1]
+
+with side data areas `side_data_capacity` apart, starting at `side_data_offset`, frames `frame_stride` apart, starting at `frames_offset` from the ring,
+and rows `row_stride` apart within a frame.
+"""
+
+from dataclasses import dataclass
+from enum import IntEnum
+from typing import Optional, cast
+import mmap
+import os
+import socket
+import struct
+import time
+
+from . import atomic
+
+SHM_MAGIC = 0x70616D63
+SHM_VERSION = 6
+MAX_CONSUMERS = 32
+CONSUMER_NAME_SIZE = 24
+MAX_SLOTS = 64
+U64_MAX = 0xFFFF_FFFF_FFFF_FFFF
+
+HEADER_FORMAT = "=IHHQIIQ"
+# `slot_count`, `max_pinned` and `frame_stride`
+HEADER_SLOTS_FORMAT = "=IIQ"
+HEADER_SLOTS_OFFSET = 16
+# `row_stride` and `frames_offset`, after the atomics
+HEADER_RING_FORMAT = "=IQ"
+HEADER_RING_OFFSET = 44
+# `shm_descriptor_t`, sent with the file descriptor over `fd_socket`
+DESCRIPTOR_FORMAT = "=IHHQQ"
+LATEST_SLOT_OFFSET = 32
+PINNED_TOTAL_OFFSET = 36
+GENERATION_OFFSET = 40
+LATEST_FRAME_COUNT_OFFSET = 56
+# `frame_shape_t`: width, height, channels, depth, channel_order, reserved, reserved, buffer_size
+SHAPE_FORMAT = "=IIBBBBIQ"
+SHAPE_OFFSET = 64
+# `side_data_offset` and `side_data_capacity`
+HEADER_SIDE_DATA_FORMAT = "=QI"
+HEADER_SIDE_DATA_OFFSET = 88
+CONSUMERS_OFFSET = 128
+CONSUMER_SLOT_SIZE = 64
+HEADER_SIZE = CONSUMERS_OFFSET + MAX_CONSUMERS * CONSUMER_SLOT_SIZE
+
+# `consumer_slot_t`
+SLOT_PID_OFFSET = 0
+SLOT_PID_NS_OFFSET = 4
+SLOT_LAST_FRAME_COUNT_OFFSET = 8
+SLOT_PINNED_MASK_OFFSET = 16
+SLOT_HEARTBEAT_OFFSET = 24
+SLOT_NAME_OFFSET = 32
+
+# `frame_slot_t`, one per frame at the start of the ring
+FRAME_SLOT_SIZE = 64
+FRAME_SLOT_SEQ_OFFSET = 0
+FRAME_SLOT_FRAME_COUNT_OFFSET = 8
+FRAME_SLOT_PINS_OFFSET = 16
+FRAME_SLOT_SIDE_DATA_SIZE_OFFSET = 20
+# `capture_ns`, `grabbed_ns` and `published_ns`
+FRAME_SLOT_TIMES_OFFSET = 24
+
+# `side_data_record_t`: type, reserved, length; values are padded to its size
+SIDE_DATA_RECORD_FORMAT = "=HHI"
+SIDE_DATA_RECORD_SIZE = 8
+
+
+class SideDataType(IntEnum):
+    """
+    well-known types of side data records; `USER` and above are free for applications
+    """
+
+    EXPOSURE = 1
+    """
+    `double`, `CAP_PROP_EXPOSURE`
+    """
+    GAIN = 2
+    """
+    `double`, `CAP_PROP_GAIN`
+    """
+    GPS = 3
+    """
+    `double[3]`; latitude and longitude in degrees, altitude in meters
+    """
+    DETECTIONS = 4
+    USER = 0x8000
+
+
+class ChannelOrder(IntEnum):
+    """
+    `channel_order_t`; order of the first three channels of the frames
+    """
+
+    BGR = 0
+    RGB = 1
+
+
+@dataclass
+class ShmHeader:
+    magic: int
+    version: int
+    max_consumers: int
+    data_offset: int
+    """
+    offset of the ring from the start of the object
+    """
+    slot_count: int
+    max_pinned: int
+    frame_stride: int
+    row_stride: int
+    frames_offset: int
+    width: int
+    height: int
+    channels: int
+    depth: int
+    """
+    OpenCV pixel depth of the frames
+    """
+    buffer_size: int
+    """
+    size of a frame with packed rows; 0 until the producer has laid out the ring
+    """
+    channel_order: ChannelOrder
+    """
+    always `BGR` for frames with fewer than 3 channels
+    """
+    side_data_offset: int
+    side_data_capacity: int
+    """
+    bytes of side data each slot can hold; 0 if disabled
+    """
+    generation: int
+    """
+    `generation` the fields above were read at; stale once `generation()` differs
+    """
+
+    def slot_offset(self, index: int) -> int:
+        """
+        offset of the slot header of ring slot `index`
+        """
+        return self.data_offset + index * FRAME_SLOT_SIZE
+
+    def side_data_offset_of(self, index: int) -> int:
+        """
+        offset of the side data area of ring slot `index`
+        """
+        return self.data_offset + self.side_data_offset + index * self.side_data_capacity
+
+    def frame_offset(self, index: int) -> int:
+        """
+        offset of the frame in ring slot `index`
+        """
+        return self.data_offset + self.frames_offset + index * self.frame_stride
+
+    @property
+    def info(self) -> tuple[int, int, int, int, int]:
+        """
+        the frame geometry; compares equal to `SyncMessage.info`
+        """
+        return (self.width, self.height, self.channels, self.depth, self.buffer_size)
+
+    @property
+    def has_ring(self) -> bool:
+        """
+        whether the producer has laid out the ring for its first frame
+        """
+        return self.slot_count > 0 and self.buffer_size > 0
+
+    @property
+    def size(self) -> int:
+        """
+        size of the object the ring needs
+        """
+        return self.frame_offset(self.slot_count)
+
+    @staticmethod
+    def unmarshal(buf: memoryview) -> Optional["ShmHeader"]:
+        """
+        `None` if the producer hasn't finished writing the header yet
+        """
+        if len(buf) < HEADER_SIZE:
+            return None
+        if atomic.load_u32(atomic.address_of(buf)) != SHM_MAGIC:
+            return None
+        gen = generation(buf)
+        if gen % 2 != 0:
+            return None
+        (
+            magic,
+            version,
+            max_consumers,
+            data_offset,
+            slot_count,
+            max_pinned,
+            frame_stride,
+        ) = struct.unpack_from(HEADER_FORMAT, buf)
+        row_stride, frames_offset = struct.unpack_from(
+            HEADER_RING_FORMAT, buf, HEADER_RING_OFFSET
+        )
+        (
+            width,
+            height,
+            channels,
+            depth,
+            channel_order,
+            _,
+            _,
+            buffer_size,
+        ) = struct.unpack_from(SHAPE_FORMAT, buf, SHAPE_OFFSET)
+        side_data_offset, side_data_capacity = struct.unpack_from(
+            HEADER_SIDE_DATA_FORMAT, buf, HEADER_SIDE_DATA_OFFSET
+        )
+        if version != SHM_VERSION:
+            raise ValueError(
+                f"shared memory layout version {version}; expect {SHM_VERSION}"
+            )
+        return ShmHeader(
+            magic=magic,
+            version=version,
+            max_consumers=max_consumers,
+            data_offset=data_offset,
+            slot_count=slot_count,
+            max_pinned=max_pinned,
+            frame_stride=frame_stride,
+            row_stride=row_stride,
+            frames_offset=frames_offset,
+            width=width,
+            height=height,
+            channels=channels,
+            depth=depth,
+            buffer_size=buffer_size,
+            channel_order=ChannelOrder(channel_order),
+            side_data_offset=side_data_offset,
+            side_data_capacity=side_data_capacity,
+            generation=gen,
+        )
+
+
+def generation(buf: memoryview) -> int:
+    """
+    bumped by the producer whenever it lays out the ring again; odd while it does
+    """
+    return atomic.load_u32(atomic.address_of(buf, GENERATION_OFFSET))
+
+
+def latest_slot(buf: memoryview) -> int:
+    return atomic.load_u32(atomic.address_of(buf, LATEST_SLOT_OFFSET))
+
+
+def latest_frame_count(buf: memoryview) -> Optional[int]:
+    """
+    frame count of the frame in `latest_slot`; `None` before the first frame.
+    The header stores it plus one, so that frame 0 counts as published.
+    """
+    stored = atomic.load_u64(atomic.address_of(buf, LATEST_FRAME_COUNT_OFFSET))
+    return None if stored == 0 else stored - 1
+
+
+def slot_frame_count(buf: memoryview, header: ShmHeader, index: int) -> int:
+    return atomic.load_u64(
+        atomic.address_of(
+            buf, header.slot_offset(index) + FRAME_SLOT_FRAME_COUNT_OFFSET
+        ),
+        atomic.RELAXED,
+    )
+
+
+def slot_of(buf: memoryview, header: ShmHeader, frame_count: int) -> Optional[int]:
+    """
+    ring slot holding frame `frame_count` (`SyncMessage.frame_count`); `None`
+    once the producer has reused it. Only the low 32 bits are compared, all
+    wire format v1 carries; they're unique among the frames of a ring.
+    """
+    latest = latest_slot(buf)
+    for i in [latest, *(i for i in range(header.slot_count) if i != latest)]:
+        if (slot_frame_count(buf, header, i) ^ frame_count) & 0xFFFF_FFFF != 0:
+            continue
+        # a slot never written since the ring was laid out has frame count 0 as well
+        if i == latest or slot_times(buf, header, i)[2] != 0:
+            return i
+    return None
+
+
+def slot_side_data(
+    buf: memoryview, header: ShmHeader, index: int
+) -> list[tuple[int, memoryview]]:
+    """
+    `(type, value)` of the side data records of the frame in ring slot `index`;
+    the values are views into the shared memory, valid as long as the frame is.
+    Mirrors `parse_side_data()`.
+    """
+    if header.side_data_capacity == 0:
+        return []
+    used = atomic.load_u32(
+        atomic.address_of(
+            buf, header.slot_offset(index) + FRAME_SLOT_SIDE_DATA_SIZE_OFFSET
+        ),
+        atomic.RELAXED,
+    )
+    start = header.side_data_offset_of(index)
+    end = start + min(used, header.side_data_capacity)
+    records = []
+    offset = start
+    while offset + SIDE_DATA_RECORD_SIZE <= end:
+        type_, _, length = struct.unpack_from(SIDE_DATA_RECORD_FORMAT, buf, offset)
+        offset += SIDE_DATA_RECORD_SIZE
+        if length > end - offset:
+            break
+        records.append((type_, buf[offset : offset + length]))
+        offset += align_up(length, SIDE_DATA_RECORD_SIZE)
+    return records
+
+
+def align_up(n: int, alignment: int) -> int:
+    return (n + alignment - 1) // alignment * alignment
+
+
+def slot_times(buf: memoryview, header: ShmHeader, index: int) -> tuple[int, int, int]:
+    """
+    `CLOCK_MONOTONIC` capture, grab and publish time of the frame in ring slot `index`, in nanoseconds
+    """
+    offset = header.slot_offset(index) + FRAME_SLOT_TIMES_OFFSET
+    return cast(
+        tuple[int, int, int],
+        tuple(
+            atomic.load_u64(atomic.address_of(buf, offset + 8 * i), atomic.RELAXED)
+            for i in range(3)
+        ),
+    )
+
+
+def ring_size(buffer_size: int) -> int:
+    """
+    size of an object holding a single slot ring of packed rows, as laid out by `init_single_ring`
+    """
+    return data_offset() + FRAME_SLOT_SIZE + align_up(buffer_size, FRAME_SLOT_SIZE)
+
+
+def receive_fd(path: str) -> int:
+    """
+    Fetch the file descriptor of an anonymous object from the producer's `fd_socket`.
+    """
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+        sock.connect(path)
+        msg, fds, _, _ = socket.recv_fds(
+            sock, struct.calcsize(DESCRIPTOR_FORMAT), 1
+        )
+    if not fds:
+        raise ValueError(f"`{path}` sent no file descriptor")
+    magic, version, _, _, _ = struct.unpack(DESCRIPTOR_FORMAT, msg)
+    if magic != SHM_MAGIC or version != SHM_VERSION:
+        for fd in fds:
+            os.close(fd)
+        raise ValueError(
+            f"`{path}` sent layout version {version}; expect {SHM_VERSION}"
+        )
+    return fds[0]
+
+
+def data_offset() -> int:
+    """
+    `shm_data_offset()`; the header rounded up to the page size
+    """
+    page = mmap.PAGESIZE
+    return (HEADER_SIZE + page - 1) // page * page
+
+
+def has_header(buf: memoryview) -> bool:
+    """
+    whether `buf` holds a header of this layout version, e.g. one left by an
+    earlier run of a relay
+    """
+    if len(buf) < HEADER_SIZE:
+        return False
+    magic, version = struct.unpack_from("=IH", buf)
+    return magic == SHM_MAGIC and version == SHM_VERSION
+
+
+def init_header(buf: memoryview):
+    """
+    Write a fresh header without a ring, as the producer does before its
+    first frame. Used by relays creating their own buffer; lay out the ring
+    with `init_single_ring`.
+    """
+    buf[:HEADER_SIZE] = bytes(HEADER_SIZE)
+    struct.pack_into(
+        HEADER_FORMAT, buf, 0, 0, SHM_VERSION, MAX_CONSUMERS, data_offset(), 0, 0, 0
+    )
+    for i in range(MAX_CONSUMERS):
+        offset = CONSUMERS_OFFSET + i * CONSUMER_SLOT_SIZE + SLOT_HEARTBEAT_OFFSET
+        struct.pack_into("=Q", buf, offset, U64_MAX)
+    atomic.store_u32(atomic.address_of(buf), SHM_MAGIC)
+
+
+def init_single_ring(
+    buf: memoryview,
+    info: tuple[int, int, int, int, int],
+    row_stride: int,
+    channel_order: ChannelOrder = ChannelOrder.BGR,
+):
+    """
+    Lay out a single slot ring of packed rows for frames of `info`
+    (`SyncMessage.info`) in `channel_order`. `buf` must hold `ring_size` bytes.
+
+    Bumps `generation` around it as `init_ring` does, so attached consumers
+    notice and remap; the consumer table is kept.
+    """
+    width, height, channels, depth, buffer_size = info
+    gen_addr = atomic.address_of(buf, GENERATION_OFFSET)
+    # odd if a relay died while laying out the ring
+    odd = generation(buf) | 1
+    atomic.store_u32(gen_addr, odd, atomic.SEQ_CST)
+    struct.pack_into(
+        HEADER_SLOTS_FORMAT,
+        buf,
+        HEADER_SLOTS_OFFSET,
+        1,
+        0,
+        align_up(buffer_size, FRAME_SLOT_SIZE),
+    )
+    struct.pack_into(
+        HEADER_RING_FORMAT, buf, HEADER_RING_OFFSET, row_stride, FRAME_SLOT_SIZE
+    )
+    struct.pack_into(
+        SHAPE_FORMAT,
+        buf,
+        SHAPE_OFFSET,
+        width,
+        height,
+        channels,
+        depth,
+        channel_order,
+        0,
+        0,
+        buffer_size,
+    )
+    struct.pack_into(HEADER_SIDE_DATA_FORMAT, buf, HEADER_SIDE_DATA_OFFSET, 0, 0)
+    slot = data_offset()
+    buf[slot : slot + FRAME_SLOT_SIZE] = bytes(FRAME_SLOT_SIZE)
+    atomic.store_u32(atomic.address_of(buf, LATEST_SLOT_OFFSET), 0, atomic.RELAXED)
+    atomic.store_u64(
+        atomic.address_of(buf, LATEST_FRAME_COUNT_OFFSET), 0, atomic.RELAXED
+    )
+    atomic.store_u32(gen_addr, (odd + 1) & 0xFFFF_FFFF)
+
+
+def publish_single(buf: memoryview, frame_count: int):
+    """
+    Record `frame_count` as the frame in the only slot of a ring made by `init_single_ring`.
+    """
+    slot = data_offset()
+    atomic.store_u64(
+        atomic.address_of(buf, slot + FRAME_SLOT_FRAME_COUNT_OFFSET),
+        frame_count,
+        atomic.RELAXED,
+    )
+    atomic.store_u64(
+        atomic.address_of(buf, LATEST_FRAME_COUNT_OFFSET),
+        frame_count + 1,
+        atomic.RELAXED,
+    )
+
+
+def pid_namespace() -> int:
+    """
+    `pid_namespace()`; inode of the PID namespace of this process, truncated
+    to 32 bits, 0 if unknown
+    """
+    try:
+        return os.stat("/proc/self/ns/pid").st_ino & 0xFFFF_FFFF
+    except OSError:
+        return 0
+
+
+class ConsumerRegistration:
+    """
+    A slot in the consumer table of the shared memory header.
+
+    The producer reads it to report per-consumer lag and prunes slots
+    whose heartbeat is older than its `consumer_timeout_ms`.
+    """
+
+    _buf: memoryview
+    _pid: int
+    _name: str
+    _slot: Optional[int] = None
+
+    def __init__(self, buf: memoryview, name: str):
+        self._buf = buf
+        self._pid = os.getpid()
+        self._name = name
+        self._slot = None
+
+    def _slot_addr(self, slot: int, field: int) -> int:
+        return atomic.address_of(
+            self._buf, CONSUMERS_OFFSET + slot * CONSUMER_SLOT_SIZE + field
+        )
+
+    @property
+    def slot(self) -> Optional[int]:
+        return self._slot
+
+    def register(self) -> bool:
+        """
+        Claim a free slot; `False` if all of them are taken.
+        """
+        for i in range(MAX_CONSUMERS):
+            if not atomic.compare_exchange_u32(
+                self._slot_addr(i, SLOT_PID_OFFSET), 0, self._pid
+            ):
+                continue
+            name = self._name.encode()[:CONSUMER_NAME_SIZE]
+            offset = CONSUMERS_OFFSET + i * CONSUMER_SLOT_SIZE + SLOT_NAME_OFFSET
+            self._buf[offset : offset + CONSUMER_NAME_SIZE] = name.ljust(
+                CONSUMER_NAME_SIZE, b"\0"
+            )
+            atomic.store_u32(
+                self._slot_addr(i, SLOT_PID_NS_OFFSET), pid_namespace(), atomic.RELAXED
+            )
+            atomic.store_u64(
+                self._slot_addr(i, SLOT_LAST_FRAME_COUNT_OFFSET), 0, atomic.RELAXED
+            )
+            atomic.store_u64(
+                self._slot_addr(i, SLOT_HEARTBEAT_OFFSET), time.monotonic_ns()
+            )
+            self._slot = i
+            return True
+        return False
+
+    def _refresh(self, slot: int) -> bool:
+        """
+        Interal use only.
+
+        Refresh the heartbeat of `slot` with compare-exchange, as `heartbeat()`
+        does; `False` if the producer has pruned it or is pruning it.
+        """
+        addr = self._slot_addr(slot, SLOT_HEARTBEAT_OFFSET)
+        while True:
+            beat = atomic.load_u64(addr)
+            if (
+                beat == U64_MAX
+                or atomic.load_u32(self._slot_addr(slot, SLOT_PID_OFFSET)) != self._pid
+            ):
+                return False
+            if atomic.compare_exchange_u64(addr, beat, time.monotonic_ns()):
+                return True
+
+    def heartbeat(self, frame_count: Optional[int] = None):
+        """
+        Refresh the heartbeat, and the last read frame if given.
+        Registers again if the producer has pruned the slot meanwhile.
+        """
+        if self._slot is not None and not self._refresh(self._slot):
+            # the slot might belong to another consumer by now; leave it alone
+            self._slot = None
+        if self._slot is None and not self.register():
+            return
+        if frame_count is not None:
+            atomic.store_u64(
+                self._slot_addr(self._slot, SLOT_LAST_FRAME_COUNT_OFFSET),
+                frame_count,
+                atomic.RELAXED,
+            )
+
+    def pin_latest(self, header: ShmHeader) -> Optional[int]:
+        """
+        Lease the latest ring slot so the producer won't overwrite it until `unpin`.
+
+        `None` if leasing is disabled, the producer's `max_pinned` leases are
+        taken, this consumer holds that slot already, or `header` is stale.
+        Mirrors `pin_latest()`.
+        """
+        if self._slot is None or header.max_pinned == 0:
+            return None
+        gen = generation(self._buf)
+        if gen != header.generation:
+            return None
+        total = atomic.address_of(self._buf, PINNED_TOTAL_OFFSET)
+        if atomic.fetch_add_u32(total, 1, atomic.ACQ_REL) >= header.max_pinned:
+            atomic.fetch_sub_u32(total, 1, atomic.RELEASE)
+            return None
+        index = latest_slot(self._buf)
+        bit = 1 << index
+        mask = self._slot_addr(self._slot, SLOT_PINNED_MASK_OFFSET)
+        if atomic.load_u64(mask) & bit:
+            atomic.fetch_sub_u32(total, 1, atomic.RELEASE)
+            return None
+        slot = header.slot_offset(index)
+        pins = atomic.address_of(self._buf, slot + FRAME_SLOT_PINS_OFFSET)
+        atomic.fetch_add_u32(pins, 1)
+        seq = atomic.load_u64(
+            atomic.address_of(self._buf, slot + FRAME_SLOT_SEQ_OFFSET), atomic.SEQ_CST
+        )
+        # not recorded in the mask until the lease holds, so nobody else drops
+        # these; `unpin` would miss them after the producer cleared the mask
+        if seq % 2 != 0 or generation(self._buf) != gen:
+            atomic.fetch_sub_u32(pins, 1, atomic.RELEASE)
+            atomic.fetch_sub_u32(total, 1, atomic.RELEASE)
+            return None
+        if atomic.fetch_or_u64(mask, bit) & bit:
+            atomic.fetch_sub_u32(pins, 1, atomic.RELEASE)
+            atomic.fetch_sub_u32(total, 1, atomic.RELEASE)
+            return None
+        # from here on the producer may drop the pin through the mask
+        if generation(self._buf) != gen:
+            self.unpin(header, index)
+            return None
+        return index
+
+    def unpin(self, header: ShmHeader, index: int):
+        """
+        End a lease taken with `pin_latest`. A no-op if the producer has
+        already dropped it, e.g. after laying out the ring again.
+        """
+        if self._slot is None:
+            return
+        bit = 1 << index
+        mask = self._slot_addr(self._slot, SLOT_PINNED_MASK_OFFSET)
+        if not atomic.fetch_and_u64(mask, ~bit & U64_MAX) & bit:
+            return
+        atomic.fetch_sub_u32(
+            atomic.address_of(
+                self._buf, header.slot_offset(index) + FRAME_SLOT_PINS_OFFSET
+            ),
+            1,
+            atomic.RELEASE,
+        )
+        atomic.fetch_sub_u32(
+            atomic.address_of(self._buf, PINNED_TOTAL_OFFSET), 1, atomic.RELEASE
+        )
+
+    def unregister(self):
+        """
+        End every lease with `unpin` first.
+        """
+        if self._slot is None:
+            return
+        atomic.store_u64(
+            self._slot_addr(self._slot, SLOT_HEARTBEAT_OFFSET), U64_MAX, atomic.RELAXED
+        )
+        atomic.store_u32(
+            self._slot_addr(self._slot, SLOT_PID_NS_OFFSET), 0, atomic.RELAXED
+        )
+        atomic.store_u32(self._slot_addr(self._slot, SLOT_PID_OFFSET), 0)
+        self._slot = None
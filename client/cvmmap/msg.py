@@ -1,20 +1,51 @@
 from dataclasses import dataclass
 import struct
+import time
+
+import numpy as np
+
+SYNC_MAGIC = 0x6D737663  # "cvsm"
+SYNC_VERSION = 2
+
+# wire format v1, without timestamps
+SYNC_MESSAGE_V1_FORMAT = "=IHHBBI"
+# wire format v2: magic, version, size, sequence, frame info, timestamps
+SYNC_MESSAGE_PREAMBLE_FORMAT = "=IHH"
+SYNC_MESSAGE_FORMAT = "=IHHQIIBBQQQQ"
+
+# indexed by OpenCV depth
+_DEPTH_DTYPES = (
+    np.uint8,
+    np.int8,
+    np.uint16,
+    np.int16,
+    np.int32,
+    np.float32,
+    np.float64,
+    np.float16,
+)
+
+
+def depth_to_dtype(depth: int) -> np.dtype:
+    """
+    numpy dtype of an OpenCV depth
+    """
+    return np.dtype(_DEPTH_DTYPES[depth])
 
 
 @dataclass
 class SyncMessage:
     frame_count: int
     """
-    `uint32_t`
+    `uint64_t` sequence; `uint32_t` in wire format v1
     """
     width: int
     """
-    `uint16_t`
+    `uint32_t`; `uint16_t` in wire format v1
     """
     height: int
     """
-    `uint16_t`
+    `uint32_t`; `uint16_t` in wire format v1
     """
     channels: int
     """
@@ -29,13 +60,102 @@ class SyncMessage:
     """
     buffer_size: int
     """
-    `uint32_t`
+    `uint64_t`; `uint32_t` in wire format v1
+    """
+    capture_ns: int = 0
+    """
+    `CLOCK_MONOTONIC` in nanoseconds when the source captured the frame, if
+    the backend reports it, otherwise when the producer started reading it;
+    0 if unknown, always in wire format v1
     """
+    grabbed_ns: int = 0
+    """
+    `CLOCK_MONOTONIC` in nanoseconds when the producer had read the frame; 0 if unknown
+    """
+    published_ns: int = 0
+    """
+    `CLOCK_MONOTONIC` in nanoseconds when the frame was in shared memory; 0 if unknown
+    """
+
+    def age_ns(self) -> int:
+        """
+        time since the frame was captured; 0 if unknown.
+        only meaningful on the producer's host
+        """
+        if self.capture_ns == 0:
+            return 0
+        return max(0, time.monotonic_ns() - self.capture_ns)
+
+    @property
+    def info(self) -> tuple[int, int, int, int, int]:
+        """
+        the `frame_info_t` part of the message; a change means the consumer has to remap
+        """
+        return (self.width, self.height, self.channels, self.depth, self.buffer_size)
+
+    @property
+    def dtype(self) -> np.dtype:
+        return depth_to_dtype(self.depth)
+
+    def marshal(self) -> bytes:
+        return struct.pack(
+            SYNC_MESSAGE_FORMAT,
+            SYNC_MAGIC,
+            SYNC_VERSION,
+            struct.calcsize(SYNC_MESSAGE_FORMAT),
+            self.frame_count,
+            self.width,
+            self.height,
+            self.channels,
+            self.depth,
+            self.buffer_size,
+            self.capture_ns,
+            self.grabbed_ns,
+            self.published_ns,
+        )
 
     @staticmethod
     def unmarshal(data: bytes) -> "SyncMessage":
+        """
+        accepts every wire format; v2 is recognized by its magic, and fields
+        a later version appends after the known ones are ignored
+        """
+        if len(data) >= struct.calcsize(SYNC_MESSAGE_FORMAT):
+            magic, version, size = struct.unpack_from(
+                SYNC_MESSAGE_PREAMBLE_FORMAT, data
+            )
+            if magic == SYNC_MAGIC:
+                if version < SYNC_VERSION or size > len(data):
+                    raise ValueError(
+                        f"malformed synchronization message; version={version}, size={size}"
+                    )
+                (
+                    _,
+                    _,
+                    _,
+                    frame_count,
+                    width,
+                    height,
+                    channels,
+                    depth,
+                    buffer_size,
+                    capture_ns,
+                    grabbed_ns,
+                    published_ns,
+                ) = struct.unpack_from(SYNC_MESSAGE_FORMAT, data)
+                return SyncMessage(
+                    frame_count=frame_count,
+                    width=width,
+                    height=height,
+                    channels=channels,
+                    depth=depth,
+                    buffer_size=buffer_size,
+                    capture_ns=capture_ns,
+                    grabbed_ns=grabbed_ns,
+                    published_ns=published_ns,
+                )
         frame_count, width, height, channels, depth, buffer_size = struct.unpack(
-            "=IHHBBI", data
+            SYNC_MESSAGE_V1_FORMAT, data
         )
         return SyncMessage(
             frame_count=frame_count,
@@ -0,0 +1,288 @@
+"""
+Receiver for the compressed network stream (`[network]` in the producer config).
+
+The receiver decompresses every frame, undoes the XOR-delta against the last
+keyframe and writes the result into a local shared memory buffer, then
+republishes a `SyncMessage` on a local ZMQ address, so that `CvMmapClient`
+works on the remote stream exactly like on a local producer.
+"""
+
+from dataclasses import dataclass
+from enum import IntEnum
+from logging import getLogger
+from typing import Optional, cast
+import struct
+import time
+
+import numpy as np
+import zmq
+from zmq.asyncio import Context
+
+from .msg import SyncMessage
+from .shm import MappedFile
+from . import layout
+
+NDArray = np.ndarray
+
+NET_TOPIC_MAGIC = 0x7E
+FRAME_TOPIC_MAGIC = 0x7D
+NET_FRAME_KEY = 1 << 0
+NET_FRAME_DELTA = 1 << 1
+NET_FRAME_RGB = 1 << 2
+
+
+class Codec(IntEnum):
+    NONE = 0
+    LZ4 = 1
+    ZSTD = 2
+
+
+@dataclass
+class NetFrameHeader:
+    frame_count: int
+    """
+    `uint64_t`
+    """
+    keyframe_count: int
+    """
+    `uint64_t`
+
+    frame_count of the keyframe a delta frame is XOR-ed against
+    """
+    width: int
+    height: int
+    channels: int
+    depth: int
+    buffer_size: int
+    codec: Codec
+    flags: int
+    chunk_count: int
+    chunk_size: int
+    """
+    `uint32_t`
+
+    uncompressed size of every chunk but the last one
+    """
+
+    FORMAT = "=QQIIBBQBBHI"
+
+    @property
+    def info(self) -> tuple[int, int, int, int, int]:
+        return (self.width, self.height, self.channels, self.depth, self.buffer_size)
+
+    @staticmethod
+    def unmarshal(data: bytes) -> "NetFrameHeader":
+        (
+            frame_count,
+            keyframe_count,
+            width,
+            height,
+            channels,
+            depth,
+            buffer_size,
+            codec,
+            flags,
+            chunk_count,
+            chunk_size,
+        ) = struct.unpack(NetFrameHeader.FORMAT, data)
+        return NetFrameHeader(
+            frame_count=frame_count,
+            keyframe_count=keyframe_count,
+            width=width,
+            height=height,
+            channels=channels,
+            depth=depth,
+            buffer_size=buffer_size,
+            codec=Codec(codec),
+            flags=flags,
+            chunk_count=chunk_count,
+            chunk_size=chunk_size,
+        )
+
+    @property
+    def is_key(self) -> bool:
+        return bool(self.flags & NET_FRAME_KEY)
+
+    @property
+    def channel_order(self) -> layout.ChannelOrder:
+        if self.flags & NET_FRAME_RGB:
+            return layout.ChannelOrder.RGB
+        return layout.ChannelOrder.BGR
+
+
+def _decompress(codec: Codec, data: bytes, size: int) -> bytes:
+    if codec == Codec.NONE:
+        return data
+    if codec == Codec.LZ4:
+        import lz4.block  # pylint: disable=import-outside-toplevel
+
+        return lz4.block.decompress(data, uncompressed_size=size)
+    if codec == Codec.ZSTD:
+        import zstandard  # pylint: disable=import-outside-toplevel
+
+        return zstandard.ZstdDecompressor().decompress(data, max_output_size=size)
+    raise ValueError(f"unknown codec {codec}")
+
+
+class NetReceiver:
+    """
+    Relay a remote compressed stream into a local shared memory buffer.
+
+    Delta frames are skipped until the first keyframe arrives (late joiners).
+    """
+
+    _address: str
+    _shm_name: str
+    _zmq_addr: str
+
+    _ctx: Context
+    _sub: zmq.asyncio.Socket
+    _pub: zmq.asyncio.Socket
+
+    _shm: Optional[MappedFile] = None
+    _info: Optional[tuple[int, int, int, int, int]] = None
+    _channel_order: Optional[layout.ChannelOrder] = None
+    _keyframe: Optional[NDArray] = None
+    _keyframe_count: Optional[int] = None
+
+    def __init__(self, address: str, shm_name: str, zmq_addr: str):
+        """
+        :param address: ZMQ address of the remote producer, e.g. `tcp://camera-box:5555`
+        :param shm_name: name of the local shared memory buffer; one left over
+            from an earlier run is taken over
+        :param zmq_addr: local ZMQ address to publish `SyncMessage` on
+        """
+        self._address = address
+        self._shm_name = shm_name
+        self._zmq_addr = zmq_addr
+
+        self._ctx = Context.instance()
+        self._sub = self._ctx.socket(zmq.SUB)
+        self._sub.connect(self._address)
+        self._sub.subscribe(bytes([NET_TOPIC_MAGIC]))
+        self._pub = self._ctx.socket(zmq.PUB)
+        self._pub.bind(self._zmq_addr)
+
+        self._shm = None
+        self._info = None
+        self._channel_order = None
+        self._keyframe = None
+        self._keyframe_count = None
+
+    def _ensure_shm(self, header: NetFrameHeader):
+        """
+        Interal use only.
+
+        Lay out the local shared memory buffer again when the frame geometry
+        or the channel order changes, growing it in place if needed. Like the
+        producer, it keeps one object and bumps its generation, so attached
+        consumers remap instead of holding on to a stale object.
+        """
+        if (
+            self._shm is not None
+            and self._info == header.info
+            and self._channel_order == header.channel_order
+        ):
+            return
+        required = layout.ring_size(header.buffer_size)
+        if self._shm is None or self._shm.size < required:
+            if self._shm is not None:
+                self._shm.close()
+            self._shm = MappedFile.open_shm(self._shm_name, required)
+        if not layout.has_header(self._shm.buf):
+            layout.init_header(self._shm.buf)
+        # relayed rows are packed
+        layout.init_single_ring(
+            self._shm.buf,
+            header.info,
+            header.buffer_size // max(header.height, 1),
+            header.channel_order,
+        )
+        self._info = header.info
+        self._channel_order = header.channel_order
+
+    def close(self):
+        if self._shm is not None:
+            self._shm.close()
+            MappedFile.unlink_shm(self._shm_name)
+            self._shm = None
+            self._info = None
+            self._channel_order = None
+
+    def _reconstruct(self, header: NetFrameHeader, chunks: list[bytes]) -> bool:
+        if not header.is_key and header.keyframe_count != self._keyframe_count:
+            # joined late or lost the keyframe; wait for the next one
+            return False
+        self._ensure_shm(header)
+        assert self._shm is not None
+        if header.is_key:
+            self._keyframe = np.empty(header.buffer_size, dtype=np.uint8)
+        assert self._keyframe is not None
+        out = np.ndarray(
+            (header.buffer_size,),
+            dtype=np.uint8,
+            buffer=self._shm.buf,
+            offset=layout.data_offset() + layout.FRAME_SLOT_SIZE,
+        )
+        for i, chunk in enumerate(chunks):
+            offset = i * header.chunk_size
+            size = min(header.chunk_size, header.buffer_size - offset)
+            raw = np.frombuffer(
+                _decompress(header.codec, chunk, size), dtype=np.uint8, count=size
+            )
+            if header.is_key:
+                self._keyframe[offset : offset + size] = raw
+                out[offset : offset + size] = raw
+            else:
+                np.bitwise_xor(
+                    self._keyframe[offset : offset + size],
+                    raw,
+                    out=out[offset : offset + size],
+                )
+        if header.is_key:
+            self._keyframe_count = header.frame_count
+        layout.publish_single(self._shm.buf, header.frame_count)
+        return True
+
+    async def run(self):
+        """
+        Receive, reconstruct and republish frames until cancelled.
+        """
+        try:
+            while True:
+                parts = cast(list[bytes], await self._sub.recv_multipart())
+                if len(parts) < 2:
+                    continue
+                try:
+                    header = NetFrameHeader.unmarshal(parts[1])
+                except struct.error as e:
+                    getLogger(__name__).exception(e)
+                    continue
+                chunks = parts[2:]
+                if len(chunks) != header.chunk_count:
+                    getLogger(__name__).warning(
+                        "frame@%d: expect %d chunks, got %d",
+                        header.frame_count,
+                        header.chunk_count,
+                        len(chunks),
+                    )
+                    continue
+                if not self._reconstruct(header, chunks):
+                    continue
+                # the remote monotonic clock means nothing here; capture time stays unknown
+                now = time.monotonic_ns()
+                msg = SyncMessage(
+                    frame_count=header.frame_count,
+                    width=header.width,
+                    height=header.height,
+                    channels=header.channels,
+                    depth=header.depth,
+                    buffer_size=header.buffer_size,
+                    grabbed_ns=now,
+                    published_ns=now,
+                )
+                await self._pub.send_multipart(
+                    [bytes([FRAME_TOPIC_MAGIC]), msg.marshal()]
+                )
+        finally:
+            self.close()
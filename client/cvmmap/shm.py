@@ -1,5 +1,7 @@
 from multiprocessing import resource_tracker as _mprt
 from multiprocessing import shared_memory as _mpshm
+import mmap
+import os
 import sys
 import threading
 
@@ -59,3 +61,73 @@ else:
                 )  # pylint: disable=protected-access
                 if self._track:
                     _mprt.unregister(self._name, "shared_memory")
+
+
+class MappedFile:
+    """
+    A file descriptor mapped like `SharedMemory`, for producers backing the
+    object by a file on hugetlbfs (`huge_pages = "hugetlbfs"`) or by a memfd
+    passed over `fd_socket`, instead of `/dev/shm`.
+    """
+
+    _mmap: mmap.mmap
+    _buf: memoryview
+    _name: str
+
+    def __init__(self, fd: int, name: str):
+        """
+        Takes ownership of `fd`; it's closed once mapped.
+        """
+        try:
+            self._mmap = mmap.mmap(fd, os.fstat(fd).st_size)
+        finally:
+            os.close(fd)
+        self._buf = memoryview(self._mmap)
+        self._name = name
+
+    @staticmethod
+    def open(path: str) -> "MappedFile":
+        return MappedFile(os.open(path, os.O_RDWR), path)
+
+    @staticmethod
+    def open_shm(name: str, size: int) -> "MappedFile":
+        """
+        Map the POSIX shared memory object `name`, creating it if needed and
+        growing it to at least `size` bytes. Never shrinks it, so other
+        processes' mappings stay valid.
+        """
+        fd = _mpshm._posixshmem.shm_open(  # pylint: disable=protected-access
+            "/" + name.lstrip("/"), os.O_CREAT | os.O_RDWR, mode=0o666
+        )
+        try:
+            if os.fstat(fd).st_size < size:
+                os.ftruncate(fd, size)
+        except OSError:
+            os.close(fd)
+            raise
+        return MappedFile(fd, name)
+
+    @staticmethod
+    def unlink_shm(name: str):
+        _mpshm._posixshmem.shm_unlink(  # pylint: disable=protected-access
+            "/" + name.lstrip("/")
+        )
+
+    @property
+    def buf(self) -> memoryview:
+        return self._buf
+
+    @property
+    def size(self) -> int:
+        return len(self._mmap)
+
+    @property
+    def name(self) -> str:
+        return self._name
+
+    def close(self):
+        """
+        Raises `BufferError` while views of `buf` are alive, as `SharedMemory.close` does.
+        """
+        self._buf.release()
+        self._mmap.close()
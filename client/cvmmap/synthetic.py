@@ -0,0 +1,82 @@
+"""
+Frames of the built-in source `api = "synthetic"`; mirrors `src/synthetic.hpp`.
+
+Element `k` of row `y` is `(k + y) % 256` in the depth of the frame, except for
+`synthetic_stamp_t` over the first bytes of the first row, so a consumer can
+check every frame it reads bit for bit. Only frames published without a
+`roi`, `output_size` or `[undistort]` table keep the pattern.
+"""
+
+from dataclasses import dataclass
+from typing import Optional
+import struct
+
+import numpy as np
+
+from .layout import ChannelOrder
+
+SYNTHETIC_STAMP_MAGIC = 0x59535643
+# magic, reserved, sequence, timestamp_ns
+STAMP_FORMAT = "=IIQQ"
+STAMP_SIZE = struct.calcsize(STAMP_FORMAT)
+
+
+@dataclass
+class SyntheticStamp:
+    sequence: int
+    """
+    frames the source generated before this one; gaps are frames it dropped
+    """
+    timestamp_ns: int
+    """
+    `CLOCK_MONOTONIC` when the frame was generated
+    """
+
+
+def _in_bgr(image: np.ndarray, channel_order: ChannelOrder) -> np.ndarray:
+    if channel_order == ChannelOrder.RGB and image.ndim == 3 and image.shape[2] >= 3:
+        image = image.copy()
+        image[..., [0, 2]] = image[..., [2, 0]]
+    return image
+
+
+def read_stamp(
+    image: np.ndarray, channel_order: ChannelOrder = ChannelOrder.BGR
+) -> Optional[SyntheticStamp]:
+    """
+    the stamp of a synthetic frame, or `None` if `image` doesn't have one
+    """
+    first_row = np.ascontiguousarray(_in_bgr(image, channel_order)[0])
+    stamp = first_row.tobytes()[:STAMP_SIZE]
+    if len(stamp) < STAMP_SIZE:
+        return None
+    magic, _, sequence, timestamp_ns = struct.unpack(STAMP_FORMAT, stamp)
+    if magic != SYNTHETIC_STAMP_MAGIC:
+        return None
+    return SyntheticStamp(sequence=sequence, timestamp_ns=timestamp_ns)
+
+
+def expected_pattern(shape: tuple[int, ...], dtype: np.dtype) -> np.ndarray:
+    """
+    a synthetic frame of `shape` and `dtype` without its stamp
+    """
+    height = shape[0]
+    elements = int(np.prod(shape[1:]))
+    pattern = (np.arange(elements)[None, :] + np.arange(height)[:, None]) % 256
+    return pattern.astype(dtype).reshape(shape)
+
+
+def verify(image: np.ndarray, channel_order: ChannelOrder = ChannelOrder.BGR) -> bool:
+    """
+    whether `image` is a synthetic frame, bit for bit
+    """
+    image = _in_bgr(image, channel_order)
+    if read_stamp(image) is None:
+        return False
+    expected = expected_pattern(image.shape, image.dtype)
+    # compare bytes, so that the check is exact for floating point frames too
+    actual = np.ascontiguousarray(image).view(np.uint8).reshape(image.shape[0], -1)
+    wanted = expected.view(np.uint8).reshape(image.shape[0], -1)
+    if not np.array_equal(actual[0, STAMP_SIZE:], wanted[0, STAMP_SIZE:]):
+        return False
+    return np.array_equal(actual[1:], wanted[1:])
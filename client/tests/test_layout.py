@@ -0,0 +1,224 @@
+"""
+Behavior of the shared memory layout as seen from Python consumers; mirrors
+`tests/shm_layout_test.cpp` where both sides implement the same protocol.
+
+    cd client && python -m pytest tests
+"""
+
+import mmap
+import os
+import struct
+import time
+
+import pytest
+
+from cvmmap import layout
+from cvmmap.layout import ConsumerRegistration, ShmHeader
+from cvmmap.msg import SYNC_MESSAGE_V1_FORMAT, SyncMessage
+
+INFO = (10, 4, 3, 0, 120)
+
+
+@pytest.fixture
+def buf():
+    """
+    a header and a single slot ring, as a relay lays them out
+    """
+    m = mmap.mmap(-1, layout.ring_size(INFO[4]))
+    view = memoryview(m)
+    layout.init_header(view)
+    layout.init_single_ring(view, INFO, 30)
+    yield view
+    view.release()
+    m.close()
+
+
+def header_of(buf: memoryview) -> ShmHeader:
+    header = ShmHeader.unmarshal(buf)
+    assert header is not None
+    return header
+
+
+def slot_field(slot: int, field: int) -> int:
+    return layout.CONSUMERS_OFFSET + slot * layout.CONSUMER_SLOT_SIZE + field
+
+
+def pins(buf: memoryview, header: ShmHeader, index: int) -> int:
+    return struct.unpack_from(
+        "=I", buf, header.slot_offset(index) + layout.FRAME_SLOT_PINS_OFFSET
+    )[0]
+
+
+def pinned_total(buf: memoryview) -> int:
+    return struct.unpack_from("=I", buf, layout.PINNED_TOTAL_OFFSET)[0]
+
+
+def test_sync_message_v1_is_14_bytes():
+    # `sync_message_t` in `src/common.hpp`
+    assert struct.calcsize(SYNC_MESSAGE_V1_FORMAT) == 14
+    data = bytes.fromhex("04030201 8002 e001 03 00 00100e00".replace(" ", ""))
+    msg = SyncMessage.unmarshal(data)
+    assert msg.frame_count == 0x01020304
+    assert msg.info == (640, 480, 3, 0, 640 * 480 * 3)
+
+
+def test_sync_message_v2_round_trip():
+    msg = SyncMessage(1 << 40, 640, 480, 3, 0, 640 * 480 * 3, capture_ns=123)
+    assert SyncMessage.unmarshal(msg.marshal()) == msg
+
+
+def test_header_offsets_match_the_cpp_layout():
+    # static_asserts in `src/shm_layout.hpp`
+    assert layout.HEADER_RING_OFFSET == 44
+    assert layout.LATEST_FRAME_COUNT_OFFSET == 56
+    assert layout.SHAPE_OFFSET == 64
+    assert layout.HEADER_SIDE_DATA_OFFSET == 88
+    assert layout.CONSUMERS_OFFSET == 128
+    assert struct.calcsize(layout.SHAPE_FORMAT) == 24
+    assert layout.data_offset() % mmap.PAGESIZE == 0
+    assert layout.data_offset() >= layout.HEADER_SIZE
+
+
+def test_init_single_ring(buf):
+    assert layout.has_header(buf)
+    header = header_of(buf)
+    assert header.generation == 2
+    assert header.slot_count == 1
+    assert header.max_pinned == 0
+    assert header.info == INFO
+    assert header.has_ring
+    assert layout.latest_frame_count(buf) is None
+
+    layout.publish_single(buf, 7)
+    assert layout.latest_frame_count(buf) == 7
+    # laid out again in place; attached consumers notice the generation
+    layout.init_single_ring(buf, INFO, 30)
+    assert layout.generation(buf) == 4
+    assert layout.latest_frame_count(buf) is None
+
+
+def test_init_single_ring_recovers_from_odd_generation(buf):
+    # a relay died while laying out the ring
+    struct.pack_into("=I", buf, layout.GENERATION_OFFSET, 5)
+    layout.init_single_ring(buf, INFO, 30)
+    assert layout.generation(buf) == 6
+
+
+def test_slot_of(buf):
+    header = header_of(buf)
+    layout.publish_single(buf, 3)
+    assert layout.slot_of(buf, header, 3) == 0
+    assert layout.slot_of(buf, header, 4) is None
+    # wire format v1 only carries the low 32 bits
+    layout.publish_single(buf, (1 << 32) + 3)
+    assert layout.slot_of(buf, header, 3) == 0
+
+
+def test_registration_round_trip(buf):
+    reg = ConsumerRegistration(buf, "a rather long consumer name")
+    assert reg.register()
+    slot = reg.slot
+    assert slot is not None
+    pid, pid_ns = struct.unpack_from("=II", buf, slot_field(slot, 0))
+    assert pid == os.getpid()
+    assert pid_ns == layout.pid_namespace()
+    name = bytes(buf[slot_field(slot, layout.SLOT_NAME_OFFSET) :][:24])
+    assert name == b"a rather long consumer n"
+
+    reg.heartbeat(42)
+    assert reg.slot == slot
+    assert struct.unpack_from(
+        "=Q", buf, slot_field(slot, layout.SLOT_LAST_FRAME_COUNT_OFFSET)
+    ) == (42,)
+
+    reg.unregister()
+    assert reg.slot is None
+    assert struct.unpack_from("=II", buf, slot_field(slot, 0)) == (0, 0)
+    assert struct.unpack_from(
+        "=Q", buf, slot_field(slot, layout.SLOT_HEARTBEAT_OFFSET)
+    ) == (layout.U64_MAX,)
+
+
+def test_heartbeat_after_prune_registers_again(buf):
+    reg = ConsumerRegistration(buf, "pruned")
+    assert reg.register()
+    assert reg.slot == 0
+    # as `prune_consumers` leaves a slot it took over, with another
+    # consumer claiming it before the pruned one beats again
+    struct.pack_into(
+        "=Q", buf, slot_field(0, layout.SLOT_HEARTBEAT_OFFSET), layout.U64_MAX
+    )
+    struct.pack_into("=I", buf, slot_field(0, layout.SLOT_PID_OFFSET), 1)
+
+    reg.heartbeat(9)
+    assert reg.slot == 1
+    # the reused slot is left alone
+    assert struct.unpack_from(
+        "=Q", buf, slot_field(0, layout.SLOT_LAST_FRAME_COUNT_OFFSET)
+    ) == (0,)
+    assert struct.unpack_from(
+        "=Q", buf, slot_field(0, layout.SLOT_HEARTBEAT_OFFSET)
+    ) == (layout.U64_MAX,)
+    assert struct.unpack_from(
+        "=Q", buf, slot_field(1, layout.SLOT_LAST_FRAME_COUNT_OFFSET)
+    ) == (9,)
+
+
+def test_heartbeat_refreshes(buf):
+    reg = ConsumerRegistration(buf, "fresh")
+    assert reg.register()
+    offset = slot_field(0, layout.SLOT_HEARTBEAT_OFFSET)
+    struct.pack_into("=Q", buf, offset, 1)
+    before = time.monotonic_ns()
+    reg.heartbeat()
+    assert reg.slot == 0
+    assert struct.unpack_from("=Q", buf, offset)[0] >= before
+
+
+def enable_pinning(buf: memoryview, max_pinned: int):
+    struct.pack_into("=I", buf, layout.HEADER_SLOTS_OFFSET + 4, max_pinned)
+
+
+def test_pin_and_unpin(buf):
+    enable_pinning(buf, 1)
+    header = header_of(buf)
+    reg = ConsumerRegistration(buf, "pin")
+    assert reg.register()
+    layout.publish_single(buf, 0)
+    index = reg.pin_latest(header)
+    assert index == 0
+    assert pins(buf, header, 0) == 1
+    assert pinned_total(buf) == 1
+    # already held, and `max_pinned` reached
+    assert reg.pin_latest(header) is None
+    assert pinned_total(buf) == 1
+
+    reg.unpin(header, index)
+    assert pins(buf, header, 0) == 0
+    assert pinned_total(buf) == 0
+    # a second unpin is a no-op
+    reg.unpin(header, index)
+    assert pinned_total(buf) == 0
+
+
+def test_pin_refused_on_stale_header(buf):
+    enable_pinning(buf, 1)
+    header = header_of(buf)
+    reg = ConsumerRegistration(buf, "stale")
+    assert reg.register()
+    layout.init_single_ring(buf, INFO, 30)
+    enable_pinning(buf, 1)
+    assert reg.pin_latest(header) is None
+    assert pins(buf, header, 0) == 0
+    assert pinned_total(buf) == 0
+
+
+def test_pin_refused_on_slot_being_written(buf):
+    enable_pinning(buf, 1)
+    header = header_of(buf)
+    reg = ConsumerRegistration(buf, "busy")
+    assert reg.register()
+    struct.pack_into("=Q", buf, header.slot_offset(0), 1)
+    assert reg.pin_latest(header) is None
+    assert pins(buf, header, 0) == 0
+    assert pinned_total(buf) == 0
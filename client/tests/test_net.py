@@ -0,0 +1,96 @@
+"""
+The shared memory buffer `NetReceiver` relays into.
+
+    cd client && python -m pytest tests
+"""
+
+import os
+
+import pytest
+
+from cvmmap import layout
+from cvmmap.net import Codec, NetFrameHeader, NetReceiver, NET_FRAME_KEY
+from cvmmap.shm import MappedFile
+
+
+def frame_header(width: int, height: int) -> NetFrameHeader:
+    return NetFrameHeader(
+        frame_count=0,
+        keyframe_count=0,
+        width=width,
+        height=height,
+        channels=3,
+        depth=0,
+        buffer_size=width * height * 3,
+        codec=Codec.NONE,
+        flags=NET_FRAME_KEY,
+        chunk_count=1,
+        chunk_size=width * height * 3,
+    )
+
+
+@pytest.fixture
+def shm_name():
+    name = f"cvmmap_test_{os.getpid()}"
+    yield name
+    try:
+        MappedFile.unlink_shm(name)
+    except FileNotFoundError:
+        pass
+
+
+@pytest.fixture
+def receiver(shm_name):
+    tag = f"{os.getpid()}_{id(shm_name)}"
+    recv = NetReceiver(f"inproc://net-{tag}", shm_name, f"inproc://sync-{tag}")
+    yield recv
+    recv.close()
+    # pylint: disable=protected-access
+    recv._sub.close(0)
+    recv._pub.close(0)
+
+
+def test_takes_over_a_stale_object(receiver, shm_name):
+    stale = MappedFile.open_shm(shm_name, layout.ring_size(64))
+    stale.buf[:64] = b"\xff" * 64
+    stale.close()
+
+    receiver._ensure_shm(frame_header(4, 4))  # pylint: disable=protected-access
+    consumer = MappedFile.open_shm(shm_name, 0)
+    try:
+        assert layout.has_header(consumer.buf)
+        header = layout.ShmHeader.unmarshal(consumer.buf)
+        assert header is not None
+        assert header.info == (4, 4, 3, 0, 48)
+        assert header.generation == 2
+    finally:
+        consumer.close()
+
+
+def test_keeps_one_object_across_geometry_changes(receiver, shm_name):
+    receiver._ensure_shm(frame_header(4, 4))  # pylint: disable=protected-access
+    consumer = MappedFile.open_shm(shm_name, 0)
+    try:
+        small = consumer.size
+        # unchanged geometry leaves the ring alone
+        receiver._ensure_shm(frame_header(4, 4))  # pylint: disable=protected-access
+        assert layout.generation(consumer.buf) == 2
+
+        receiver._ensure_shm(frame_header(640, 480))  # pylint: disable=protected-access
+        # the consumer's mapping still shows the header and learns to remap
+        assert layout.generation(consumer.buf) == 4
+        header = layout.ShmHeader.unmarshal(consumer.buf)
+        assert header is not None
+        assert header.size > small
+        grown = MappedFile.open_shm(shm_name, 0)
+        assert grown.size >= header.size
+        grown.close()
+    finally:
+        consumer.close()
+
+
+def test_close_unlinks(receiver, shm_name):
+    receiver._ensure_shm(frame_header(4, 4))  # pylint: disable=protected-access
+    receiver.close()
+    with pytest.raises(FileNotFoundError):
+        MappedFile.unlink_shm(shm_name)
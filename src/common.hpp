@@ -0,0 +1,252 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+namespace app {
+using invalid_argument = std::invalid_argument;
+
+constexpr std::string_view trim(std::string_view s) {
+	s.remove_prefix(std::min(s.find_first_not_of(" \t\r\v\n"), s.size()));
+	s.remove_suffix(std::min(s.size() - s.find_last_not_of(" \t\r\v\n") - 1, s.size()));
+	return s;
+}
+
+constexpr auto FRAME_TOPIC_MAGIC = 0x7d;
+using cap_api_t                  = decltype(cv::CAP_ANY);
+/// the built-in `synthetic_capture`; not an OpenCV backend, but inside the range of `cv::VideoCaptureAPIs`
+constexpr auto CAP_SYNTHETIC     = static_cast<cap_api_t>(4000);
+
+static const std::unordered_map<std::string, cap_api_t> api_map = {
+	{"any", cv::CAP_ANY},
+	{"v4l", cv::CAP_V4L},
+	{"v4l2", cv::CAP_V4L2},
+	{"gstreamer", cv::CAP_GSTREAMER},
+	{"dshow", cv::CAP_DSHOW},
+	{"avfoundation", cv::CAP_AVFOUNDATION},
+	{"ffmpeg", cv::CAP_FFMPEG},
+	{"synthetic", CAP_SYNTHETIC},
+};
+
+inline std::string_view cap_api_to_string(const cap_api_t api) {
+	for (const auto &[key, value] : api_map) {
+		if (value == api) {
+			return key;
+		}
+	}
+	throw invalid_argument(std::format("invalid API value: `{}`", static_cast<int>(api)));
+}
+
+inline cap_api_t cap_api_from_string(const std::string_view s) {
+	for (const auto &[key, value] : api_map) {
+		if (key == s) {
+			return value;
+		}
+	}
+	throw invalid_argument(std::format("invalid API key: `{}`", s));
+}
+
+inline std::string depth_to_string(const int depth) {
+	switch (depth) {
+	case CV_8U:
+		return "CV_8U";
+	case CV_8S:
+		return "CV_8S";
+	case CV_16U:
+		return "CV_16U";
+	case CV_16S:
+		return "CV_16S";
+	case CV_16F:
+		return "CV_16F";
+	case CV_32S:
+		return "CV_32S";
+	case CV_32F:
+		return "CV_32F";
+	case CV_64F:
+		return "CV_64F";
+	default:
+		return "unknown";
+	}
+}
+
+inline int depth_from_string(const std::string_view s) {
+	for (const auto depth : {CV_8U, CV_8S, CV_16U, CV_16S, CV_16F, CV_32S, CV_32F, CV_64F}) {
+		if (depth_to_string(depth) == s) {
+			return depth;
+		}
+	}
+	throw invalid_argument(std::format("invalid depth key: `{}`", s));
+}
+
+// https://gist.github.com/yangcha/38f2fa630e223a8546f9b48ebbb3e61a
+inline int cv_depth_to_size(int depth) {
+	switch (depth) {
+	case CV_8U:
+	case CV_8S:
+		return 1;
+	case CV_16U:
+	case CV_16S:
+	case CV_16F:
+		return 2;
+	case CV_32S:
+	case CV_32F:
+		return 4;
+	case CV_64F:
+		return 8;
+	default:
+		throw app::invalid_argument(std::format("invalid depth value `{}`", depth));
+	}
+}
+
+// https://docs.opencv.org/4.x/d3/d63/classcv_1_1Mat.html
+// See `Detailed Description`
+// strides for each dimension
+// stride[0]=channel
+// stride[1]=channel*cols
+// stride[2]=channel*cols*rows
+struct __attribute__((packed)) frame_info_t {
+	uint32_t width;
+	uint32_t height;
+	uint8_t channels;
+	/// CV_8U, CV_8S, CV_16U, CV_16S, CV_16F, CV_32S, CV_32F, CV_64F
+	uint8_t depth;
+	uint64_t buffer_size;
+
+	/// geometry of `frame`; `buffer_size` counts packed rows, whatever `frame.step[0]` is
+	static frame_info_t of(const cv::Mat &frame) {
+		return frame_info_t{
+			.width       = static_cast<uint32_t>(frame.cols),
+			.height      = static_cast<uint32_t>(frame.rows),
+			.channels    = static_cast<uint8_t>(frame.channels()),
+			.depth       = static_cast<uint8_t>(frame.depth()),
+			.buffer_size = static_cast<uint64_t>(frame.total() * frame.elemSize()),
+		};
+	}
+
+	[[nodiscard]]
+	int pixelWidth() const {
+		return cv_depth_to_size(depth);
+	}
+
+	int marshal(std::span<uint8_t> buf) const {
+		if (buf.size() < sizeof(frame_info_t)) {
+			return -1;
+		}
+		memcpy(buf.data(), this, sizeof(frame_info_t));
+		return sizeof(frame_info_t);
+	}
+
+	static std::optional<frame_info_t> unmarshal(const std::span<uint8_t> buf) {
+		if (buf.size() < sizeof(frame_info_t)) {
+			return std::nullopt;
+		}
+		frame_info_t info;
+		memcpy(&info, buf.data(), sizeof(frame_info_t));
+		return info;
+	}
+};
+
+/// `frame_info_t` of wire format v1, with 16 bit dimensions and a 32 bit size
+struct __attribute__((packed)) frame_info_v1_t {
+	uint16_t width;
+	uint16_t height;
+	uint8_t channels;
+	uint8_t depth;
+	uint32_t buffer_size;
+
+	/// `std::nullopt` if `info` doesn't fit
+	static std::optional<frame_info_v1_t> from(const frame_info_t &info) {
+		if (info.width > UINT16_MAX or info.height > UINT16_MAX or info.buffer_size > UINT32_MAX) {
+			return std::nullopt;
+		}
+		return frame_info_v1_t{
+			.width       = static_cast<uint16_t>(info.width),
+			.height      = static_cast<uint16_t>(info.height),
+			.channels    = info.channels,
+			.depth       = info.depth,
+			.buffer_size = static_cast<uint32_t>(info.buffer_size),
+		};
+	}
+};
+
+/// synchronization message of wire format v1, for consumers that predate
+/// `sync_message_v2_t` (`wire_version = 1`).
+///
+/// byte-identical to the original message (`=IHHBBI`, 14 bytes); it has no
+/// room for the timestamps, which only `sync_message_v2_t` carries
+struct __attribute__((packed)) sync_message_t {
+	uint32_t frame_count;
+	frame_info_v1_t info;
+	// NOTE: I don't need the `name` field
+	// as long as we don't share same IPC socket for different video sources.
+	int marshal(std::span<uint8_t> buf) const {
+		if (buf.size() < sizeof(sync_message_t)) {
+			return -1;
+		}
+		memcpy(buf.data(), this, sizeof(sync_message_t));
+		return sizeof(sync_message_t);
+	}
+
+	static std::optional<sync_message_t> unmarshal(const std::span<uint8_t> buf) {
+		if (buf.size() < sizeof(sync_message_t)) {
+			return std::nullopt;
+		}
+		sync_message_t msg;
+		memcpy(&msg, buf.data(), sizeof(sync_message_t));
+		return msg;
+	}
+};
+
+static_assert(sizeof(sync_message_t) == 14);
+
+constexpr uint32_t SYNC_MAGIC   = 0x6d737663; // "cvsm"
+constexpr uint16_t SYNC_VERSION = 2;
+
+/// synchronization message since wire format v2.
+///
+/// self-describing: a reader checks `magic` and `version`, and skips to
+/// `size` bytes, so later versions can append fields without breaking it.
+struct __attribute__((packed)) sync_message_v2_t {
+	uint32_t magic = SYNC_MAGIC;
+	uint16_t version = SYNC_VERSION;
+	/// `sizeof(sync_message_v2_t)` of the sender
+	uint16_t size = sizeof(sync_message_v2_t);
+	/// `frame_count`; never wraps in practice
+	uint64_t sequence;
+	frame_info_t info;
+	/// `CLOCK_MONOTONIC` in nanoseconds, see `frame_times_t`; 0 if unknown
+	uint64_t capture_ns;
+	uint64_t grabbed_ns;
+	uint64_t published_ns;
+
+	int marshal(std::span<uint8_t> buf) const {
+		if (buf.size() < sizeof(sync_message_v2_t)) {
+			return -1;
+		}
+		memcpy(buf.data(), this, sizeof(sync_message_v2_t));
+		return sizeof(sync_message_v2_t);
+	}
+
+	/// accepts messages of later versions, as long as they start with this layout
+	static std::optional<sync_message_v2_t> unmarshal(const std::span<uint8_t> buf) {
+		if (buf.size() < sizeof(sync_message_v2_t)) {
+			return std::nullopt;
+		}
+		sync_message_v2_t msg;
+		memcpy(&msg, buf.data(), sizeof(sync_message_v2_t));
+		if (msg.magic != SYNC_MAGIC or msg.version < SYNC_VERSION or msg.size < sizeof(sync_message_v2_t)) {
+			return std::nullopt;
+		}
+		return msg;
+	}
+};
+}
@@ -0,0 +1,582 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <variant>
+#include <vector>
+#include <toml++/toml.hpp>
+#include "common.hpp"
+#include "copy.hpp"
+#include "numa.hpp"
+#include "shm_layout.hpp"
+#include "synthetic.hpp"
+#include "transform.hpp"
+
+namespace app {
+enum class codec_t : uint8_t {
+	none = 0,
+	lz4  = 1,
+	zstd = 2,
+};
+
+static const std::unordered_map<std::string, codec_t> codec_map = {
+	{"none", codec_t::none},
+	{"lz4", codec_t::lz4},
+	{"zstd", codec_t::zstd},
+};
+
+inline std::string_view codec_to_string(const codec_t codec) {
+	for (const auto &[key, value] : codec_map) {
+		if (value == codec) {
+			return key;
+		}
+	}
+	throw invalid_argument(std::format("invalid codec value: `{}`", static_cast<int>(codec)));
+}
+
+inline codec_t codec_from_string(const std::string_view s) {
+	for (const auto &[key, value] : codec_map) {
+		if (key == s) {
+			return value;
+		}
+	}
+	throw invalid_argument(std::format("invalid codec key: `{}`", s));
+}
+
+/// the first codec found at build time of LZ4 and zstd, or none
+constexpr codec_t DEFAULT_CODEC =
+#if defined(CVMMAP_WITH_LZ4)
+	codec_t::lz4;
+#elif defined(CVMMAP_WITH_ZSTD)
+	codec_t::zstd;
+#else
+	codec_t::none;
+#endif
+
+/// compressed frame stream for remote consumers (`[network]` table)
+struct NetworkConfig {
+	/// ZMQ address the compressed stream is published on, e.g. `tcp://*:5555`
+	std::string address;
+	codec_t codec = DEFAULT_CODEC;
+	/// compression level; acceleration for LZ4, level for zstd
+	int level = 1;
+	/// send XOR-delta against the last keyframe instead of the full frame
+	bool delta = true;
+	/// a keyframe is sent at least every `keyframe_interval` frames, for late joiners
+	uint32_t keyframe_interval = 30;
+	/// number of compression threads; each frame is split into one chunk per worker
+	uint32_t workers = 4;
+
+	static NetworkConfig from_toml(const toml::table &table) {
+		NetworkConfig config;
+		if (const auto address = table["address"]; address) {
+			config.address = *address.value<std::string>();
+		} else {
+			throw invalid_argument("network.address is required");
+		}
+		if (const auto codec = table["codec"]; codec) {
+			config.codec = codec_from_string(*codec.value<std::string>());
+		}
+		if (const auto level = table["level"]; level) {
+			config.level = *level.value<int>();
+		}
+		if (const auto delta = table["delta"]; delta) {
+			config.delta = *delta.value<bool>();
+		}
+		if (const auto interval = table["keyframe_interval"]; interval) {
+			config.keyframe_interval = *interval.value<uint32_t>();
+			if (config.keyframe_interval == 0) {
+				throw invalid_argument("network.keyframe_interval must be positive");
+			}
+		}
+		if (const auto workers = table["workers"]; workers) {
+			config.workers = *workers.value<uint32_t>();
+			if (config.workers == 0 || config.workers > UINT16_MAX) {
+				throw invalid_argument("network.workers must be in [1, 65535]");
+			}
+		}
+		return config;
+	}
+
+	[[nodiscard]]
+	toml::table to_toml() const {
+		return toml::table{
+			{"address", address},
+			{"codec", codec_to_string(codec)},
+			{"level", level},
+			{"delta", delta},
+			{"keyframe_interval", keyframe_interval},
+			{"workers", workers},
+		};
+	}
+
+	bool operator==(const NetworkConfig &) const = default;
+};
+
+enum class huge_pages_t : uint8_t {
+	/// regular pages
+	none = 0,
+	/// ask for transparent huge pages with `madvise`; needs `shmem_enabled` set to `advise` or `always`
+	transparent = 1,
+	/// back the object by a file on a hugetlbfs mount instead of `/dev/shm`,
+	/// or by a `MFD_HUGETLB` memfd with `fd_socket`
+	hugetlbfs = 2,
+};
+
+static const std::unordered_map<std::string, huge_pages_t> huge_pages_map = {
+	{"none", huge_pages_t::none},
+	{"transparent", huge_pages_t::transparent},
+	{"hugetlbfs", huge_pages_t::hugetlbfs},
+};
+
+inline std::string_view huge_pages_to_string(const huge_pages_t huge_pages) {
+	for (const auto &[key, value] : huge_pages_map) {
+		if (value == huge_pages) {
+			return key;
+		}
+	}
+	throw invalid_argument(std::format("invalid huge_pages value: `{}`", static_cast<int>(huge_pages)));
+}
+
+inline huge_pages_t huge_pages_from_string(const std::string_view s) {
+	for (const auto &[key, value] : huge_pages_map) {
+		if (key == s) {
+			return value;
+		}
+	}
+	throw invalid_argument(std::format("invalid huge_pages key: `{}`", s));
+}
+
+/// backing of the shared memory object (`[memory]` table); fixed for the lifetime of the process
+struct MemoryConfig {
+	huge_pages_t huge_pages = huge_pages_t::none;
+	/// mount point of hugetlbfs, for `huge_pages = "hugetlbfs"`
+	std::string hugetlbfs_path = "/dev/hugepages";
+	/// fault the pages in when mapping (`MAP_POPULATE`) instead of on the first frame
+	bool prefault = true;
+	/// `mlock` the mappings so they are never paged out; needs `RLIMIT_MEMLOCK` or `CAP_IPC_LOCK`
+	bool lock = false;
+	/// bind the pages to this NUMA node; also the default CPU affinity, see `Config::cpu_affinity`
+	std::optional<uint32_t> numa_node;
+	/// create an anonymous `memfd` instead of a named object, and hand its file
+	/// descriptor to consumers connecting to this unix socket path
+	std::optional<std::string> fd_socket;
+
+	static MemoryConfig from_toml(const toml::table &table) {
+		MemoryConfig config;
+		if (const auto huge_pages = table["huge_pages"]; huge_pages) {
+			config.huge_pages = huge_pages_from_string(*huge_pages.value<std::string>());
+		}
+		if (const auto path = table["hugetlbfs_path"]; path) {
+			config.hugetlbfs_path = *path.value<std::string>();
+		}
+		if (const auto prefault = table["prefault"]; prefault) {
+			config.prefault = *prefault.value<bool>();
+		}
+		if (const auto lock = table["lock"]; lock) {
+			config.lock = *lock.value<bool>();
+		}
+		if (const auto numa_node = table["numa_node"]; numa_node) {
+			config.numa_node = *numa_node.value<uint32_t>();
+		}
+		if (const auto fd_socket = table["fd_socket"]; fd_socket) {
+			config.fd_socket = *fd_socket.value<std::string>();
+		}
+		return config;
+	}
+
+	[[nodiscard]]
+	toml::table to_toml() const {
+		auto tbl = toml::table{
+			{"huge_pages", huge_pages_to_string(huge_pages)},
+			{"hugetlbfs_path", hugetlbfs_path},
+			{"prefault", prefault},
+			{"lock", lock},
+		};
+		if (numa_node) {
+			tbl.insert_or_assign("numa_node", *numa_node);
+		}
+		if (fd_socket) {
+			tbl.insert_or_assign("fd_socket", *fd_socket);
+		}
+		return tbl;
+	}
+
+	bool operator==(const MemoryConfig &) const = default;
+};
+
+struct Config {
+	/// name of shared memory (with `shm_open` and `shm_unlink`, or the file name on hugetlbfs)
+	std::string name;
+	/// pipeline or index, depends on API; unused by `synthetic`
+	std::variant<std::string, int> pipeline;
+	/// API preference used by OpenCV, or `CAP_SYNTHETIC`
+	cap_api_t api_preference = cv::CAP_ANY;
+	/// frames of `api = "synthetic"` (`[synthetic]` table)
+	synthetic_options_t synthetic;
+	/// ZMQ address for synchronization
+	std::string zmq_address;
+	/// whether the video source is looped, when it's a finite source
+	bool is_loop = false;
+	/// a registered consumer without a heartbeat for this long is considered gone
+	uint32_t consumer_timeout_ms = 5000;
+	/// stop reading from the source while no consumer is registered
+	bool pause_when_idle = false;
+	/// number of frames kept in the shared memory ring
+	uint32_t slot_count = 1;
+	/// how many ring slots consumers may lease at the same time; 0 disables leasing.
+	/// at least two slots stay writable, so `slot_count` must be `max_pinned + 2` or more
+	uint32_t max_pinned = 0;
+	/// pad every row in the ring to a multiple of this many bytes, e.g. 64 for AVX-512; 1 packs rows tightly
+	uint32_t row_alignment = 1;
+	/// start every frame in the ring on a multiple of this many bytes, e.g. 4096 or 2097152
+	uint32_t frame_alignment = 64;
+	/// frames of at least this many bytes are copied into the ring with non-temporal stores; 0 never
+	uint64_t non_temporal_threshold = DEFAULT_NON_TEMPORAL_THRESHOLD;
+	/// threads copying a frame into the ring, including the capture thread; 1 copies on the capture thread only
+	uint32_t copy_threads = 1;
+	/// frames of at least this many bytes are split across `copy_threads`
+	uint64_t parallel_copy_threshold = DEFAULT_PARALLEL_COPY_THRESHOLD;
+	/// bytes of side data records (`side_data_record_t`) each ring slot can hold next to its frame; 0 disables them
+	uint32_t side_data_size = 0;
+	/// layout of the synchronization message; 2 is `sync_message_v2_t`,
+	/// 1 is the original `sync_message_t`, for consumers that parse only that.
+	/// they still have to find the frames through `shm_header_t`
+	uint32_t wire_version = SYNC_VERSION;
+	/// channel order of 3 and 4 channel frames in the ring and on the network stream;
+	/// `rgb` swaps the channels while copying, saving consumers a conversion
+	channel_order_t channel_order = channel_order_t::bgr;
+	/// lens model to undistort the frames with before `roi` and `output_size` (`[undistort]` table)
+	std::optional<undistort_options_t> undistort;
+	/// `[x, y, width, height]` of the source frames to publish; the whole frame if empty
+	std::optional<cv::Rect> roi;
+	/// `[width, height]` the published region is scaled to; unscaled if empty
+	std::optional<cv::Size> output_size;
+	/// one of `interpolation_map`, used by `output_size`
+	int interpolation = cv::INTER_LINEAR;
+	MemoryConfig memory;
+	/// CPUs the capture, publish and control threads run on; the CPUs of `memory.numa_node` if empty.
+	/// fixed for the lifetime of the process
+	std::vector<uint32_t> cpu_affinity;
+	/// optional ZMQ address of the request/reply control endpoint
+	std::optional<std::string> control_address;
+	/// optional compressed stream for remote consumers
+	std::optional<NetworkConfig> network;
+
+	static Config Default() {
+		// https://github.com/opencv/opencv/blob/f503890c2b2ba73f4f94971c1845ead941143262/modules/videoio/src/cap_gstreamer.cpp#L1535
+		// https://github.com/opencv/opencv/blob/f503890c2b2ba73f4f94971c1845ead941143262/modules/videoio/src/cap_gstreamer.cpp#L1503
+		// an appsink called `opencvsink`
+		return {
+			.name                    = "default",
+			.pipeline                = "videotestsrc ! timeoverlay ! videoconvert ! video/x-raw,format=BGR ! appsink name=opencvsink",
+			.api_preference          = cv::CAP_GSTREAMER,
+			.synthetic               = synthetic_options_t{},
+			.zmq_address             = "ipc:///tmp/0",
+			.is_loop                 = false,
+			.consumer_timeout_ms     = 5000,
+			.pause_when_idle         = false,
+			.slot_count              = 1,
+			.max_pinned              = 0,
+			.row_alignment           = 1,
+			.frame_alignment         = 64,
+			.non_temporal_threshold  = DEFAULT_NON_TEMPORAL_THRESHOLD,
+			.copy_threads            = 1,
+			.parallel_copy_threshold = DEFAULT_PARALLEL_COPY_THRESHOLD,
+			.side_data_size          = 0,
+			.wire_version            = SYNC_VERSION,
+			.channel_order           = channel_order_t::bgr,
+			.undistort               = std::nullopt,
+			.roi                     = std::nullopt,
+			.output_size             = std::nullopt,
+			.interpolation           = cv::INTER_LINEAR,
+			.memory                  = MemoryConfig{},
+			.cpu_affinity            = {},
+			.control_address         = std::nullopt,
+			.network                 = std::nullopt,
+		};
+	}
+
+	static Config from_toml(const toml::table &table) {
+		Config config;
+		if (const auto name = table["name"]; name) {
+			config.name = *name.value<std::string>();
+		} else {
+			throw invalid_argument("name is required");
+		}
+		if (const auto api = table["api"]; api) {
+			config.api_preference = cap_api_from_string(*api.value<std::string>());
+		} else {
+			throw invalid_argument("api is required");
+		}
+		if (const auto pipeline = table["pipeline"]; pipeline) {
+			if (const auto s = pipeline.value<std::string>(); s) {
+				config.pipeline = *s;
+			} else if (const auto i = pipeline.value<int>(); i) {
+				config.pipeline = *i;
+			} else {
+				throw invalid_argument("pipeline must be string or integer");
+			}
+		} else if (config.api_preference != CAP_SYNTHETIC) {
+			throw invalid_argument("pipeline is required");
+		}
+		if (const auto synthetic = table["synthetic"].as_table(); synthetic) {
+			auto &options = config.synthetic;
+			if (const auto width = (*synthetic)["width"]; width) {
+				options.width = *width.value<uint32_t>();
+			}
+			if (const auto height = (*synthetic)["height"]; height) {
+				options.height = *height.value<uint32_t>();
+			}
+			if (const auto depth = (*synthetic)["depth"]; depth) {
+				options.depth = depth_from_string(*depth.value<std::string>());
+				if (options.depth != CV_8U and options.depth != CV_16U and options.depth != CV_32F) {
+					throw invalid_argument("synthetic.depth must be CV_8U, CV_16U or CV_32F");
+				}
+			}
+			if (const auto channels = (*synthetic)["channels"]; channels) {
+				options.channels = *channels.value<uint32_t>();
+				if (options.channels == 0 or options.channels > 4) {
+					throw invalid_argument("synthetic.channels must be in [1, 4]");
+				}
+			}
+			if (const auto fps = (*synthetic)["fps"]; fps) {
+				options.fps = *fps.value<double>();
+				if (options.fps < 0) {
+					throw invalid_argument("synthetic.fps must not be negative");
+				}
+			}
+			if (options.height == 0 or uint64_t{options.width} * options.channels * cv_depth_to_size(options.depth) < sizeof(synthetic_stamp_t)) {
+				throw invalid_argument(std::format("synthetic frames need rows of at least {} bytes", sizeof(synthetic_stamp_t)));
+			}
+		}
+		if (const auto zmq_address = table["zmq_address"]; zmq_address) {
+			config.zmq_address = *zmq_address.value<std::string>();
+		} else {
+			throw invalid_argument("zmq_address is required");
+		}
+		if (const auto is_loop = table["is_loop"]; is_loop) {
+			config.is_loop = *is_loop.value<bool>();
+		} else {
+			config.is_loop = false;
+		}
+		if (const auto timeout = table["consumer_timeout_ms"]; timeout) {
+			config.consumer_timeout_ms = *timeout.value<uint32_t>();
+		}
+		if (const auto pause_when_idle = table["pause_when_idle"]; pause_when_idle) {
+			config.pause_when_idle = *pause_when_idle.value<bool>();
+		}
+		if (const auto slot_count = table["slot_count"]; slot_count) {
+			config.slot_count = *slot_count.value<uint32_t>();
+			if (config.slot_count == 0 || config.slot_count > MAX_SLOTS) {
+				throw invalid_argument(std::format("slot_count must be in [1, {}]", MAX_SLOTS));
+			}
+		}
+		if (const auto max_pinned = table["max_pinned"]; max_pinned) {
+			config.max_pinned = *max_pinned.value<uint32_t>();
+			if (config.max_pinned > 0 && config.slot_count < config.max_pinned + 2) {
+				throw invalid_argument("slot_count must be at least max_pinned + 2");
+			}
+		}
+		if (const auto row_alignment = table["row_alignment"]; row_alignment) {
+			config.row_alignment = *row_alignment.value<uint32_t>();
+			if (not std::has_single_bit(config.row_alignment)) {
+				throw invalid_argument("row_alignment must be a power of two");
+			}
+		}
+		if (const auto frame_alignment = table["frame_alignment"]; frame_alignment) {
+			config.frame_alignment = *frame_alignment.value<uint32_t>();
+			if (not std::has_single_bit(config.frame_alignment) or config.frame_alignment < alignof(frame_slot_t)) {
+				throw invalid_argument(std::format("frame_alignment must be a power of two, at least {}", alignof(frame_slot_t)));
+			}
+		}
+		if (const auto threshold = table["non_temporal_threshold"]; threshold) {
+			config.non_temporal_threshold = *threshold.value<uint64_t>();
+		}
+		if (const auto copy_threads = table["copy_threads"]; copy_threads) {
+			config.copy_threads = *copy_threads.value<uint32_t>();
+			if (config.copy_threads == 0) {
+				throw invalid_argument("copy_threads must be at least 1");
+			}
+		}
+		if (const auto threshold = table["parallel_copy_threshold"]; threshold) {
+			config.parallel_copy_threshold = *threshold.value<uint64_t>();
+		}
+		if (const auto side_data_size = table["side_data_size"]; side_data_size) {
+			config.side_data_size = *side_data_size.value<uint32_t>();
+			if (config.side_data_size > MAX_SIDE_DATA_SIZE) {
+				throw invalid_argument(std::format("side_data_size must be at most {}", MAX_SIDE_DATA_SIZE));
+			}
+		}
+		if (const auto wire_version = table["wire_version"]; wire_version) {
+			config.wire_version = *wire_version.value<uint32_t>();
+			if (config.wire_version != 1 and config.wire_version != SYNC_VERSION) {
+				throw invalid_argument(std::format("wire_version must be 1 or {}", SYNC_VERSION));
+			}
+		}
+		if (const auto channel_order = table["channel_order"]; channel_order) {
+			config.channel_order = channel_order_from_string(*channel_order.value<std::string>());
+		}
+		if (const auto undistort = table["undistort"].as_table(); undistort) {
+			auto options    = undistort_options_t{};
+			const auto read = [&](const char *key, size_t min_size, size_t max_size) {
+				const auto values = (*undistort)[key].as_array();
+				if (values == nullptr or values->size() < min_size or values->size() > max_size) {
+					throw invalid_argument(std::format("undistort.{} must be an array of {} to {} numbers", key, min_size, max_size));
+				}
+				auto ret = std::vector<double>{};
+				for (const auto &value : *values) {
+					if (const auto v = value.value<double>(); v) {
+						ret.push_back(*v);
+					} else {
+						throw invalid_argument(std::format("undistort.{} must be an array of numbers", key));
+					}
+				}
+				return ret;
+			};
+			if (const auto fisheye = (*undistort)["fisheye"]; fisheye) {
+				options.fisheye = *fisheye.value<bool>();
+			}
+			const auto intrinsics = read("intrinsics", 4, 4);
+			std::ranges::copy(intrinsics, options.intrinsics.begin());
+			// what `cv::fisheye` and `cv::initUndistortRectifyMap` accept
+			options.distortion = options.fisheye ? read("distortion", 4, 4) : read("distortion", 4, 8);
+			if (not options.fisheye and options.distortion.size() != 4 and options.distortion.size() != 5 and options.distortion.size() != 8) {
+				throw invalid_argument("undistort.distortion must have 4, 5 or 8 coefficients");
+			}
+			config.undistort = std::move(options);
+		}
+		if (const auto roi = table["roi"].as_array(); roi) {
+			if (roi->size() != 4 or not roi->is_homogeneous<int64_t>()) {
+				throw invalid_argument("roi must be [x, y, width, height]");
+			}
+			config.roi = cv::Rect{*(*roi)[0].value<int>(), *(*roi)[1].value<int>(), *(*roi)[2].value<int>(), *(*roi)[3].value<int>()};
+			if (config.roi->x < 0 or config.roi->y < 0 or config.roi->width <= 0 or config.roi->height <= 0) {
+				throw invalid_argument("roi must have a non-negative origin and a positive size");
+			}
+		}
+		if (const auto size = table["output_size"].as_array(); size) {
+			if (size->size() != 2 or not size->is_homogeneous<int64_t>()) {
+				throw invalid_argument("output_size must be [width, height]");
+			}
+			config.output_size = cv::Size{*(*size)[0].value<int>(), *(*size)[1].value<int>()};
+			if (config.output_size->width <= 0 or config.output_size->height <= 0) {
+				throw invalid_argument("output_size must be positive");
+			}
+		}
+		if (const auto interpolation = table["interpolation"]; interpolation) {
+			config.interpolation = interpolation_from_string(*interpolation.value<std::string>());
+		}
+		if (const auto memory = table["memory"].as_table(); memory) {
+			config.memory = MemoryConfig::from_toml(*memory);
+		}
+		if (const auto cpus = table["cpu_affinity"].as_array(); cpus) {
+			for (const auto &cpu : *cpus) {
+				const auto c = cpu.value<uint32_t>();
+				if (not c) {
+					throw invalid_argument("cpu_affinity must be an array of CPU indices");
+				}
+				if (*c >= MAX_CPUS) {
+					throw invalid_argument(std::format("cpu_affinity must be in [0, {})", MAX_CPUS));
+				}
+				config.cpu_affinity.push_back(*c);
+			}
+		}
+		if (const auto control_address = table["control_address"]; control_address) {
+			config.control_address = *control_address.value<std::string>();
+		}
+		if (const auto network = table["network"].as_table(); network) {
+			config.network = NetworkConfig::from_toml(*network);
+		}
+		return config;
+	}
+
+	[[nodiscard]]
+	std::string to_toml() const {
+		auto ss  = std::stringstream{};
+		auto tbl = toml::table{
+			{"name", name},
+			{"api", cap_api_to_string(api_preference)},
+			{"zmq_address", zmq_address},
+			{"is_loop", is_loop},
+			{"consumer_timeout_ms", consumer_timeout_ms},
+			{"pause_when_idle", pause_when_idle},
+			{"slot_count", slot_count},
+			{"max_pinned", max_pinned},
+			{"row_alignment", row_alignment},
+			{"frame_alignment", frame_alignment},
+			{"non_temporal_threshold", static_cast<int64_t>(non_temporal_threshold)},
+			{"copy_threads", copy_threads},
+			{"parallel_copy_threshold", static_cast<int64_t>(parallel_copy_threshold)},
+			{"side_data_size", side_data_size},
+			{"wire_version", wire_version},
+			{"channel_order", channel_order_to_string(channel_order)},
+			{"interpolation", interpolation_to_string(interpolation)},
+			{"memory", memory.to_toml()},
+		};
+		if (std::holds_alternative<int>(pipeline)) {
+			tbl.insert_or_assign("pipeline", std::get<int>(pipeline));
+		} else {
+			tbl.insert_or_assign("pipeline", std::get<std::string>(pipeline));
+		}
+		if (api_preference == CAP_SYNTHETIC) {
+			tbl.insert_or_assign("synthetic", toml::table{
+												  {"width", synthetic.width},
+												  {"height", synthetic.height},
+												  {"depth", depth_to_string(synthetic.depth)},
+												  {"channels", synthetic.channels},
+												  {"fps", synthetic.fps},
+											  });
+		}
+		if (not cpu_affinity.empty()) {
+			auto cpus = toml::array{};
+			for (const auto cpu : cpu_affinity) {
+				cpus.push_back(cpu);
+			}
+			tbl.insert_or_assign("cpu_affinity", std::move(cpus));
+		}
+		if (undistort) {
+			auto intrinsics = toml::array{};
+			for (const auto v : undistort->intrinsics) {
+				intrinsics.push_back(v);
+			}
+			auto distortion = toml::array{};
+			for (const auto v : undistort->distortion) {
+				distortion.push_back(v);
+			}
+			tbl.insert_or_assign("undistort", toml::table{
+												  {"intrinsics", std::move(intrinsics)},
+												  {"distortion", std::move(distortion)},
+												  {"fisheye", undistort->fisheye},
+											  });
+		}
+		if (roi) {
+			tbl.insert_or_assign("roi", toml::array{roi->x, roi->y, roi->width, roi->height});
+		}
+		if (output_size) {
+			tbl.insert_or_assign("output_size", toml::array{output_size->width, output_size->height});
+		}
+		if (control_address) {
+			tbl.insert_or_assign("control_address", *control_address);
+		}
+		if (network) {
+			tbl.insert_or_assign("network", network->to_toml());
+		}
+		ss << tbl << "\n\n";
+		return ss.str();
+	}
+
+	[[nodiscard]]
+	transform_options_t transform() const {
+		return transform_options_t{
+			.undistort     = undistort,
+			.roi           = roi,
+			.output_size   = output_size,
+			.interpolation = interpolation,
+		};
+	}
+};
+}
@@ -0,0 +1,47 @@
+#include "control.hpp"
+#include <chrono>
+#include <spdlog/spdlog.h>
+
+namespace app {
+control_server::control_server(zmq::context_t &ctx, const std::string &address, handler_t handler)
+	: sock_(ctx, zmq::socket_type::rep), handler_(std::move(handler)) {
+	sock_.set(zmq::sockopt::linger, 0);
+	sock_.bind(address);
+	thread_ = std::thread([this] { run(); });
+}
+
+control_server::~control_server() {
+	is_running_.store(false, std::memory_order::relaxed);
+	thread_.join();
+}
+
+void control_server::run() {
+	// poll with a timeout so that the destructor doesn't need to interrupt a blocking `recv`
+	constexpr auto poll_timeout = std::chrono::milliseconds(100);
+	while (is_running_.load(std::memory_order::relaxed)) {
+		try {
+			zmq::pollitem_t items[] = {{sock_.handle(), 0, ZMQ_POLLIN, 0}};
+			zmq::poll(items, 1, poll_timeout);
+			if ((items[0].revents & ZMQ_POLLIN) == 0) {
+				continue;
+			}
+			zmq::message_t request;
+			if (not sock_.recv(request, zmq::recv_flags::none)) {
+				continue;
+			}
+			const auto command = request.to_string_view();
+			spdlog::debug("control request: `{}`", command);
+			std::string reply;
+			try {
+				reply = handler_(command);
+			} catch (const std::exception &e) {
+				// a REP socket must always answer, or it would be stuck in the receive state
+				reply = reply_error(e.what());
+			}
+			sock_.send(zmq::buffer(reply), zmq::send_flags::none);
+		} catch (const zmq::error_t &e) {
+			spdlog::error("control endpoint error; {}", e.what());
+		}
+	}
+}
+}
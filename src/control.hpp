@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <toml++/toml.hpp>
+#include <zmq.hpp>
+
+namespace app {
+inline std::string reply_ok(toml::table tbl = {}) {
+	tbl.insert_or_assign("ok", true);
+	auto ss = std::stringstream{};
+	ss << toml::json_formatter{tbl};
+	return ss.str();
+}
+
+inline std::string reply_error(std::string_view reason) {
+	auto ss = std::stringstream{};
+	ss << toml::json_formatter{toml::table{
+		{"ok", false},
+		{"error", reason},
+	}};
+	return ss.str();
+}
+
+/// ZMQ REP endpoint answering runtime queries and commands.
+///
+/// a request is a single line of whitespace separated words (e.g. `seek 120`);
+/// the reply is whatever `handler` returns, by convention a JSON object with an `ok` field.
+/// requests are served on a dedicated thread, so `handler` must be thread safe.
+class control_server {
+public:
+	using handler_t = std::function<std::string(std::string_view)>;
+
+	/// @throws zmq::error_t when binding fails
+	control_server(zmq::context_t &ctx, const std::string &address, handler_t handler);
+	~control_server();
+
+	control_server(const control_server &)            = delete;
+	control_server &operator=(const control_server &) = delete;
+
+private:
+	void run();
+
+	zmq::socket_t sock_;
+	handler_t handler_;
+	std::atomic_bool is_running_{true};
+	std::thread thread_;
+};
+}
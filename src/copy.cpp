@@ -0,0 +1,84 @@
+#include "copy.hpp"
+#include <algorithm>
+#include <cstring>
+#include "dispatch.hpp"
+
+namespace app {
+namespace {
+	/// swap the channels of `pixels` pixels of `channels` channels of `T`
+	template <typename T>
+	void swap_rb_pixels(uint8_t *dst, const uint8_t *src, size_t pixels, size_t channels) {
+		const auto pixel_bytes = sizeof(T) * channels;
+		for (size_t i = 0; i < pixels; ++i, dst += pixel_bytes, src += pixel_bytes) {
+			memcpy(dst + sizeof(T), src + sizeof(T), pixel_bytes - sizeof(T));
+			memcpy(dst, src + 2 * sizeof(T), sizeof(T));
+			memcpy(dst + 2 * sizeof(T), src, sizeof(T));
+		}
+	}
+
+	/// the bound SIMD kernels for 8-bit BGR and BGRA, a loop over the channel size otherwise
+	void swap_rb(const kernel_table_t &k, const cv::Mat &src, uint8_t *dst, const uint8_t *data, size_t pixels) {
+		const auto channels = static_cast<size_t>(src.channels());
+		switch (src.type()) {
+		case CV_8UC3:
+			return k.swap_rb_8uc3(dst, data, pixels);
+		case CV_8UC4:
+			return k.swap_rb_8uc4(dst, data, pixels);
+		default:
+			break;
+		}
+		switch (src.elemSize1()) {
+		case 1:
+			return swap_rb_pixels<uint8_t>(dst, data, pixels, channels);
+		case 2:
+			return swap_rb_pixels<uint16_t>(dst, data, pixels, channels);
+		case 4:
+			return swap_rb_pixels<uint32_t>(dst, data, pixels, channels);
+		default:
+			return swap_rb_pixels<uint64_t>(dst, data, pixels, channels);
+		}
+	}
+}
+
+void copy_frame(const cv::Mat &src, uint8_t *dst, size_t dst_stride, const copy_options_t &options) {
+	const auto pixel_bytes = src.elemSize();
+	const auto cols        = static_cast<size_t>(src.cols);
+	const auto row_bytes   = cols * pixel_bytes;
+	const auto rows        = static_cast<size_t>(src.rows);
+	const auto total       = row_bytes * rows;
+	const bool swapping    = options.swap_rb and src.channels() >= 3;
+	const bool streaming   = not swapping and options.non_temporal_threshold != 0 and total >= options.non_temporal_threshold;
+	const auto &k          = swapping or streaming ? kernels() : kernels_for(simd_level_t::scalar);
+	const bool is_packed   = src.isContinuous() and dst_stride == row_bytes;
+	// `pixels` pixels from `data`, converted in the same pass when swapping
+	const auto write = [&](uint8_t *to, const uint8_t *data, size_t pixels) {
+		if (swapping) {
+			swap_rb(k, src, to, data, pixels);
+		} else {
+			k.stream_copy(to, data, pixels * pixel_bytes);
+		}
+	};
+	// rows `[begin, end)`; streaming stores are only ordered by a fence on the thread that issued them
+	const auto copy_rows = [&](size_t begin, size_t end) {
+		if (is_packed) {
+			write(dst + begin * row_bytes, src.data + begin * row_bytes, (end - begin) * cols);
+		} else {
+			for (auto r = begin; r < end; ++r) {
+				write(dst + r * dst_stride, src.ptr(static_cast<int>(r)), cols);
+			}
+		}
+		if (streaming) {
+			k.fence();
+		}
+	};
+
+	const auto bands = options.pool != nullptr and total >= options.parallel_threshold ? std::min(options.pool->size(), rows) : 1;
+	if (bands <= 1) {
+		copy_rows(0, rows);
+		return;
+	}
+	options.pool->parallel_for(bands, [&](size_t band) {
+		copy_rows(band * rows / bands, (band + 1) * rows / bands);
+	});
+}
+}
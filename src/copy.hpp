@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <opencv2/core.hpp>
+#include "common.hpp"
+#include "worker_pool.hpp"
+
+namespace app {
+/// frames at least this large are copied with non-temporal stores by default;
+/// well past the L2 cache, where the producer would only evict data it still needs
+constexpr size_t DEFAULT_NON_TEMPORAL_THRESHOLD = 4 << 20;
+/// frames at least this large are split across the copy threads by default; about
+/// where a single core stops keeping up with the memory bandwidth
+constexpr size_t DEFAULT_PARALLEL_COPY_THRESHOLD = 16 << 20;
+
+/// order of the first three channels of the frames in the ring; OpenCV decodes to BGR
+enum class channel_order_t : uint8_t {
+	bgr = 0,
+	rgb = 1,
+};
+
+static const std::unordered_map<std::string, channel_order_t> channel_order_map = {
+	{"bgr", channel_order_t::bgr},
+	{"rgb", channel_order_t::rgb},
+};
+
+inline std::string_view channel_order_to_string(const channel_order_t order) {
+	for (const auto &[key, value] : channel_order_map) {
+		if (value == order) {
+			return key;
+		}
+	}
+	throw invalid_argument(std::format("invalid channel order value: `{}`", static_cast<int>(order)));
+}
+
+inline channel_order_t channel_order_from_string(const std::string_view s) {
+	for (const auto &[key, value] : channel_order_map) {
+		if (key == s) {
+			return value;
+		}
+	}
+	throw invalid_argument(std::format("invalid channel order key: `{}`", s));
+}
+
+struct copy_options_t {
+	/// frames of at least this many bytes (0 never) go through the streaming
+	/// kernel bound by `bind_kernels`, so they don't push the decoder's working
+	/// set out of the cache
+	size_t non_temporal_threshold = DEFAULT_NON_TEMPORAL_THRESHOLD;
+	/// frames of at least `parallel_threshold` bytes are split into row bands,
+	/// one per thread of `pool`; `nullptr` copies on the calling thread only
+	worker_pool *pool         = nullptr;
+	size_t parallel_threshold = DEFAULT_PARALLEL_COPY_THRESHOLD;
+	/// swap the first and third channel of frames with 3 or more channels while
+	/// copying (BGR <-> RGB), in the same pass; ignored for other frames.
+	/// swapped frames are written with regular stores
+	bool swap_rb = false;
+};
+
+/// copy the pixels of `src` to `dst`, starting a new row every `dst_stride` bytes.
+/// the padding after each row is left untouched. every byte is written when it returns
+void copy_frame(const cv::Mat &src, uint8_t *dst, size_t dst_stride, const copy_options_t &options = {});
+}
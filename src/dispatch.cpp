@@ -0,0 +1,252 @@
+#include "dispatch.hpp"
+#include <algorithm>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CVMMAP_X86 1
+#endif
+
+namespace app {
+namespace {
+	/// bytes until `dst` is aligned to `alignment`, at most `n`
+	size_t head_bytes(const uint8_t *dst, size_t alignment, size_t n) {
+		const auto misalignment = reinterpret_cast<uintptr_t>(dst) % alignment;
+		return std::min(n, misalignment == 0 ? 0 : alignment - misalignment);
+	}
+
+	void stream_copy_scalar(uint8_t *dst, const uint8_t *src, size_t n) {
+		memcpy(dst, src, n);
+	}
+
+	void fence_none() {}
+
+	void xor_scalar(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t n) {
+		size_t i = 0;
+		for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+			uint64_t x, y;
+			memcpy(&x, a + i, sizeof(uint64_t));
+			memcpy(&y, b + i, sizeof(uint64_t));
+			x ^= y;
+			memcpy(dst + i, &x, sizeof(uint64_t));
+		}
+		for (; i < n; ++i) {
+			dst[i] = a[i] ^ b[i];
+		}
+	}
+
+	void swap_rb_8uc3_scalar(uint8_t *dst, const uint8_t *src, size_t pixels) {
+		for (size_t i = 0; i < pixels * 3; i += 3) {
+			dst[i]     = src[i + 2];
+			dst[i + 1] = src[i + 1];
+			dst[i + 2] = src[i];
+		}
+	}
+
+	void swap_rb_8uc4_scalar(uint8_t *dst, const uint8_t *src, size_t pixels) {
+		for (size_t i = 0; i < pixels * 4; i += 4) {
+			uint32_t x;
+			memcpy(&x, src + i, sizeof(x));
+			x = (x & 0xff00ff00) | ((x >> 16) & 0xff) | ((x & 0xff) << 16);
+			memcpy(dst + i, &x, sizeof(x));
+		}
+	}
+
+#ifdef CVMMAP_X86
+	// Every streaming kernel copies an unaligned head with `memcpy` until `dst`
+	// is aligned for the streaming stores, then 64 bytes (one cache line, i.e.
+	// one full write-combining buffer) per iteration, then the tail.
+
+	__attribute__((target("sse2"))) void stream_copy_sse2(uint8_t *dst, const uint8_t *src, size_t n) {
+		const auto head = head_bytes(dst, 16, n);
+		memcpy(dst, src, head);
+		dst += head, src += head, n -= head;
+		for (; n >= 64; n -= 64, dst += 64, src += 64) {
+			const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+			const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16));
+			const auto c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 32));
+			const auto d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 48));
+			_mm_stream_si128(reinterpret_cast<__m128i *>(dst), a);
+			_mm_stream_si128(reinterpret_cast<__m128i *>(dst + 16), b);
+			_mm_stream_si128(reinterpret_cast<__m128i *>(dst + 32), c);
+			_mm_stream_si128(reinterpret_cast<__m128i *>(dst + 48), d);
+		}
+		memcpy(dst, src, n);
+	}
+
+	__attribute__((target("avx2"))) void stream_copy_avx2(uint8_t *dst, const uint8_t *src, size_t n) {
+		const auto head = head_bytes(dst, 32, n);
+		memcpy(dst, src, head);
+		dst += head, src += head, n -= head;
+		for (; n >= 64; n -= 64, dst += 64, src += 64) {
+			const auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+			const auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 32));
+			_mm256_stream_si256(reinterpret_cast<__m256i *>(dst), a);
+			_mm256_stream_si256(reinterpret_cast<__m256i *>(dst + 32), b);
+		}
+		memcpy(dst, src, n);
+	}
+
+	__attribute__((target("avx512f"))) void stream_copy_avx512(uint8_t *dst, const uint8_t *src, size_t n) {
+		const auto head = head_bytes(dst, 64, n);
+		memcpy(dst, src, head);
+		dst += head, src += head, n -= head;
+		for (; n >= 64; n -= 64, dst += 64, src += 64) {
+			_mm512_stream_si512(reinterpret_cast<__m512i *>(dst), _mm512_loadu_si512(src));
+		}
+		memcpy(dst, src, n);
+	}
+
+	/// streaming stores are weakly ordered; order them before whatever publishes the frame
+	__attribute__((target("sse2"))) void fence_sse2() {
+		_mm_sfence();
+	}
+
+	__attribute__((target("sse2"))) void xor_sse2(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t n) {
+		size_t i = 0;
+		for (; i + 16 <= n; i += 16) {
+			const auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+			const auto y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_xor_si128(x, y));
+		}
+		xor_scalar(dst + i, a + i, b + i, n - i);
+	}
+
+	/// the same bit twiddling as `swap_rb_8uc4_scalar`, four pixels at a time
+	__attribute__((target("sse2"))) void swap_rb_8uc4_sse2(uint8_t *dst, const uint8_t *src, size_t pixels) {
+		const auto keep = _mm_set1_epi32(static_cast<int>(0xff00ff00));
+		const auto low  = _mm_set1_epi32(0xff);
+		size_t i        = 0;
+		for (; i + 4 <= pixels; i += 4) {
+			const auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4));
+			const auto y = _mm_or_si128(_mm_and_si128(x, keep),
+										_mm_or_si128(_mm_and_si128(_mm_srli_epi32(x, 16), low),
+													 _mm_slli_epi32(_mm_and_si128(x, low), 16)));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), y);
+		}
+		swap_rb_8uc4_scalar(dst + i * 4, src + i * 4, pixels - i);
+	}
+
+	// SSSE3 comes with every SSE4.2 CPU; `pshufb` swaps the channels of a whole vector at once.
+	// a vector holds five 3-channel pixels and one byte of the sixth, which is passed through
+	// and rewritten by the next iteration, so consecutive vectors are 15 bytes apart
+
+	__attribute__((target("ssse3"))) void swap_rb_8uc3_ssse3(uint8_t *dst, const uint8_t *src, size_t pixels) {
+		const auto mask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+		const auto n    = pixels * 3;
+		size_t i        = 0;
+		for (; i + 16 <= n; i += 15) {
+			const auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_shuffle_epi8(x, mask));
+		}
+		swap_rb_8uc3_scalar(dst + i, src + i, (n - i) / 3);
+	}
+
+	__attribute__((target("ssse3"))) void swap_rb_8uc4_ssse3(uint8_t *dst, const uint8_t *src, size_t pixels) {
+		const auto mask = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+		size_t i        = 0;
+		for (; i + 4 <= pixels; i += 4) {
+			const auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), _mm_shuffle_epi8(x, mask));
+		}
+		swap_rb_8uc4_scalar(dst + i * 4, src + i * 4, pixels - i);
+	}
+
+	/// `pshufb` doesn't cross the 128-bit lanes, so each lane takes five pixels as in the SSSE3
+	/// kernel; the lanes are stored in order, the second one rewriting the passed-through byte
+	__attribute__((target("avx2"))) void swap_rb_8uc3_avx2(uint8_t *dst, const uint8_t *src, size_t pixels) {
+		const auto mask = _mm256_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15,
+										   2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+		const auto n    = pixels * 3;
+		size_t i        = 0;
+		for (; i + 31 <= n; i += 30) {
+			const auto lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+			const auto hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 15));
+			const auto y  = _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1), mask);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm256_castsi256_si128(y));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 15), _mm256_extracti128_si256(y, 1));
+		}
+		swap_rb_8uc3_ssse3(dst + i, src + i, (n - i) / 3);
+	}
+
+	__attribute__((target("avx2"))) void swap_rb_8uc4_avx2(uint8_t *dst, const uint8_t *src, size_t pixels) {
+		const auto mask = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+										   2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+		size_t i        = 0;
+		for (; i + 8 <= pixels; i += 8) {
+			const auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i * 4));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4), _mm256_shuffle_epi8(x, mask));
+		}
+		swap_rb_8uc4_ssse3(dst + i * 4, src + i * 4, pixels - i);
+	}
+
+	__attribute__((target("avx2"))) void xor_avx2(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t n) {
+		size_t i = 0;
+		for (; i + 32 <= n; i += 32) {
+			const auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+			const auto y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_xor_si256(x, y));
+		}
+		xor_scalar(dst + i, a + i, b + i, n - i);
+	}
+
+	__attribute__((target("avx512f"))) void xor_avx512(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t n) {
+		size_t i = 0;
+		for (; i + 64 <= n; i += 64) {
+			const auto x = _mm512_loadu_si512(a + i);
+			const auto y = _mm512_loadu_si512(b + i);
+			_mm512_storeu_si512(dst + i, _mm512_xor_si512(x, y));
+		}
+		xor_scalar(dst + i, a + i, b + i, n - i);
+	}
+#endif
+
+	// indexed by `simd_level_t`. SSE4.2 stands for the SSSE3 shuffles here; AVX-512
+	// binds the AVX2 shuffles, as byte shuffles of 512 bits need AVX-512BW
+	const kernel_table_t kernel_tables[] = {
+		{simd_level_t::scalar, stream_copy_scalar, fence_none, xor_scalar, swap_rb_8uc3_scalar, swap_rb_8uc4_scalar},
+#ifdef CVMMAP_X86
+		{simd_level_t::sse2, stream_copy_sse2, fence_sse2, xor_sse2, swap_rb_8uc3_scalar, swap_rb_8uc4_sse2},
+		{simd_level_t::sse42, stream_copy_sse2, fence_sse2, xor_sse2, swap_rb_8uc3_ssse3, swap_rb_8uc4_ssse3},
+		{simd_level_t::avx2, stream_copy_avx2, fence_sse2, xor_avx2, swap_rb_8uc3_avx2, swap_rb_8uc4_avx2},
+		{simd_level_t::avx512, stream_copy_avx512, fence_sse2, xor_avx512, swap_rb_8uc3_avx2, swap_rb_8uc4_avx2},
+#endif
+	};
+
+	const kernel_table_t *bound = &kernel_tables[0];
+}
+
+simd_level_t detect_simd_level() {
+#ifdef CVMMAP_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		return simd_level_t::avx512;
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		return simd_level_t::avx2;
+	}
+	if (__builtin_cpu_supports("sse4.2")) {
+		return simd_level_t::sse42;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return simd_level_t::sse2;
+	}
+#endif
+	return simd_level_t::scalar;
+}
+
+const kernel_table_t &kernels_for(simd_level_t level) {
+	const auto index = std::min<size_t>(static_cast<size_t>(level), std::size(kernel_tables) - 1);
+	return kernel_tables[index];
+}
+
+simd_level_t bind_kernels(std::optional<simd_level_t> forced) {
+	const auto detected = detect_simd_level();
+	const auto level    = forced and *forced <= detected ? *forced : detected;
+	bound               = &kernels_for(level);
+	return bound->level;
+}
+
+const kernel_table_t &kernels() {
+	return *bound;
+}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "common.hpp"
+
+// Runtime CPU dispatch for the pixel kernels around `set_frame`.
+//
+// The binary targets the baseline ISA; every kernel that profits from wider
+// vectors is compiled once per level with `__attribute__((target))` and bound
+// through `kernel_table_t` at startup, so one build runs on old and new CPUs alike.
+namespace app {
+enum class simd_level_t : uint8_t {
+	scalar = 0,
+	sse2,
+	sse42,
+	avx2,
+	avx512,
+};
+
+static const std::unordered_map<std::string, simd_level_t> simd_level_map = {
+	{"scalar", simd_level_t::scalar},
+	{"sse2", simd_level_t::sse2},
+	{"sse4.2", simd_level_t::sse42},
+	{"avx2", simd_level_t::avx2},
+	{"avx512", simd_level_t::avx512},
+};
+
+inline std::string_view simd_level_to_string(const simd_level_t level) {
+	for (const auto &[key, value] : simd_level_map) {
+		if (value == level) {
+			return key;
+		}
+	}
+	throw invalid_argument(std::format("invalid SIMD level value: `{}`", static_cast<int>(level)));
+}
+
+inline simd_level_t simd_level_from_string(const std::string_view s) {
+	for (const auto &[key, value] : simd_level_map) {
+		if (key == s) {
+			return value;
+		}
+	}
+	throw invalid_argument(std::format("invalid SIMD level key: `{}`", s));
+}
+
+/// the widest level the CPU supports; `scalar` off x86
+simd_level_t detect_simd_level();
+
+struct kernel_table_t {
+	simd_level_t level;
+	/// copy `n` bytes with non-temporal stores where the level has them; call `fence` before publishing
+	void (*stream_copy)(uint8_t *dst, const uint8_t *src, size_t n);
+	/// order the stores of `stream_copy` on the calling thread
+	void (*fence)();
+	/// `dst[i] = a[i] ^ b[i]`; `dst` may alias `a`
+	void (*xor_bytes)(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t n);
+	/// copy `pixels` 8-bit 3-channel pixels with the first and third channel swapped (BGR <-> RGB);
+	/// `dst` must not overlap `src`
+	void (*swap_rb_8uc3)(uint8_t *dst, const uint8_t *src, size_t pixels);
+	/// as `swap_rb_8uc3` for 4-channel pixels; the fourth channel is kept
+	void (*swap_rb_8uc4)(uint8_t *dst, const uint8_t *src, size_t pixels);
+};
+
+/// the kernels of `level`; the CPU must support it
+const kernel_table_t &kernels_for(simd_level_t level);
+
+/// bind the kernels of `forced`, or of `detect_simd_level` without it.
+/// a level the CPU lacks falls back to the detected one.
+/// call once at startup, before any thread uses `kernels()`
+/// @return the bound level
+simd_level_t bind_kernels(std::optional<simd_level_t> forced = std::nullopt);
+
+/// the kernels bound by `bind_kernels`; `scalar` until then
+const kernel_table_t &kernels();
+}
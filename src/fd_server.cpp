@@ -0,0 +1,95 @@
+#include "fd_server.hpp"
+#include "shm_layout.hpp"
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <spdlog/spdlog.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace app {
+fd_server::fd_server(const std::string &path, int shm_fd, uint64_t data_offset)
+	: path_(path), shm_fd_(shm_fd), data_offset_(data_offset) {
+	sockaddr_un addr{};
+	addr.sun_family = AF_UNIX;
+	if (path_.size() >= sizeof(addr.sun_path)) {
+		throw std::system_error(ENAMETOOLONG, std::generic_category(), path_);
+	}
+	memcpy(addr.sun_path, path_.c_str(), path_.size() + 1);
+	listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listen_fd_ == -1) {
+		throw std::system_error(errno, std::generic_category(), "socket");
+	}
+	// left over from a producer that crashed
+	unlink(path_.c_str());
+	if (bind(listen_fd_, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) == -1 or listen(listen_fd_, 16) == -1) {
+		const auto err = errno;
+		close(listen_fd_);
+		throw std::system_error(err, std::generic_category(), path_);
+	}
+	thread_ = std::thread([this] { run(); });
+}
+
+fd_server::~fd_server() {
+	is_running_.store(false, std::memory_order::relaxed);
+	thread_.join();
+	close(listen_fd_);
+	unlink(path_.c_str());
+}
+
+void fd_server::run() {
+	// poll with a timeout so that the destructor doesn't need to interrupt a blocking `accept`
+	constexpr int poll_timeout_ms = 100;
+	while (is_running_.load(std::memory_order::relaxed)) {
+		pollfd item{.fd = listen_fd_, .events = POLLIN, .revents = 0};
+		if (poll(&item, 1, poll_timeout_ms) <= 0 or (item.revents & POLLIN) == 0) {
+			continue;
+		}
+		const auto conn = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+		if (conn == -1) {
+			spdlog::error("failed to accept on `{}`; {} ({})", path_, strerror(errno), errno);
+			continue;
+		}
+		serve(conn);
+		close(conn);
+	}
+}
+
+void fd_server::serve(int conn) const {
+	struct stat st{};
+	if (fstat(shm_fd_, &st) == -1) {
+		spdlog::error("failed to stat shared memory; {} ({})", strerror(errno), errno);
+		return;
+	}
+	const auto desc = shm_descriptor_t{
+		.magic       = SHM_MAGIC,
+		.version     = SHM_VERSION,
+		.reserved    = 0,
+		.data_offset = data_offset_,
+		.size        = static_cast<uint64_t>(st.st_size),
+	};
+	iovec iov{
+		.iov_base = const_cast<shm_descriptor_t *>(&desc),
+		.iov_len  = sizeof(shm_descriptor_t),
+	};
+	alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))]{};
+	msghdr msg{};
+	msg.msg_iov        = &iov;
+	msg.msg_iovlen     = 1;
+	msg.msg_control    = control;
+	msg.msg_controllen = sizeof(control);
+	auto cmsg          = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level   = SOL_SOCKET;
+	cmsg->cmsg_type    = SCM_RIGHTS;
+	cmsg->cmsg_len     = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &shm_fd_, sizeof(int));
+	if (sendmsg(conn, &msg, MSG_NOSIGNAL) == -1) {
+		spdlog::warn("failed to pass shared memory to a consumer; {} ({})", strerror(errno), errno);
+		return;
+	}
+	spdlog::debug("passed shared memory ({} bytes) to a consumer", desc.size);
+}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+namespace app {
+/// hands the file descriptor of an anonymous shared memory object to consumers.
+///
+/// listens on a unix domain socket; every connection gets one `shm_descriptor_t`
+/// with the descriptor attached as `SCM_RIGHTS`, then it's closed. Connections
+/// are served on a dedicated thread.
+class fd_server {
+public:
+	/// a stale socket file at `path` is replaced
+	/// @throws std::system_error when the socket can't be bound
+	fd_server(const std::string &path, int shm_fd, uint64_t data_offset);
+	~fd_server();
+
+	fd_server(const fd_server &)            = delete;
+	fd_server &operator=(const fd_server &) = delete;
+
+private:
+	void run();
+	void serve(int conn) const;
+
+	std::string path_;
+	int listen_fd_ = -1;
+	int shm_fd_;
+	uint64_t data_offset_;
+	std::atomic_bool is_running_{true};
+	std::thread thread_;
+};
+}
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <atomic>
 #include <iostream>
 #include <filesystem>
@@ -9,11 +10,28 @@
 #include <charconv>
 #include <expected>
 #include <span>
+#include <memory>
+#include <mutex>
 #include <CLI/CLI.hpp>
 #include <toml++/toml.hpp>
 #include <spdlog/spdlog.h>
 #include <opencv2/videoio.hpp>
 #include <zmq_addon.hpp>
+#include "common.hpp"
+#include "config.hpp"
+#include "net.hpp"
+#include "control.hpp"
+#include "stats.hpp"
+#include "shm_layout.hpp"
+#include "side_data.hpp"
+#include "memory.hpp"
+#include "numa.hpp"
+#include "fd_server.hpp"
+#include "copy.hpp"
+#include "dispatch.hpp"
+#include "transform.hpp"
+#include "subscription.hpp"
+#include "synthetic.hpp"
 #include <sys/types.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
@@ -45,231 +63,6 @@
 #define STRR(X) #X
 #define STR(X)  STRR(X)
 
-namespace app {
-using invalid_argument = std::invalid_argument;
-
-constexpr std::string_view trim(std::string_view s) {
-	s.remove_prefix(std::min(s.find_first_not_of(" \t\r\v\n"), s.size()));
-	s.remove_suffix(std::min(s.size() - s.find_last_not_of(" \t\r\v\n") - 1, s.size()));
-	return s;
-}
-
-constexpr auto FRAME_TOPIC_MAGIC = 0x7d;
-using cap_api_t                  = decltype(cv::CAP_ANY);
-
-static const std::unordered_map<std::string, cap_api_t> api_map = {
-	{"any", cv::CAP_ANY},
-	{"v4l", cv::CAP_V4L},
-	{"v4l2", cv::CAP_V4L2},
-	{"gstreamer", cv::CAP_GSTREAMER},
-	{"dshow", cv::CAP_DSHOW},
-	{"avfoundation", cv::CAP_AVFOUNDATION},
-	{"ffmpeg", cv::CAP_FFMPEG},
-};
-
-std::string_view cap_api_to_string(const cap_api_t api) {
-	for (const auto &[key, value] : api_map) {
-		if (value == api) {
-			return key;
-		}
-	}
-	throw invalid_argument(std::format("invalid API value: `{}`", static_cast<int>(api)));
-}
-
-cap_api_t cap_api_from_string(const std::string_view s) {
-	for (const auto &[key, value] : api_map) {
-		if (key == s) {
-			return value;
-		}
-	}
-	throw invalid_argument(std::format("invalid API key: `{}`", s));
-}
-
-struct Config {
-	/// name of shared memory (with `shm_open` and `shm_unlink`)
-	std::string name;
-	/// pipeline or index, depends on API
-	std::variant<std::string, int> pipeline;
-	/// API preference used by OpenCV
-	cap_api_t api_preference = cv::CAP_ANY;
-	/// ZMQ address for synchronization
-	std::string zmq_address;
-	/// whether the video source is looped, when it's a finite source
-	bool is_loop = false;
-
-	static Config Default() {
-		// https://github.com/opencv/opencv/blob/f503890c2b2ba73f4f94971c1845ead941143262/modules/videoio/src/cap_gstreamer.cpp#L1535
-		// https://github.com/opencv/opencv/blob/f503890c2b2ba73f4f94971c1845ead941143262/modules/videoio/src/cap_gstreamer.cpp#L1503
-		// an appsink called `opencvsink`
-		return {
-			.name           = "default",
-			.pipeline       = "videotestsrc ! timeoverlay ! videoconvert ! video/x-raw,format=BGR ! appsink name=opencvsink",
-			.api_preference = cv::CAP_GSTREAMER,
-			.zmq_address    = "ipc:///tmp/0",
-			.is_loop        = false,
-		};
-	}
-
-	static Config from_toml(const toml::table &table) {
-		Config config;
-		if (const auto name = table["name"]; name) {
-			config.name = *name.value<std::string>();
-		} else {
-			throw invalid_argument("name is required");
-		}
-		if (const auto pipeline = table["pipeline"]; pipeline) {
-			if (const auto s = pipeline.value<std::string>(); s) {
-				config.pipeline = *s;
-			} else if (const auto i = pipeline.value<int>(); i) {
-				config.pipeline = *i;
-			} else {
-				throw invalid_argument("pipeline must be string or integer");
-			}
-		} else {
-			throw invalid_argument("pipeline is required");
-		}
-		if (const auto api = table["api"]; api) {
-			config.api_preference = cap_api_from_string(*api.value<std::string>());
-		} else {
-			throw invalid_argument("api is required");
-		}
-		if (const auto zmq_address = table["zmq_address"]; zmq_address) {
-			config.zmq_address = *zmq_address.value<std::string>();
-		} else {
-			throw invalid_argument("zmq_address is required");
-		}
-		if (const auto is_loop = table["is_loop"]; is_loop) {
-			config.is_loop = *is_loop.value<bool>();
-		} else {
-			config.is_loop = false;
-		}
-		return config;
-	}
-
-	[[nodiscard]]
-	std::string to_toml() const {
-		auto ss  = std::stringstream{};
-		auto tbl = toml::table{
-			{"name", name},
-			{"api", cap_api_to_string(api_preference)},
-			{"zmq_address", zmq_address},
-			{"is_loop", is_loop},
-		};
-		if (std::holds_alternative<int>(pipeline)) {
-			tbl.insert_or_assign("pipeline", std::get<int>(pipeline));
-		} else {
-			tbl.insert_or_assign("pipeline", std::get<std::string>(pipeline));
-		}
-		ss << tbl << "\n\n";
-		return ss.str();
-	}
-};
-
-std::string depth_to_string(const int depth) {
-	switch (depth) {
-	case CV_8U:
-		return "CV_8U";
-	case CV_8S:
-		return "CV_8S";
-	case CV_16U:
-		return "CV_16U";
-	case CV_16S:
-		return "CV_16S";
-	case CV_16F:
-		return "CV_16F";
-	case CV_32S:
-		return "CV_32S";
-	case CV_32F:
-		return "CV_32F";
-	case CV_64F:
-		return "CV_64F";
-	default:
-		return "unknown";
-	}
-}
-
-// https://gist.github.com/yangcha/38f2fa630e223a8546f9b48ebbb3e61a
-inline int cv_depth_to_size(int depth) {
-	switch (depth) {
-	case CV_8U:
-	case CV_8S:
-		return 1;
-	case CV_16U:
-	case CV_16S:
-	case CV_16F:
-		return 2;
-	case CV_32S:
-	case CV_32F:
-		return 4;
-	case CV_64F:
-		return 8;
-	default:
-		throw app::invalid_argument(std::format("invalid depth value `{}`", depth));
-	}
-}
-
-// https://docs.opencv.org/4.x/d3/d63/classcv_1_1Mat.html
-// See `Detailed Description`
-// strides for each dimension
-// stride[0]=channel
-// stride[1]=channel*cols
-// stride[2]=channel*cols*rows
-struct __attribute__((packed)) frame_info_t {
-	uint16_t width;
-	uint16_t height;
-	uint8_t channels;
-	/// CV_8U, CV_8S, CV_16U, CV_16S, CV_16F, CV_32S, CV_32F, CV_64F
-	uint8_t depth;
-	uint32_t buffer_size;
-
-	[[nodiscard]]
-	int pixelWidth() const {
-		return cv_depth_to_size(depth);
-	}
-
-	int marshal(std::span<uint8_t> buf) const {
-		if (buf.size() < sizeof(frame_info_t)) {
-			return -1;
-		}
-		memcpy(buf.data(), this, sizeof(frame_info_t));
-		return sizeof(frame_info_t);
-	}
-
-	static std::optional<frame_info_t> unmarshal(const std::span<uint8_t> buf) {
-		if (buf.size() < sizeof(frame_info_t)) {
-			return std::nullopt;
-		}
-		frame_info_t info;
-		memcpy(&info, buf.data(), sizeof(frame_info_t));
-		return info;
-	}
-};
-
-struct __attribute__((packed)) sync_message_t {
-	uint32_t frame_count;
-	frame_info_t info;
-	// NOTE: I don't need the `name` field
-	// as long as we don't share same IPC socket for different video sources.
-	int marshal(std::span<uint8_t> buf) const {
-		if (buf.size() < sizeof(sync_message_t)) {
-			return -1;
-		}
-		memcpy(buf.data(), this, sizeof(sync_message_t));
-		return sizeof(sync_message_t);
-	}
-
-	static std::optional<sync_message_t> unmarshal(const std::span<uint8_t> buf) {
-		if (buf.size() < sizeof(sync_message_t)) {
-			return std::nullopt;
-		}
-		sync_message_t msg;
-		memcpy(&msg, buf.data(), sizeof(sync_message_t));
-		return msg;
-	}
-};
-}
-
-
 namespace app::version {
 constexpr auto revision          = STR(GIT_REV);
 constexpr auto tag               = STR(GIT_TAG);
@@ -301,6 +94,9 @@ int main(int argc, char **argv) {
 	app.add_flag("-d,--debug", use_debug, "Enable debug log");
 	static bool use_trace = false;
 	app.add_flag("--trace", use_trace, "Enable trace log");
+	static std::string simd_level;
+	app.add_option("--simd", simd_level, "Force the pixel kernels to a level for testing; scalar, sse2, sse4.2, avx2 or avx512")
+		->check(CLI::IsMember(simd_level_map));
 	CLI11_PARSE(app, argc, argv);
 	if (use_debug) {
 		spdlog::set_level(spdlog::level::debug);
@@ -310,6 +106,15 @@ int main(int argc, char **argv) {
 		spdlog::set_level(spdlog::level::info);
 	}
 
+	{
+		const auto forced = simd_level.empty() ? std::nullopt : std::optional{simd_level_from_string(simd_level)};
+		const auto bound  = bind_kernels(forced);
+		if (forced and *forced != bound) {
+			spdlog::warn("the CPU doesn't support {} kernels", simd_level);
+		}
+		spdlog::info("pixel kernels: {} (CPU supports {})", simd_level_to_string(bound), simd_level_to_string(detect_simd_level()));
+	}
+
 	const std::filesystem::path config_path = config_file;
 	if (not std::filesystem::exists(config_path)) {
 		if (use_default) {
@@ -323,21 +128,60 @@ int main(int argc, char **argv) {
 			return 1;
 		}
 	}
-	toml::table config_tbl;
-	try {
-		config_tbl = toml::parse_file(config_file);
-	} catch (const toml::parse_error &e) {
-		spdlog::error("failed to parse config file: {}", e.what());
-		return 1;
-	}
+	const auto load_config = [] -> std::optional<app::Config> {
+		toml::table config_tbl;
+		try {
+			config_tbl = toml::parse_file(config_file);
+		} catch (const toml::parse_error &e) {
+			spdlog::error("failed to parse config file: {}", e.what());
+			return std::nullopt;
+		}
+		try {
+			return app::Config::from_toml(config_tbl);
+		} catch (const app::invalid_argument &e) {
+			spdlog::error("invalid config: {}", e.what());
+			return std::nullopt;
+		}
+	};
 	app::Config config;
-	try {
-		config = app::Config::from_toml(config_tbl);
-	} catch (const app::invalid_argument &e) {
-		spdlog::error("invalid config: {}", e.what());
+	if (auto c = load_config(); c) {
+		config = std::move(*c);
+	} else {
 		return 1;
 	}
 
+	// before any thread exists (ZMQ I/O threads included), so that every thread inherits it
+	auto cpus = config.cpu_affinity;
+	if (cpus.empty() and config.memory.numa_node) {
+		if (auto node = node_cpus(*config.memory.numa_node); node) {
+			cpus = std::move(*node);
+		} else {
+			spdlog::warn("failed to read the CPUs of NUMA node {}", *config.memory.numa_node);
+		}
+	}
+	if (const auto allowed = allowed_cpus(); not cpus.empty() and not allowed.empty()) {
+		// the kernel would drop them silently, or refuse the whole set if none is left
+		auto denied = std::vector<uint32_t>{};
+		std::erase_if(cpus, [&](uint32_t cpu) {
+			if (std::ranges::find(allowed, cpu) != allowed.end()) {
+				return false;
+			}
+			denied.push_back(cpu);
+			return true;
+		});
+		if (not denied.empty()) {
+			spdlog::error("CPU(s) {} are not allowed for this process (cpuset or taskset); skip them", format_cpu_list(denied));
+		}
+	}
+	if (not cpus.empty()) {
+		const auto list = format_cpu_list(cpus);
+		if (set_cpu_affinity(cpus)) {
+			spdlog::info("run on CPU(s) {}", list);
+		} else {
+			spdlog::warn("failed to set CPU affinity to {}; {} ({})", list, strerror(errno), errno);
+		}
+	}
+
 	// https://libzmq.readthedocs.io/en/latest/zmq_ipc.html
 	// https://libzmq.readthedocs.io/en/latest/zmq_inproc.html
 	zmq::context_t ctx;
@@ -350,20 +194,81 @@ int main(int argc, char **argv) {
 	}
 	spdlog::info("bind to ZMQ address: `{}`", config.zmq_address);
 
-	std::cout << "Config Used: " << config.to_toml() << std::endl;
-	cv::VideoCapture cap;
-	// https://gstreamer.freedesktop.org/documentation/shm/shmsink.html?gi-language=c
-	if (std::holds_alternative<int>(config.pipeline)) {
-		const auto index = std::get<int>(config.pipeline);
-		spdlog::info("open video source index (int): {}", index);
-		cap.open(index, config.api_preference);
+	// guards the pointer itself against the control thread; only the main thread replaces it
+	std::mutex net_mutex;
+	std::unique_ptr<net_publisher> net;
+	const auto make_net = [&ctx](const std::optional<NetworkConfig> &network) -> std::expected<std::unique_ptr<net_publisher>, int> {
+		using ue_t = std::unexpected<int>;
+		if (not network) {
+			return nullptr;
+		}
+		std::unique_ptr<net_publisher> ret;
+		try {
+			ret = std::make_unique<net_publisher>(ctx, *network);
+		} catch (const zmq::error_t &e) {
+			spdlog::error("failed to bind network stream to `{}`: {}", network->address, e.what());
+			return ue_t{-1};
+		} catch (const app::invalid_argument &e) {
+			spdlog::error("invalid network config: {}", e.what());
+			return ue_t{-1};
+		}
+		spdlog::info("publish {} compressed stream on `{}` (delta={}, keyframe_interval={}, workers={})",
+					 codec_to_string(network->codec), network->address,
+					 network->delta, network->keyframe_interval, network->workers);
+		return ret;
+	};
+	if (auto ret = make_net(config.network); ret) {
+		net = std::move(*ret);
 	} else {
-		const auto pipeline = std::get<std::string>(config.pipeline);
-		spdlog::info("open video source pipeline (string): {}", pipeline);
-		cap.open(pipeline, config.api_preference);
+		return 1;
 	}
-	if (not cap.isOpened()) {
-		spdlog::error("failed to open video source. check OpenCV VideoCapture API support if you're sure the source is correct.");
+
+	// workers pinned one per CPU the producer may run on; the capture thread copies a band itself
+	const auto make_copy_pool = [](uint32_t copy_threads) -> std::unique_ptr<worker_pool> {
+		if (copy_threads <= 1) {
+			return nullptr;
+		}
+		const auto pinned = allowed_cpus();
+		spdlog::info("copy large frames on {} threads, pinned to {} CPU(s)", copy_threads, pinned.size());
+		return std::make_unique<worker_pool>(copy_threads, pinned);
+	};
+	auto copy_pool = make_copy_pool(config.copy_threads);
+
+	std::cout << "Config Used: " << config.to_toml() << std::endl;
+	// a `synthetic_capture` for `api = "synthetic"`
+	auto cap = std::make_unique<cv::VideoCapture>();
+	// whether `CAP_PROP_POS_MSEC` of the open source is a capture time on `CLOCK_MONOTONIC`
+	bool has_monotonic_pos = false;
+	const auto open_source = [&cap, &has_monotonic_pos](const app::Config &config) {
+		// https://gstreamer.freedesktop.org/documentation/shm/shmsink.html?gi-language=c
+		if (config.api_preference == CAP_SYNTHETIC) {
+			const auto &synthetic = config.synthetic;
+			spdlog::info("open synthetic source: {}x{}x{}; depth={}; fps={}",
+						 synthetic.width, synthetic.height, synthetic.channels, app::depth_to_string(synthetic.depth), synthetic.fps);
+			cap = std::make_unique<synthetic_capture>(synthetic);
+		} else if (std::holds_alternative<int>(config.pipeline)) {
+			const auto index = std::get<int>(config.pipeline);
+			spdlog::info("open video source index (int): {}", index);
+			cap = std::make_unique<cv::VideoCapture>();
+			cap->open(index, config.api_preference);
+		} else {
+			const auto pipeline = std::get<std::string>(config.pipeline);
+			spdlog::info("open video source pipeline (string): {}", pipeline);
+			cap = std::make_unique<cv::VideoCapture>();
+			cap->open(pipeline, config.api_preference);
+		}
+		if (not cap->isOpened()) {
+			spdlog::error("failed to open video source. check OpenCV VideoCapture API support if you're sure the source is correct.");
+			return false;
+		}
+		// `CAP_PROP_POS_MSEC` is the driver timestamp of the buffer on V4L2, and the stamp of `synthetic_capture`;
+		// other backends report a stream position there, whatever its value
+		const auto backend = config.api_preference == CAP_SYNTHETIC ? std::string{"synthetic"} : cap->getBackendName();
+		has_monotonic_pos  = config.api_preference == CAP_SYNTHETIC or backend == "V4L2";
+		spdlog::info("video backend: {}; capture timestamps from the backend: {}", backend, has_monotonic_pos);
+		return true;
+	};
+	if (not open_source(config)) {
 		std::cout << cv::getBuildInformation() << std::endl;
 		return 1;
 	}
@@ -373,8 +278,8 @@ int main(int argc, char **argv) {
 		uint32_t frame_count;
 	};
 	const auto check_finite_source = [&cap] -> std::optional<finite_source_info_t> {
-		const auto fps         = cap.get(cv::CAP_PROP_FPS);
-		const auto frame_count = cap.get(cv::CAP_PROP_FRAME_COUNT);
+		const auto fps         = cap->get(cv::CAP_PROP_FPS);
+		const auto frame_count = cap->get(cv::CAP_PROP_FRAME_COUNT);
 		if (fps > 0 and frame_count > 0) {
 			return finite_source_info_t{
 				.fps         = fps,
@@ -385,42 +290,242 @@ int main(int argc, char **argv) {
 	};
 
 	const auto reset_video_position = [&cap] {
-		cap.set(cv::CAP_PROP_POS_FRAMES, 0);
+		cap->set(cv::CAP_PROP_POS_FRAMES, 0);
 	};
 	const auto get_video_position = [&cap] -> int {
-		return static_cast<int>(cap.get(cv::CAP_PROP_POS_FRAMES));
+		return static_cast<int>(cap->get(cv::CAP_PROP_POS_FRAMES));
 	};
 
 
 	static size_t frame_count = 0;
 	static std::atomic_bool is_running{true};
+	static std::atomic_bool is_reload_requested{false};
 	constexpr auto sigint_handler = [](int) {
 		spdlog::info("SIGINT received, stopping...");
 		is_running.store(false, std::memory_order::relaxed);
 	};
+	constexpr auto sighup_handler = [](int) {
+		is_reload_requested.store(true, std::memory_order::relaxed);
+	};
 	std::signal(SIGINT, sigint_handler);
-	const auto finite_source_info = check_finite_source();
-	const auto frame_interval_ms  = [finite_source_info] -> std::optional<int> {
-        if (finite_source_info) {
-            return static_cast<int>(1000.0 / finite_source_info->fps);
-        } else {
-            return std::nullopt;
-        }
-	}();
-	if (finite_source_info) {
-		spdlog::info("detected finite source; fps={} ({}ms), frame_count={}, is_loop={}",
-					 finite_source_info->fps, *frame_interval_ms, finite_source_info->frame_count, config.is_loop);
-	} else {
-		spdlog::info("infinite source detected (live stream)");
-	}
+	std::signal(SIGHUP, sighup_handler);
+	std::optional<finite_source_info_t> finite_source_info;
+	std::optional<int> frame_interval_ms;
+	// mirrors `finite_source_info->frame_count` for the control thread; -1 for a live source
+	static std::atomic<int64_t> finite_frame_count{-1};
+	const auto probe_source = [&] {
+		finite_source_info = check_finite_source();
+		if (finite_source_info) {
+			frame_interval_ms = static_cast<int>(1000.0 / finite_source_info->fps);
+			finite_frame_count.store(finite_source_info->frame_count, std::memory_order::relaxed);
+			spdlog::info("detected finite source; fps={} ({}ms), frame_count={}, is_loop={}",
+						 finite_source_info->fps, *frame_interval_ms, finite_source_info->frame_count, config.is_loop);
+		} else {
+			frame_interval_ms = std::nullopt;
+			finite_frame_count.store(-1, std::memory_order::relaxed);
+			spdlog::info("infinite source detected (live stream)");
+		}
+	};
+	probe_source();
+
+	// written by the control thread, consumed by the capture loop
+	static std::atomic_bool is_paused{false};
+	static std::atomic<double> playback_speed{1.0};
+	static std::atomic<int64_t> seek_request{-1};
+	// of the current config; a reload replaces it
+	std::atomic<uint64_t> consumer_timeout_ns{uint64_t{config.consumer_timeout_ms} * NS_PER_MS};
+	stream_stats stats;
+	roi_subscriptions subscriptions{config.name, config.memory};
+	// mapped before the control endpoint starts and never moves
+	shm_header_t *header      = nullptr;
+	const auto handle_control = [&stats, &net, &net_mutex, &header, &subscriptions,
+								 &consumer_timeout_ns](std::string_view command) -> std::string {
+		auto iss  = std::istringstream{std::string{command}};
+		auto verb = std::string{};
+		iss >> verb;
+		if (verb == "stats") {
+			const auto s = stats.snapshot();
+			auto latency = toml::table{
+				{"p50", s.latency_p50_us},
+				{"p90", s.latency_p90_us},
+				{"p99", s.latency_p99_us},
+				{"max", s.latency_max_us},
+			};
+			uint64_t network_dropped = 0;
+			{
+				std::lock_guard lock{net_mutex};
+				network_dropped = net ? net->dropped() : 0;
+			}
+			auto tbl = toml::table{
+				{"frame_count", static_cast<int64_t>(s.frame_count)},
+				{"published", static_cast<int64_t>(s.published)},
+				{"dropped", static_cast<int64_t>(s.dropped)},
+				{"network_dropped", static_cast<int64_t>(network_dropped)},
+				{"fps", s.fps},
+				{"latency_us", std::move(latency)},
+				{"paused", is_paused.load(std::memory_order::relaxed)},
+				{"speed", playback_speed.load(std::memory_order::relaxed)},
+				{"generation", static_cast<int64_t>(header->generation.load(std::memory_order::relaxed))},
+				{"pinned", static_cast<int64_t>(header->pinned_total.load(std::memory_order::relaxed))},
+			};
+			if (s.info) {
+				auto info_tbl = toml::table{
+					{"width", static_cast<int64_t>(s.info->width)},
+					{"height", static_cast<int64_t>(s.info->height)},
+					{"channels", static_cast<int64_t>(s.info->channels)},
+					{"depth", depth_to_string(s.info->depth)},
+					{"buffer_size", static_cast<int64_t>(s.info->buffer_size)},
+				};
+				tbl.insert_or_assign("info", std::move(info_tbl));
+			}
+			return reply_ok(std::move(tbl));
+		}
+		if (verb == "consumers") {
+			const auto latest = stats.snapshot().frame_count;
+			auto consumers    = toml::array{};
+			for (const auto &c : list_consumers(*header)) {
+				consumers.push_back(toml::table{
+					{"pid", static_cast<int64_t>(c.pid)},
+					{"name", c.name},
+					{"last_frame_count", static_cast<int64_t>(c.last_frame_count)},
+					{"lag", static_cast<int64_t>(latest > c.last_frame_count ? latest - c.last_frame_count : 0)},
+					{"heartbeat_age_ms", static_cast<double>(c.heartbeat_age_ns) / NS_PER_MS},
+				});
+			}
+			return reply_ok(toml::table{{"consumers", std::move(consumers)}});
+		}
+		if (verb == "pause") {
+			is_paused.store(true, std::memory_order::relaxed);
+			return reply_ok();
+		}
+		if (verb == "resume") {
+			is_paused.store(false, std::memory_order::relaxed);
+			return reply_ok();
+		}
+		if (verb == "seek") {
+			const auto total = finite_frame_count.load(std::memory_order::relaxed);
+			if (total < 0) {
+				return reply_error("seek is only supported for finite sources");
+			}
+			int64_t target = -1;
+			if (not(iss >> target) or target < 0 or target >= total) {
+				return reply_error(std::format("usage: seek <frame in [0, {})>", total));
+			}
+			seek_request.store(target, std::memory_order::relaxed);
+			return reply_ok();
+		}
+		if (verb == "speed") {
+			if (finite_frame_count.load(std::memory_order::relaxed) < 0) {
+				return reply_error("playback speed is only supported for finite sources");
+			}
+			double speed = 0;
+			if (not(iss >> speed) or speed <= 0) {
+				return reply_error("usage: speed <positive factor>");
+			}
+			playback_speed.store(speed, std::memory_order::relaxed);
+			return reply_ok();
+		}
+		if (verb == "keyframe") {
+			std::lock_guard lock{net_mutex};
+			if (not net) {
+				return reply_error("network stream is not enabled");
+			}
+			net->request_keyframe();
+			return reply_ok();
+		}
+		if (verb == "reload") {
+			is_reload_requested.store(true, std::memory_order::relaxed);
+			return reply_ok();
+		}
+		if (verb == "subscribe") {
+			constexpr auto usage = "usage: subscribe <name> <x> <y> <width> <height> [<output width> <output height> [<interpolation>]]";
+			auto name = std::string{};
+			auto roi  = cv::Rect{};
+			if (not(iss >> name >> roi.x >> roi.y >> roi.width >> roi.height) or roi.x < 0 or roi.y < 0 or roi.width <= 0 or roi.height <= 0) {
+				return reply_error(usage);
+			}
+			auto transform = transform_options_t{};
+			transform.roi  = roi;
+			if (auto size = cv::Size{}; iss >> size.width) {
+				if (not(iss >> size.height) or size.width <= 0 or size.height <= 0) {
+					return reply_error(usage);
+				}
+				transform.output_size = size;
+			}
+			if (auto interpolation = std::string{}; iss >> interpolation) {
+				try {
+					transform.interpolation = interpolation_from_string(interpolation);
+				} catch (const invalid_argument &e) {
+					return reply_error(e.what());
+				}
+			}
+			const auto ret = subscriptions.subscribe(name, transform);
+			if (not ret) {
+				return reply_error(ret.error());
+			}
+			auto reply = toml::table{{"name", *ret}};
+			if (const auto fd_socket = subscriptions.fd_socket(name)) {
+				reply.insert("fd_socket", *fd_socket);
+			}
+			return reply_ok(std::move(reply));
+		}
+		if (verb == "unsubscribe") {
+			auto name = std::string{};
+			if (not(iss >> name)) {
+				return reply_error("usage: unsubscribe <name>");
+			}
+			if (not subscriptions.unsubscribe(name)) {
+				return reply_error(std::format("no subscription `{}`", name));
+			}
+			return reply_ok();
+		}
+		if (verb == "subscriptions") {
+			auto list = toml::array{};
+			for (const auto &s : subscriptions.list(consumer_timeout_ns.load(std::memory_order::relaxed))) {
+				const auto roi = s.transform.roi.value_or(cv::Rect{});
+				auto entry     = toml::table{
+					{"name", s.name},
+					{"object", s.object_name},
+					{"roi", toml::array{roi.x, roi.y, roi.width, roi.height}},
+					{"width", static_cast<int64_t>(s.info.width)},
+					{"height", static_cast<int64_t>(s.info.height)},
+					{"consumers", static_cast<int64_t>(s.live_consumers)},
+				};
+				if (s.fd_socket) {
+					entry.insert("fd_socket", *s.fd_socket);
+				}
+				list.push_back(std::move(entry));
+			}
+			return reply_ok(toml::table{{"subscriptions", std::move(list)}});
+		}
+		return reply_error(std::format("unknown command `{}`; expect one of stats, consumers, pause, resume, seek, speed, keyframe, reload, "
+									   "subscribe, unsubscribe, subscriptions",
+									   verb));
+	};
+	std::unique_ptr<control_server> control;
+	const auto make_control = [&ctx, &handle_control](const std::optional<std::string> &address) -> std::expected<std::unique_ptr<control_server>, int> {
+		using ue_t = std::unexpected<int>;
+		if (not address) {
+			return nullptr;
+		}
+		std::unique_ptr<control_server> ret;
+		try {
+			ret = std::make_unique<control_server>(ctx, *address, handle_control);
+		} catch (const zmq::error_t &e) {
+			spdlog::error("failed to bind control endpoint to `{}`: {}", *address, e.what());
+			return ue_t{-1};
+		}
+		spdlog::info("bind control endpoint to `{}`", *address);
+		return ret;
+	};
 
 retry_shm:
-	int shm_fd = shm_open(config.name.c_str(), O_CREAT | O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+	int shm_fd = shm_object_open(config.name, config.memory);
 	if (shm_fd == -1) {
 		spdlog::error("failed to create shared memory `{}`. {} ({})", config.name, strerror(errno), errno);
 		if (errno == EACCES || errno == EEXIST) {
 			// `ipcrm -M <name>` could be used to remove the shared memory
-			auto err = shm_unlink(config.name.c_str());
+			auto err = shm_object_unlink(config.name, config.memory);
 			if (err == -1) {
 				spdlog::error("failed to unlink shared memory `{}`. {} ({})", config.name, strerror(errno), errno);
 				return 1;
@@ -433,13 +538,13 @@ retry_shm:
 	}
 	spdlog::debug("created shared memory `{}` (fd={})", config.name, shm_fd);
 	// defer at exit
-	const auto shm_close_fn = [shm_fd, name = config.name]() {
+	const auto shm_close_fn = [shm_fd, name = config.name, memory = config.memory]() {
 		auto err = close(shm_fd);
 		if (err == -1) {
 			spdlog::error("failed to close shared memory `{}`. reason: {}", name, strerror(errno));
 			return err;
 		}
-		err = shm_unlink(name.c_str());
+		err = shm_object_unlink(name, memory);
 		if (err == -1) {
 			spdlog::error("failed to unlink shared memory `{}`. reason: {}", name, strerror(errno));
 			return err;
@@ -447,24 +552,158 @@ retry_shm:
 		return 0;
 	};
 
+	// hugetlbfs only takes sizes and offsets in whole huge pages
+	const auto page_size   = backing_page_size(config.memory);
+	const auto data_offset = shm_data_offset(page_size);
+	if (config.memory.huge_pages == huge_pages_t::transparent) {
+		spdlog::info("transparent huge pages for shared memory: `{}`", thp_shmem_mode().value_or("unavailable"));
+	}
+	spdlog::info("frames of {} bytes or more are copied with non-temporal {} stores",
+				 config.non_temporal_threshold, simd_level_to_string(kernels().level));
+	if (ftruncate(shm_fd, static_cast<off_t>(data_offset)) == -1) {
+		spdlog::error("failed to truncate shared memory; {} ({})", strerror(errno), errno);
+		shm_close_fn();
+		return 1;
+	}
+	auto header_ptr = map_shared(shm_fd, data_offset, 0, config.memory);
+	if (header_ptr == MAP_FAILED) {
+		spdlog::error("failed to mmap shared memory header; {} ({})", strerror(errno), errno);
+		shm_close_fn();
+		return 1;
+	}
+	// the object might be left over from a crashed producer; start from a clean header
+	header                = new (header_ptr) shm_header_t{};
+	header->version       = SHM_VERSION;
+	header->max_consumers = MAX_CONSUMERS;
+	header->data_offset   = data_offset;
+	for (auto &slot : header->consumers) {
+		slot.heartbeat_ns.store(UINT64_MAX, std::memory_order::relaxed);
+	}
+	std::atomic_ref{header->magic}.store(SHM_MAGIC, std::memory_order::release);
+	const auto unmap_header = [header_ptr, data_offset] {
+		if (munmap(header_ptr, data_offset) == -1) {
+			spdlog::error("failed to unmap shared memory header. reason: {}", strerror(errno));
+		}
+	};
+	if (auto ret = make_control(config.control_address); ret) {
+		control = std::move(*ret);
+	} else {
+		unmap_header();
+		shm_close_fn();
+		return 1;
+	}
+	std::unique_ptr<fd_server> fds;
+	if (config.memory.fd_socket) {
+		try {
+			fds = std::make_unique<fd_server>(*config.memory.fd_socket, shm_fd, data_offset);
+		} catch (const std::system_error &e) {
+			spdlog::error("failed to listen on `{}`: {}", *config.memory.fd_socket, e.what());
+			control.reset();
+			unmap_header();
+			shm_close_fn();
+			return 1;
+		}
+		spdlog::info("pass shared memory to consumers over `{}`", *config.memory.fd_socket);
+	}
+
+	void *ptr          = nullptr;
+	size_t mapped_size = 0;
+	// the ring is mapped on its own, right after the header.
+	// the shared memory object only ever grows. A consumer still mapping the
+	// old size would get SIGBUS if it shrank under its feet.
+	const auto map_shm = [shm_fd, data_offset, page_size, &ptr, &mapped_size, memory = config.memory](size_t size) -> bool {
+		size = (size + page_size - 1) / page_size * page_size;
+		if (size <= mapped_size) {
+			return true;
+		}
+		// https://www.deepanseeralan.com/tech/playing-with-shared-memory/
+		// ftruncate first, then mmap
+		if (ftruncate(shm_fd, static_cast<off_t>(data_offset + size)) == -1) {
+			spdlog::error("failed to truncate shared memory; {} ({})", strerror(errno), errno);
+			return false;
+		}
+		if (ptr != nullptr and munmap(ptr, mapped_size) == -1) {
+			spdlog::error("failed to unmap shared memory. reason: {}", strerror(errno));
+		}
+		ptr         = nullptr;
+		mapped_size = 0;
+		auto p      = map_shared(shm_fd, size, static_cast<off_t>(data_offset), memory);
+		if (p == MAP_FAILED) {
+			// https://developer.apple.com/library/archive/documentation/System/Conceptual/ManPages_iPhoneOS/man2/mmap.2.html
+			spdlog::error("failed to mmap shared memory; {} ({})", strerror(errno), errno);
+			return false;
+		}
+		ptr         = p;
+		mapped_size = size;
+		return true;
+	};
+
+	const auto unmap_ptr = [&ptr, &mapped_size] {
+		int err;
+		err = munmap(ptr, mapped_size);
+		if (err == -1) {
+			spdlog::error("failed to unmap shared memory. reason: {}", strerror(errno));
+			return err;
+		}
+		return 0;
+	};
+
+	// lay out the ring for `info`, dropping whatever it held; consumers remap on the bumped generation
+	const auto layout_ring = [&header, &ptr, &map_shm](const frame_info_t &info, const app::Config &config) -> bool {
+		const auto row_bytes = uint64_t{info.width} * info.channels * info.pixelWidth();
+		const auto geometry  = make_ring_geometry(config.slot_count, config.max_pinned,
+												  row_bytes, info.height,
+												  config.row_alignment, config.frame_alignment, config.side_data_size);
+		if (not map_shm(geometry.size())) {
+			return false;
+		}
+		init_ring(*header, ptr, geometry,
+				  frame_shape_t{
+					  .width         = info.width,
+					  .height        = info.height,
+					  .channels      = info.channels,
+					  .depth         = info.depth,
+					  .channel_order = static_cast<uint8_t>(info.channels >= 3 ? config.channel_order : channel_order_t::bgr),
+					  .reserved      = 0,
+					  .reserved2     = 0,
+					  .buffer_size   = info.buffer_size,
+				  });
+		spdlog::info("ring of {} slot(s); row stride {}; frame stride {}; side data {}; max_pinned={}; generation={}",
+					 geometry.slot_count, geometry.row_stride, geometry.frame_stride, geometry.side_data_capacity, geometry.max_pinned,
+					 header->generation.load(std::memory_order::relaxed));
+		return true;
+	};
+
 	cv::Mat frame;
-	using start_ret_t         = std::tuple<void *, frame_info_t>;
-	const auto at_first_frame = [shm_fd, &cap, &frame] -> std::expected<start_ret_t, int> {
+	frame_times_t times{};
+	// read the next frame and note when; the capture time is the driver's where the backend
+	// reports it (see `has_monotonic_pos`), otherwise when the read started
+	const auto read_frame = [&cap, &frame, &times, &has_monotonic_pos] {
+		const auto started_ns = monotonic_ns();
+		*cap >> frame;
+		times.grabbed_ns = monotonic_ns();
+		times.capture_ns = started_ns;
+		if (not has_monotonic_pos) {
+			return;
+		}
+		// 0 for a buffer the driver didn't stamp
+		const auto backend_msec = cap->get(cv::CAP_PROP_POS_MSEC);
+		if (const auto backend_ns = static_cast<uint64_t>(backend_msec * static_cast<double>(NS_PER_MS));
+			backend_msec > 0 and backend_ns <= times.grabbed_ns) {
+			times.capture_ns = backend_ns;
+		}
+	};
+	// geometry of the first frame as published, i.e. after the crop and scale of `config`
+	const auto at_first_frame = [&frame, &read_frame](const app::Config &config) -> std::expected<frame_info_t, int> {
 		using ue_t = std::unexpected<int>;
-		cap >> frame;
+		read_frame();
 		if (frame.empty()) {
 			spdlog::error("failed to capture first frame");
 			return ue_t{-1};
 		}
-		frame_info_t info{
-			.width       = static_cast<uint16_t>(frame.cols),
-			.height      = static_cast<uint16_t>(frame.rows),
-			.channels    = static_cast<uint8_t>(frame.channels()),
-			.depth       = static_cast<uint8_t>(frame.depth()),
-			.buffer_size = static_cast<uint32_t>(frame.total() * frame.elemSize()),
-		};
+		const auto info = config.transform().info_of(frame);
 
-		spdlog::info("first frame info: {}x{}x{}; depth={}({}); stride[0]={}; stride[1]={}; total={}; elemSize={}; bufferSize={}",
+		spdlog::info("first frame info: {}x{}x{}; depth={}({}); stride[0]={}; stride[1]={}; continuous={}; total={}; elemSize={}; bufferSize={}",
 					 frame.cols,
 					 frame.rows,
 					 frame.channels(),
@@ -472,69 +711,310 @@ retry_shm:
 					 frame.depth(),
 					 frame.step[0],
 					 frame.step[1],
+					 frame.isContinuous(),
 					 frame.total(),
 					 frame.elemSize(),
 					 frame.total() * frame.elemSize());
-
-		const auto size = frame.total() * frame.elemSize();
-		// https://www.deepanseeralan.com/tech/playing-with-shared-memory/
-		// ftruncate first, then mmap
-		if (ftruncate(shm_fd, size) == -1) {
-			spdlog::error("failed to truncate shared memory; {} ({})", strerror(errno), errno);
-			return ue_t{-1};
+		if (not config.transform().is_identity()) {
+			const auto crop = config.transform().crop_of(frame);
+			spdlog::info("publish [{}, {}, {}, {}] of the {}frame as {}x{}; interpolation={}",
+						 crop.x, crop.y, crop.width, crop.height, config.undistort ? "undistorted " : "",
+						 uint32_t{info.width}, uint32_t{info.height},
+						 interpolation_to_string(config.interpolation));
 		}
-		auto ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
-		if (ptr == MAP_FAILED) {
-			// https://developer.apple.com/library/archive/documentation/System/Conceptual/ManPages_iPhoneOS/man2/mmap.2.html
-			spdlog::error("failed to mmap shared memory; {} ({})", strerror(errno), errno);
-			return ue_t{-1};
-		}
-		memcpy(ptr, frame.data, size);
-		return std::make_tuple(ptr, info);
+		return info;
 	};
 
-	start_ret_t tmp_ret;
-	if (auto ret = at_first_frame(); ret) {
-		tmp_ret = *ret;
+	frame_info_t info;
+	if (auto ret = at_first_frame(config); ret and layout_ring(*ret, config)) {
+		info = *ret;
 	} else {
+		control.reset();
+		fds.reset();
+		if (ptr != nullptr) {
+			unmap_ptr();
+		}
+		unmap_header();
 		shm_close_fn();
 		return 1;
 	}
 
-	const auto [ptr, info] = tmp_ret;
-
-	const auto unmap_ptr = [ptr, bufferSize = info.buffer_size] {
-		int err;
-		err = munmap(ptr, bufferSize);
-		if (err == -1) {
-			spdlog::error("failed to unmap shared memory. reason: {}", strerror(errno));
-			return err;
+	if (const auto report = page_report(ptr); report) {
+		spdlog::info("ring backed by {} KiB pages ({} KiB huge mapped); resident {} KiB; locked {} KiB",
+					 report->kernel_page_size / 1024, report->huge_mapped / 1024, report->rss / 1024, report->locked / 1024);
+	}
+	if (const auto nodes = page_nodes(ptr, mapped_size, page_size); not nodes.empty()) {
+		auto list = std::string{};
+		for (size_t node = 0; node < nodes.size(); ++node) {
+			if (nodes[node] > 0) {
+				list += std::format("{}node{}={}", list.empty() ? "" : ", ", node, nodes[node]);
+			}
 		}
-		return 0;
-	};
+		spdlog::info("ring pages per NUMA node: {}", list);
+	}
 
-	const auto set_frame = [ptr, bufferSize = info.buffer_size](const cv::Mat &frame) {
-		// TODO: check frame size
-		memcpy(ptr, frame.data, bufferSize);
+	frame_transform transform;
+	// an ioctl each on V4L2, so read at a low rate rather than with every frame; 0 where the backend doesn't support them
+	struct capture_controls_t {
+		double exposure = 0;
+		double gain     = 0;
+		std::optional<stream_stats::clock_t::time_point> read_at;
+	} controls;
+	// write into the oldest slot nobody pins; false if all of them are leased and the frame has to be dropped
+	const auto set_frame = [&header, &ptr, &info, &times, &cap, &config, &copy_pool, &transform, &controls](const cv::Mat &frame) -> bool {
+		const auto index = begin_write(*header, ptr);
+		if (not index) {
+			return false;
+		}
+		// cropped and scaled on the way; rows are copied one by one when the frame is a view or padded, see `copy_frame`
+		transform.write(frame, config.transform(), frame_data(*header, ptr, *index), header->row_stride,
+						copy_options_t{
+							.non_temporal_threshold = config.non_temporal_threshold,
+							.pool                   = copy_pool.get(),
+							.parallel_threshold     = config.parallel_copy_threshold,
+							.swap_rb                = config.channel_order == channel_order_t::rgb,
+						});
+		auto side_data = side_data_writer{side_data_area(*header, ptr, *index)};
+		if (header->side_data_capacity > 0) {
+			if (const auto now = stream_stats::clock_t::now(); not controls.read_at or now - *controls.read_at >= std::chrono::seconds(1)) {
+				controls.exposure = cap->get(cv::CAP_PROP_EXPOSURE);
+				controls.gain     = cap->get(cv::CAP_PROP_GAIN);
+				controls.read_at  = now;
+			}
+			if (controls.exposure != 0) {
+				side_data.append(side_data_type_t::exposure, controls.exposure);
+			}
+			if (controls.gain != 0) {
+				side_data.append(side_data_type_t::gain, controls.gain);
+			}
+			for (const auto &source : side_data_sources()) {
+				source(side_data, frame);
+			}
+		}
+		times.published_ns = monotonic_ns();
+		end_write(*header, ptr, *index, frame_count, times, side_data.size());
+		return true;
 	};
+	set_frame(frame);
 
-	const auto send_sync_msg = [&sock, &info] {
+	// a frame that doesn't fit `frame_info_v1_t` can't be announced in the legacy format
+	bool wire_v1_overflow = false;
+	const auto send_sync_msg = [&sock, &info, &times, &config, &wire_v1_overflow] {
 		try {
-			const auto msg = sync_message_t{
-				.frame_count = static_cast<uint32_t>(frame_count),
-				.info        = info,
-			};
 			constexpr auto magic_payload = std::array<uint8_t, 1>{FRAME_TOPIC_MAGIC};
+			if (config.wire_version == 1) {
+				const auto info_v1 = frame_info_v1_t::from(info);
+				if (not info_v1) {
+					if (not wire_v1_overflow) {
+						spdlog::error("{}x{} frames of {} bytes don't fit wire format v1; set wire_version = {}",
+									  uint32_t{info.width}, uint32_t{info.height}, uint64_t{info.buffer_size}, SYNC_VERSION);
+						wire_v1_overflow = true;
+					}
+					return;
+				}
+				const auto msg = sync_message_t{
+					.frame_count = static_cast<uint32_t>(frame_count),
+					.info        = *info_v1,
+				};
+				sock.send(zmq::buffer(magic_payload), zmq::send_flags::sndmore);
+				sock.send(zmq::buffer(reinterpret_cast<const uint8_t *>(&msg), sizeof(sync_message_t)), zmq::send_flags::none);
+				return;
+			}
+			const auto msg = sync_message_v2_t{
+				.sequence     = frame_count,
+				.info         = info,
+				.capture_ns   = times.capture_ns,
+				.grabbed_ns   = times.grabbed_ns,
+				.published_ns = times.published_ns,
+			};
 			sock.send(zmq::buffer(magic_payload), zmq::send_flags::sndmore);
-			sock.send(zmq::buffer(reinterpret_cast<const uint8_t *>(&msg), sizeof(sync_message_t)), zmq::send_flags::none);
+			sock.send(zmq::buffer(reinterpret_cast<const uint8_t *>(&msg), sizeof(sync_message_v2_t)), zmq::send_flags::none);
 		} catch (const zmq::error_t &e) {
 			spdlog::error("failed to send synchronization message for frame@{}; {}", frame_count, e.what());
 		}
 	};
 
+	// Apply the config file again. Everything but the shared memory name can be
+	// changed; a new source with a different frame geometry is swapped in
+	// behind the same shared memory object with a bumped generation, so
+	// consumers stay attached and only need to remap on the next message.
+	const auto reload_config = [&] -> bool {
+		auto next_opt = load_config();
+		if (not next_opt) {
+			spdlog::warn("keep the current config");
+			return true;
+		}
+		auto next = std::move(*next_opt);
+		if (next.name != config.name) {
+			spdlog::warn("shared memory name can't be changed at runtime; keep `{}`", config.name);
+			next.name = config.name;
+		}
+		if (next.memory != config.memory or next.cpu_affinity != config.cpu_affinity) {
+			spdlog::warn("memory settings and CPU affinity can't be changed at runtime; keep the current ones");
+			next.memory       = config.memory;
+			next.cpu_affinity = config.cpu_affinity;
+		}
+		if (next.zmq_address != config.zmq_address) {
+			try {
+				sock.unbind(config.zmq_address);
+				sock.bind(next.zmq_address);
+				spdlog::info("rebind to ZMQ address: `{}`", next.zmq_address);
+			} catch (const zmq::error_t &e) {
+				spdlog::error("failed to rebind to ZMQ address `{}`: {}; keep `{}`", next.zmq_address, e.what(), config.zmq_address);
+				try {
+					sock.bind(config.zmq_address);
+				} catch (const zmq::error_t &) {}
+				next.zmq_address = config.zmq_address;
+			}
+		}
+		if (next.network != config.network) {
+			// release the old socket first, the address is likely the same
+			{
+				std::lock_guard lock{net_mutex};
+				net.reset();
+			}
+			auto ret = make_net(next.network);
+			std::lock_guard lock{net_mutex};
+			if (ret) {
+				net = std::move(*ret);
+			} else {
+				spdlog::warn("network stream disabled");
+				next.network = std::nullopt;
+			}
+		}
+		if (next.control_address != config.control_address) {
+			control.reset();
+			if (auto ret = make_control(next.control_address); ret) {
+				control = std::move(*ret);
+			} else {
+				spdlog::warn("control endpoint disabled");
+				next.control_address = std::nullopt;
+			}
+		}
+		if (next.copy_threads != config.copy_threads) {
+			copy_pool = make_copy_pool(next.copy_threads);
+		}
+		if (next.channel_order != config.channel_order) {
+			// deltas against a keyframe of the other order would be garbage
+			std::lock_guard lock{net_mutex};
+			if (net) {
+				net->request_keyframe();
+			}
+		}
+		const bool ring_changed = next.slot_count != config.slot_count or next.max_pinned != config.max_pinned or
+								  next.row_alignment != config.row_alignment or next.frame_alignment != config.frame_alignment or
+								  next.side_data_size != config.side_data_size or next.channel_order != config.channel_order or
+								  next.roi != config.roi or next.output_size != config.output_size;
+		const bool source_changed = next.pipeline != config.pipeline or next.api_preference != config.api_preference or
+									(next.api_preference == CAP_SYNTHETIC and next.synthetic != config.synthetic);
+		// the first frame of a reopened source is published once `next` is in effect
+		bool is_reopened = false;
+		if (source_changed) {
+			cap->release();
+			if (not open_source(next)) {
+				spdlog::warn("reopen the previous video source");
+				next.pipeline       = config.pipeline;
+				next.api_preference = config.api_preference;
+				next.synthetic      = config.synthetic;
+				if (not open_source(next)) {
+					return false;
+				}
+			}
+			probe_source();
+			const auto ret = at_first_frame(next);
+			if (not ret) {
+				return false;
+			}
+			const bool geometry_changed = memcmp(&*ret, &info, sizeof(frame_info_t)) != 0;
+			if (geometry_changed) {
+				spdlog::info("frame geometry changed");
+			}
+			if ((geometry_changed or ring_changed) and not layout_ring(*ret, next)) {
+				return false;
+			}
+			info        = *ret;
+			is_reopened = true;
+			// of the new source
+			controls.read_at.reset();
+		} else if (ring_changed) {
+			// the last frame is gone with the old ring; consumers wait for the next one
+			const auto next_info = next.transform().info_of(frame);
+			if (not layout_ring(next_info, next)) {
+				return false;
+			}
+			info = next_info;
+		}
+		config = std::move(next);
+		consumer_timeout_ns.store(uint64_t{config.consumer_timeout_ms} * NS_PER_MS, std::memory_order::relaxed);
+		if (is_reopened) {
+			if (set_frame(frame)) {
+				send_sync_msg();
+			}
+			frame_count += 1;
+		}
+		spdlog::info("config reloaded");
+		std::cout << "Config Used: " << config.to_toml() << std::endl;
+		return true;
+	};
+
+	auto last_prune_at = stream_stats::clock_t::now();
+	bool is_idle       = false;
+	// between failed grabs while a live source is paused
+	auto grab_backoff = std::chrono::milliseconds{0};
 	send_sync_msg();
 	while (is_running.load(std::memory_order::relaxed)) {
-		cap >> frame;
+		if (is_reload_requested.exchange(false, std::memory_order::relaxed)) {
+			if (not reload_config()) {
+				spdlog::error("failed to reload video source");
+				break;
+			}
+		}
+		if (const auto target = seek_request.exchange(-1, std::memory_order::relaxed); target >= 0) {
+			spdlog::info("seek to frame {}", target);
+			cap->set(cv::CAP_PROP_POS_FRAMES, static_cast<double>(target));
+		}
+		const auto timeout_ns = consumer_timeout_ns.load(std::memory_order::relaxed);
+		if (const auto now = stream_stats::clock_t::now(); now - last_prune_at >= std::chrono::seconds(1)) {
+			if (const auto n = prune_consumers(*header, ptr, timeout_ns); n > 0) {
+				spdlog::info("pruned {} dead consumer(s)", n);
+			}
+			subscriptions.prune(timeout_ns);
+			last_prune_at = now;
+		}
+		if (config.pause_when_idle) {
+			// cheap enough to check on every iteration, so a new consumer resumes the stream at once
+			const bool idle = count_live_consumers(*header, timeout_ns) == 0 and
+							  subscriptions.count_live_consumers(timeout_ns) == 0;
+			if (idle != is_idle) {
+				spdlog::info(idle ? "no consumer registered; pause decoding" : "consumer registered; resume decoding");
+				is_idle = idle;
+			}
+		} else {
+			is_idle = false;
+		}
+		if (is_paused.load(std::memory_order::relaxed) or is_idle) {
+			if (finite_source_info) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			} else {
+				// keep draining a live source, otherwise it would deliver stale frames on resume;
+				// `grab` without `retrieve` skips the decode/conversion on most backends
+				if (cap->grab()) {
+					stats.record_dropped();
+					grab_backoff = std::chrono::milliseconds{0};
+				} else {
+					// nothing was dropped; a source that is gone ends the stream once resumed
+					if (grab_backoff.count() == 0) {
+						spdlog::warn("failed to grab from the paused live source; retry with backoff");
+					}
+					grab_backoff = std::clamp(grab_backoff * 2, std::chrono::milliseconds(10), std::chrono::milliseconds(1000));
+					std::this_thread::sleep_for(grab_backoff);
+				}
+			}
+			continue;
+		}
+		grab_backoff = std::chrono::milliseconds{0};
+		read_frame();
+		const auto grabbed_at = stream_stats::clock_t::now();
 		if (frame.empty()) {
 			if (finite_source_info) {
 				spdlog::info("reached end of finite video source");
@@ -548,12 +1028,44 @@ retry_shm:
 				break;
 			}
 		} else {
-			set_frame(frame);
-			send_sync_msg();
+			// some backends renegotiate the resolution mid-stream; never write past a slot
+			if (const auto next_info = config.transform().info_of(frame); memcmp(&next_info, &info, sizeof(frame_info_t)) != 0) {
+				spdlog::info("frame geometry changed to {}x{}x{}; depth={}",
+							 frame.cols, frame.rows, frame.channels(), app::depth_to_string(frame.depth()));
+				if (not layout_ring(next_info, config)) {
+					break;
+				}
+				info = next_info;
+			}
+			const bool is_written = set_frame(frame);
+			if (is_written) {
+				send_sync_msg();
+				stats.record_published(frame_count, info, grabbed_at, stream_stats::clock_t::now());
+			} else {
+				spdlog::debug("every ring slot is leased; drop frame@{}", frame_count);
+				stats.record_dropped();
+			}
+			// the regions consumers asked for, each into its own object
+			subscriptions.publish(frame, frame_count, times, config, sock);
+			if (net) {
+				if (const auto transform_options = config.transform(); transform_options.is_identity()) {
+					net->submit(frame, frame_count, info, config.channel_order);
+				} else if (is_written) {
+					// read back what was just written instead of cropping, scaling or undistorting
+					// a second time; the slot is already in `channel_order`
+					const auto index   = header->latest_slot.load(std::memory_order::relaxed);
+					const auto written = cv::Mat{static_cast<int>(info.height), static_cast<int>(info.width),
+												 CV_MAKETYPE(info.depth, info.channels), frame_data(*header, ptr, index), header->row_stride};
+					net->submit(written, frame_count, info, config.channel_order, config.channel_order);
+				} else {
+					net->submit(transform.apply(frame, transform_options), frame_count, info, config.channel_order);
+				}
+			}
 			if (finite_source_info) {
 				const auto current = get_video_position();
 				spdlog::debug("frame@{} ({}/{})", frame_count, current, finite_source_info->frame_count);
-				std::this_thread::sleep_for(std::chrono::milliseconds(*frame_interval_ms));
+				const auto speed = playback_speed.load(std::memory_order::relaxed);
+				std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(*frame_interval_ms / speed));
 			} else {
 				spdlog::debug("frame@{}", frame_count);
 			}
@@ -561,7 +1073,10 @@ retry_shm:
 		frame_count += 1;
 	}
 
+	control.reset();
+	fds.reset();
 	unmap_ptr();
+	unmap_header();
 	shm_close_fn();
 	spdlog::info("normally exit");
 	return 0;
@@ -0,0 +1,164 @@
+#include "memory.hpp"
+#include "numa.hpp"
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <spdlog/spdlog.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <unistd.h>
+
+namespace app {
+namespace {
+	constexpr mode_t SHM_MODE = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH;
+
+	std::string hugetlbfs_file(const std::string &name, const MemoryConfig &config) {
+		// names follow the `shm_open` convention of an optional leading slash
+		const auto file = name.starts_with('/') ? name.substr(1) : name;
+		return (std::filesystem::path{config.hugetlbfs_path} / file).string();
+	}
+}
+
+size_t backing_page_size(const MemoryConfig &config) {
+	if (config.huge_pages == huge_pages_t::hugetlbfs) {
+		struct statfs fs{};
+		if (statfs(config.hugetlbfs_path.c_str(), &fs) == 0) {
+			return static_cast<size_t>(fs.f_bsize);
+		}
+		spdlog::warn("failed to stat hugetlbfs mount `{}`; {} ({})", config.hugetlbfs_path, strerror(errno), errno);
+	}
+	return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+int shm_object_open(const std::string &name, const MemoryConfig &config) {
+	if (config.fd_socket) {
+		auto flags = MFD_CLOEXEC | MFD_ALLOW_SEALING;
+		if (config.huge_pages == huge_pages_t::hugetlbfs) {
+			flags |= MFD_HUGETLB;
+		}
+		const auto fd = memfd_create(name.c_str(), flags);
+		if (fd == -1) {
+			return fd;
+		}
+		// the object only ever grows, so consumers can rely on it never shrinking under their mappings
+		if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL) == -1) {
+			const auto err = errno;
+			close(fd);
+			errno = err;
+			return -1;
+		}
+		return fd;
+	}
+	if (config.huge_pages == huge_pages_t::hugetlbfs) {
+		return open(hugetlbfs_file(name, config).c_str(), O_CREAT | O_RDWR, SHM_MODE);
+	}
+	return shm_open(name.c_str(), O_CREAT | O_RDWR, SHM_MODE);
+}
+
+int shm_object_unlink(const std::string &name, const MemoryConfig &config) {
+	if (config.fd_socket) {
+		// anonymous; gone with the last descriptor and mapping
+		return 0;
+	}
+	if (config.huge_pages == huge_pages_t::hugetlbfs) {
+		return unlink(hugetlbfs_file(name, config).c_str());
+	}
+	return shm_unlink(name.c_str());
+}
+
+void *map_shared(int fd, size_t size, off_t offset, const MemoryConfig &config) {
+	// transparent huge pages and the NUMA policy have to be in place before
+	// the first fault, so the range is populated afterwards in that case
+	const bool is_thp       = config.huge_pages == huge_pages_t::transparent;
+	const bool needs_advice = is_thp or config.numa_node.has_value();
+	int flags               = MAP_SHARED;
+	if (config.prefault and not needs_advice) {
+		flags |= MAP_POPULATE;
+	}
+	auto ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, fd, offset);
+	if (ptr == MAP_FAILED) {
+		return ptr;
+	}
+	if (is_thp and madvise(ptr, size, MADV_HUGEPAGE) == -1) {
+		spdlog::warn("madvise(MADV_HUGEPAGE) failed; {} ({})", strerror(errno), errno);
+	}
+	if (config.numa_node and not bind_memory(ptr, size, *config.numa_node)) {
+		spdlog::warn("failed to bind shared memory to NUMA node {}; {} ({})", *config.numa_node, strerror(errno), errno);
+	}
+	if (config.prefault and needs_advice) {
+#ifdef MADV_POPULATE_WRITE
+		if (madvise(ptr, size, MADV_POPULATE_WRITE) == -1) {
+			spdlog::warn("madvise(MADV_POPULATE_WRITE) failed; {} ({})", strerror(errno), errno);
+		}
+#else
+		spdlog::warn("prefault with huge pages or NUMA binding needs MADV_POPULATE_WRITE (Linux 5.14)");
+#endif
+	}
+	if (config.lock and mlock(ptr, size) == -1) {
+		spdlog::warn("failed to lock {} bytes of shared memory; {} ({}). check `ulimit -l`", size, strerror(errno), errno);
+	}
+	return ptr;
+}
+
+std::optional<page_report_t> page_report(const void *addr) {
+	auto ifs = std::ifstream{"/proc/self/smaps"};
+	if (not ifs) {
+		return std::nullopt;
+	}
+	const auto target = reinterpret_cast<uintptr_t>(addr);
+	std::optional<page_report_t> ret;
+	std::string line;
+	while (std::getline(ifs, line)) {
+		uintptr_t start = 0;
+		uintptr_t end   = 0;
+		// a mapping starts with its address range, its fields follow as `Key: value kB`
+		if (std::sscanf(line.c_str(), "%" SCNxPTR "-%" SCNxPTR " ", &start, &end) == 2) {
+			if (ret) {
+				break;
+			}
+			if (start <= target and target < end) {
+				ret = page_report_t{};
+			}
+			continue;
+		}
+		if (not ret) {
+			continue;
+		}
+		char key[64];
+		size_t kb = 0;
+		if (std::sscanf(line.c_str(), "%63[^:]: %zu kB", key, &kb) != 2) {
+			continue;
+		}
+		const auto k = std::string_view{key};
+		if (k == "KernelPageSize") {
+			ret->kernel_page_size = kb * 1024;
+		} else if (k == "ShmemPmdMapped" or k == "FilePmdMapped") {
+			ret->huge_mapped += kb * 1024;
+		} else if (k == "Rss") {
+			ret->rss = kb * 1024;
+		} else if (k == "Locked") {
+			ret->locked = kb * 1024;
+		}
+	}
+	return ret;
+}
+
+std::optional<std::string> thp_shmem_mode() {
+	auto ifs = std::ifstream{"/sys/kernel/mm/transparent_hugepage/shmem_enabled"};
+	std::string line;
+	if (not std::getline(ifs, line)) {
+		return std::nullopt;
+	}
+	const auto l = line.find('[');
+	const auto r = line.find(']');
+	if (l == std::string::npos or r == std::string::npos or r < l) {
+		return std::nullopt;
+	}
+	return line.substr(l + 1, r - l - 1);
+}
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <sys/types.h>
+#include "config.hpp"
+
+// Allocation of the shared memory object according to `MemoryConfig`:
+// where the object lives, which page size backs it, and whether its pages are
+// faulted in and locked up front.
+namespace app {
+/// unit the object is sized and mapped in; the huge page size of the mount on hugetlbfs
+size_t backing_page_size(const MemoryConfig &config);
+
+/// `shm_open(name)`, `open` of `name` below `hugetlbfs_path`, or a sealed
+/// `memfd` labelled `name` with `fd_socket`.
+/// @return the file descriptor, or -1 with `errno` set
+int shm_object_open(const std::string &name, const MemoryConfig &config);
+
+/// a no-op for a `memfd`
+/// @return 0, or -1 with `errno` set
+int shm_object_unlink(const std::string &name, const MemoryConfig &config);
+
+/// map `size` bytes of `fd` at `offset` shared and writable, then apply the
+/// huge page, NUMA, prefault and lock settings. Failing to apply any of them is only a warning.
+/// @return `MAP_FAILED` with `errno` set on failure
+void *map_shared(int fd, size_t size, off_t offset, const MemoryConfig &config);
+
+struct page_report_t {
+	/// `KernelPageSize`; 2 MiB/1 GiB on hugetlbfs
+	size_t kernel_page_size;
+	/// bytes mapped by transparent huge pages
+	size_t huge_mapped;
+	size_t rss;
+	size_t locked;
+};
+
+/// how the mapping containing `addr` is backed right now, from `/proc/self/smaps`
+std::optional<page_report_t> page_report(const void *addr);
+
+/// the bracketed mode in `/sys/kernel/mm/transparent_hugepage/shmem_enabled`
+std::optional<std::string> thp_shmem_mode();
+}
@@ -0,0 +1,233 @@
+#include "net.hpp"
+#include <spdlog/spdlog.h>
+#include "copy.hpp"
+#include "dispatch.hpp"
+#ifdef CVMMAP_WITH_LZ4
+#include <lz4.h>
+#endif
+#ifdef CVMMAP_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace app {
+namespace {
+	/// chunks are cut on cache line boundaries
+	constexpr size_t CHUNK_ALIGNMENT = 64;
+
+	size_t compress_bound(codec_t codec, [[maybe_unused]] size_t n) {
+		switch (codec) {
+#ifdef CVMMAP_WITH_LZ4
+		case codec_t::lz4:
+			return LZ4_compressBound(static_cast<int>(n));
+#endif
+#ifdef CVMMAP_WITH_ZSTD
+		case codec_t::zstd:
+			return ZSTD_compressBound(n);
+#endif
+		default:
+			return 0;
+		}
+	}
+}
+
+net_publisher::net_publisher(zmq::context_t &ctx, const NetworkConfig &config)
+	: config_(config), sock_(ctx, zmq::socket_type::pub), pool_(config.workers) {
+	switch (config_.codec) {
+	case codec_t::none:
+		break;
+#ifdef CVMMAP_WITH_LZ4
+	case codec_t::lz4:
+		break;
+#endif
+#ifdef CVMMAP_WITH_ZSTD
+	case codec_t::zstd:
+		for (size_t i = 0; i < config_.workers; ++i) {
+			contexts_.push_back(ZSTD_createCCtx());
+		}
+		break;
+#endif
+	default:
+		throw invalid_argument(std::format("codec `{}` is not compiled in", codec_to_string(config_.codec)));
+	}
+	scratch_.resize(config_.workers);
+	compressed_.resize(config_.workers);
+	payload_.resize(config_.workers);
+	sock_.bind(config_.address);
+	thread_ = std::thread([this] { run(); });
+}
+
+net_publisher::~net_publisher() {
+	{
+		std::lock_guard lock{mutex_};
+		stopping_ = true;
+	}
+	cv_.notify_one();
+	thread_.join();
+#ifdef CVMMAP_WITH_ZSTD
+	for (auto ctx : contexts_) {
+		ZSTD_freeCCtx(static_cast<ZSTD_CCtx *>(ctx));
+	}
+#endif
+}
+
+bool net_publisher::submit(const cv::Mat &frame, uint64_t frame_count, const frame_info_t &info, channel_order_t order,
+						   channel_order_t frame_order) {
+	{
+		std::lock_guard lock{mutex_};
+		if (pending_) {
+			dropped_.fetch_add(1, std::memory_order::relaxed);
+			spdlog::trace("network encoder busy; drop frame@{}", frame_count);
+			return false;
+		}
+	}
+	// the encoder thread never touches the staging buffer while nothing is pending
+	staging_.resize(info.buffer_size);
+	// packed rows, even if `frame` isn't continuous; cached, the encoder reads them right away
+	const bool is_rgb = order == channel_order_t::rgb and frame.channels() >= 3;
+	copy_frame(frame, staging_.data(), static_cast<size_t>(frame.cols) * frame.elemSize(),
+			   copy_options_t{.non_temporal_threshold = 0, .swap_rb = is_rgb and frame_order != order});
+	staged_frame_count_ = frame_count;
+	staged_info_        = info;
+	staged_rgb_         = is_rgb;
+	{
+		std::lock_guard lock{mutex_};
+		pending_ = true;
+	}
+	cv_.notify_one();
+	return true;
+}
+
+void net_publisher::run() {
+	while (true) {
+		{
+			std::unique_lock lock{mutex_};
+			cv_.wait(lock, [this] { return pending_ || stopping_; });
+			if (stopping_) {
+				return;
+			}
+		}
+		encode();
+		{
+			std::lock_guard lock{mutex_};
+			pending_ = false;
+		}
+	}
+}
+
+bool net_publisher::compress_chunk(size_t index, std::span<const uint8_t> input) {
+	[[maybe_unused]] auto &out = compressed_[index];
+	switch (config_.codec) {
+#ifdef CVMMAP_WITH_LZ4
+	case codec_t::lz4: {
+		out.resize(compress_bound(config_.codec, input.size()));
+		const auto n = LZ4_compress_fast(reinterpret_cast<const char *>(input.data()),
+										 reinterpret_cast<char *>(out.data()),
+										 static_cast<int>(input.size()),
+										 static_cast<int>(out.size()),
+										 config_.level);
+		if (n <= 0) {
+			return false;
+		}
+		payload_[index] = std::span{out.data(), static_cast<size_t>(n)};
+		return true;
+	}
+#endif
+#ifdef CVMMAP_WITH_ZSTD
+	case codec_t::zstd: {
+		out.resize(compress_bound(config_.codec, input.size()));
+		const auto n = ZSTD_compressCCtx(static_cast<ZSTD_CCtx *>(contexts_[index]),
+										 out.data(), out.size(),
+										 input.data(), input.size(),
+										 config_.level);
+		if (ZSTD_isError(n)) {
+			return false;
+		}
+		payload_[index] = std::span{out.data(), n};
+		return true;
+	}
+#endif
+	default:
+		payload_[index] = input;
+		return true;
+	}
+}
+
+void net_publisher::encode() {
+	const auto &info = staged_info_;
+	const auto size  = static_cast<size_t>(info.buffer_size);
+
+	const bool geometry_changed = memcmp(&keyframe_info_, &info, sizeof(frame_info_t)) != 0;
+	const bool requested        = keyframe_requested_.exchange(false, std::memory_order::relaxed);
+	const bool is_key           = not config_.delta or not has_keyframe_ or geometry_changed or requested or
+						frames_since_keyframe_ + 1 >= config_.keyframe_interval;
+	if (is_key and config_.delta) {
+		keyframe_.resize(size);
+	}
+
+	const auto workers    = static_cast<size_t>(config_.workers);
+	auto chunk_size       = (size + workers - 1) / workers;
+	chunk_size            = (chunk_size + CHUNK_ALIGNMENT - 1) / CHUNK_ALIGNMENT * CHUNK_ALIGNMENT;
+	const auto chunk_count = chunk_size == 0 ? 0 : (size + chunk_size - 1) / chunk_size;
+
+	std::atomic_bool ok{true};
+	pool_.parallel_for(chunk_count, [&](size_t i) {
+		const auto offset = i * chunk_size;
+		const auto len    = std::min(chunk_size, size - offset);
+		const auto src    = staging_.data() + offset;
+		auto input        = std::span<const uint8_t>{src, len};
+		if (is_key) {
+			if (config_.delta) {
+				memcpy(keyframe_.data() + offset, src, len);
+			}
+		} else {
+			auto &scratch = scratch_[i];
+			scratch.resize(len);
+			kernels().xor_bytes(scratch.data(), src, keyframe_.data() + offset, len);
+			input = std::span<const uint8_t>{scratch.data(), len};
+		}
+		if (not compress_chunk(i, input)) {
+			ok.store(false, std::memory_order::relaxed);
+		}
+	});
+	if (not ok.load(std::memory_order::relaxed)) {
+		spdlog::error("failed to compress frame@{} with `{}`", staged_frame_count_, codec_to_string(config_.codec));
+		// the keyframe buffer might be half written
+		has_keyframe_ = false;
+		return;
+	}
+
+	if (is_key) {
+		keyframe_count_        = staged_frame_count_;
+		keyframe_info_         = info;
+		frames_since_keyframe_ = 0;
+		has_keyframe_          = config_.delta;
+	} else {
+		frames_since_keyframe_ += 1;
+	}
+
+	const auto header = net_frame_header_t{
+		.frame_count    = staged_frame_count_,
+		.keyframe_count = is_key ? staged_frame_count_ : keyframe_count_,
+		.info           = info,
+		.codec          = static_cast<uint8_t>(config_.codec),
+		.flags          = static_cast<uint8_t>((is_key ? NET_FRAME_KEY : NET_FRAME_DELTA) | (staged_rgb_ ? NET_FRAME_RGB : 0)),
+		.chunk_count    = static_cast<uint16_t>(chunk_count),
+		.chunk_size     = static_cast<uint32_t>(chunk_size),
+	};
+	try {
+		constexpr auto magic_payload = std::array<uint8_t, 1>{NET_TOPIC_MAGIC};
+		sock_.send(zmq::buffer(magic_payload), zmq::send_flags::sndmore);
+		sock_.send(zmq::buffer(reinterpret_cast<const uint8_t *>(&header), sizeof(net_frame_header_t)),
+				   chunk_count == 0 ? zmq::send_flags::none : zmq::send_flags::sndmore);
+		size_t total = 0;
+		for (size_t i = 0; i < chunk_count; ++i) {
+			const auto flags = i + 1 == chunk_count ? zmq::send_flags::none : zmq::send_flags::sndmore;
+			sock_.send(zmq::buffer(payload_[i].data(), payload_[i].size()), flags);
+			total += payload_[i].size();
+		}
+		spdlog::trace("network frame@{} ({}); {} -> {} bytes", staged_frame_count_, is_key ? "key" : "delta", size, total);
+	} catch (const zmq::error_t &e) {
+		spdlog::error("failed to send network frame@{}; {}", staged_frame_count_, e.what());
+	}
+}
+}
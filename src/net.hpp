@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <zmq.hpp>
+#include "common.hpp"
+#include "config.hpp"
+#include "worker_pool.hpp"
+
+namespace app {
+constexpr auto NET_TOPIC_MAGIC = 0x7e;
+
+enum net_frame_flag : uint8_t {
+	/// the payload is the full frame
+	NET_FRAME_KEY = 1 << 0,
+	/// the payload is XOR-ed against the keyframe `keyframe_count`
+	NET_FRAME_DELTA = 1 << 1,
+	/// the frame has RGB channel order instead of BGR, see `channel_order_t`
+	NET_FRAME_RGB = 1 << 2,
+};
+
+/// header of a compressed frame on the network stream.
+///
+/// message layout: `[NET_TOPIC_MAGIC] [net_frame_header_t] [chunk 0] ... [chunk n-1]`;
+/// every chunk is compressed independently with `codec`
+struct __attribute__((packed)) net_frame_header_t {
+	uint64_t frame_count;
+	/// frame_count of the keyframe a delta frame is XOR-ed against; equals `frame_count` for keyframes
+	uint64_t keyframe_count;
+	frame_info_t info;
+	/// see `codec_t`
+	uint8_t codec;
+	/// see `net_frame_flag`
+	uint8_t flags;
+	uint16_t chunk_count;
+	/// uncompressed size of every chunk but the last one
+	uint32_t chunk_size;
+};
+
+/// publishes compressed (optionally delta-encoded) frames on a ZMQ PUB socket.
+///
+/// encoding happens on a dedicated thread so the capture loop only pays for
+/// one copy into the staging buffer; a frame submitted while the previous one
+/// is still being encoded is dropped. since delta frames only reference the
+/// last keyframe, dropping one never breaks the frames after it.
+class net_publisher {
+public:
+	/// @throws zmq::error_t when binding fails
+	/// @throws app::invalid_argument when the codec is not compiled in
+	net_publisher(zmq::context_t &ctx, const NetworkConfig &config);
+	~net_publisher();
+
+	net_publisher(const net_publisher &)            = delete;
+	net_publisher &operator=(const net_publisher &) = delete;
+
+	/// frames with 3 or more channels are sent in `order`; request a keyframe when it changes.
+	/// `frame_order` is the order `frame` is in, e.g. `order` for a frame read back from the ring
+	/// @return false if the frame is dropped because the encoder is busy
+	bool submit(const cv::Mat &frame, uint64_t frame_count, const frame_info_t &info,
+				channel_order_t order = channel_order_t::bgr, channel_order_t frame_order = channel_order_t::bgr);
+
+	/// force the next encoded frame to be a keyframe
+	void request_keyframe() {
+		keyframe_requested_.store(true, std::memory_order::relaxed);
+	}
+
+	[[nodiscard]]
+	uint64_t dropped() const {
+		return dropped_.load(std::memory_order::relaxed);
+	}
+
+private:
+	void run();
+	void encode();
+	bool compress_chunk(size_t index, std::span<const uint8_t> input);
+
+	NetworkConfig config_;
+	zmq::socket_t sock_;
+	worker_pool pool_;
+
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	bool pending_  = false;
+	bool stopping_ = false;
+
+	std::vector<uint8_t> staging_;
+	uint64_t staged_frame_count_ = 0;
+	frame_info_t staged_info_{};
+	bool staged_rgb_ = false;
+
+	std::vector<uint8_t> keyframe_;
+	frame_info_t keyframe_info_{};
+	uint64_t keyframe_count_        = 0;
+	uint32_t frames_since_keyframe_ = 0;
+	bool has_keyframe_              = false;
+
+	/// per chunk buffers; `scratch_` holds the XOR-ed input of a delta frame
+	std::vector<std::vector<uint8_t>> scratch_;
+	std::vector<std::vector<uint8_t>> compressed_;
+	std::vector<std::span<const uint8_t>> payload_;
+	/// per chunk codec state (`ZSTD_CCtx *`)
+	std::vector<void *> contexts_;
+
+	std::atomic_bool keyframe_requested_{false};
+	std::atomic<uint64_t> dropped_{0};
+	std::thread thread_;
+};
+}
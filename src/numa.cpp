@@ -0,0 +1,123 @@
+#include "numa.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <format>
+#include <fstream>
+#include <string>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace app {
+std::optional<std::vector<uint32_t>> parse_cpu_list(std::string_view s) {
+	std::vector<uint32_t> ret;
+	while (not s.empty()) {
+		const auto comma = s.find(',');
+		auto range       = s.substr(0, comma);
+		s                = comma == std::string_view::npos ? std::string_view{} : s.substr(comma + 1);
+		if (range.empty()) {
+			continue;
+		}
+		uint32_t first = 0;
+		const auto [p, ec] = std::from_chars(range.data(), range.data() + range.size(), first);
+		if (ec != std::errc{}) {
+			return std::nullopt;
+		}
+		uint32_t last = first;
+		if (p != range.data() + range.size()) {
+			if (*p != '-') {
+				return std::nullopt;
+			}
+			const auto r = std::from_chars(p + 1, range.data() + range.size(), last);
+			if (r.ec != std::errc{} or r.ptr != range.data() + range.size() or last < first) {
+				return std::nullopt;
+			}
+		}
+		for (auto cpu = first; cpu <= last; ++cpu) {
+			ret.push_back(cpu);
+		}
+	}
+	return ret;
+}
+
+std::string format_cpu_list(const std::vector<uint32_t> &cpus) {
+	auto ret = std::string{};
+	for (const auto cpu : cpus) {
+		ret += std::format("{}{}", ret.empty() ? "" : ",", cpu);
+	}
+	return ret;
+}
+
+std::optional<std::vector<uint32_t>> node_cpus(uint32_t node) {
+	auto ifs = std::ifstream{std::format("/sys/devices/system/node/node{}/cpulist", node)};
+	std::string line;
+	if (not std::getline(ifs, line)) {
+		return std::nullopt;
+	}
+	return parse_cpu_list(line);
+}
+
+bool bind_memory(void *addr, size_t size, uint32_t node) {
+	constexpr size_t bits = sizeof(unsigned long) * 8;
+	std::vector<unsigned long> mask(node / bits + 1, 0);
+	mask[node / bits] |= 1UL << (node % bits);
+	// the kernel takes one bit less than `maxnode`
+	const auto maxnode = mask.size() * bits + 1;
+	return syscall(SYS_mbind, addr, size, MPOL_BIND, mask.data(), maxnode, MPOL_MF_MOVE) == 0;
+}
+
+bool set_cpu_affinity(const std::vector<uint32_t> &cpus) {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (const auto cpu : cpus) {
+		if (cpu >= MAX_CPUS) {
+			errno = EINVAL;
+			return false;
+		}
+		CPU_SET(cpu, &set);
+	}
+	return sched_setaffinity(0, sizeof(cpu_set_t), &set) == 0;
+}
+
+std::vector<uint32_t> allowed_cpus() {
+	std::vector<uint32_t> ret;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (sched_getaffinity(0, sizeof(cpu_set_t), &set) != 0) {
+		return ret;
+	}
+	for (uint32_t cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+		if (CPU_ISSET(cpu, &set)) {
+			ret.push_back(cpu);
+		}
+	}
+	return ret;
+}
+
+std::vector<size_t> page_nodes(const void *addr, size_t size, size_t page_size, size_t max_samples) {
+	const auto pages = size / page_size;
+	const auto step  = std::max<size_t>(1, pages / max_samples);
+	std::vector<void *> samples;
+	for (size_t i = 0; i < pages; i += step) {
+		samples.push_back(const_cast<uint8_t *>(static_cast<const uint8_t *>(addr)) + i * page_size);
+	}
+	std::vector<int> status(samples.size(), -1);
+	std::vector<size_t> ret;
+	// without target nodes `move_pages` only reports where each page is
+	if (syscall(SYS_move_pages, 0, samples.size(), samples.data(), nullptr, status.data(), 0) != 0) {
+		return ret;
+	}
+	for (const auto node : status) {
+		if (node < 0) {
+			continue;
+		}
+		if (static_cast<size_t>(node) >= ret.size()) {
+			ret.resize(node + 1, 0);
+		}
+		ret[node] += step;
+	}
+	return ret;
+}
+}
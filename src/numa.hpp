@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sched.h>
+
+// NUMA placement through the raw system calls, so libnuma isn't needed.
+namespace app {
+/// CPU indices are below this; the size of `cpu_set_t`
+constexpr uint32_t MAX_CPUS = CPU_SETSIZE;
+
+/// parse a kernel CPU/node list like `0-3,8,10-11`
+std::optional<std::vector<uint32_t>> parse_cpu_list(std::string_view s);
+
+/// `cpus` as a comma separated list
+std::string format_cpu_list(const std::vector<uint32_t> &cpus);
+
+/// CPUs of NUMA node `node`, from `/sys/devices/system/node`
+std::optional<std::vector<uint32_t>> node_cpus(uint32_t node);
+
+/// bind the pages of `[addr, addr + size)` to `node` and move the ones already faulted in.
+/// on a shared mapping the policy sticks to the object, so pages faulted later land there as well
+/// @return false with `errno` set
+bool bind_memory(void *addr, size_t size, uint32_t node);
+
+/// restrict the calling thread, and every thread it creates afterwards, to `cpus`
+/// @return false with `errno` set; `EINVAL` for an index from `MAX_CPUS`
+bool set_cpu_affinity(const std::vector<uint32_t> &cpus);
+
+/// CPUs the calling thread may run on; empty on failure
+std::vector<uint32_t> allowed_cpus();
+
+/// number of resident pages per NUMA node (the index) in `[addr, addr + size)`.
+/// samples at most `max_samples` pages evenly; pages not faulted in yet aren't counted
+std::vector<size_t> page_nodes(const void *addr, size_t size, size_t page_size, size_t max_samples = 4096);
+}
@@ -0,0 +1,590 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Layout of the shared memory object, shared by the producer and C++ consumers.
+// `client/cvmmap/layout.py` mirrors it for Python consumers.
+//
+// [shm_header_t, padded to a page] [ring]
+// where the header describes the frames (`frame_shape_t`) and the ring, so a
+// consumer can map the frames as soon as the header is valid,
+// and the ring is
+// [frame_slot_t * slot_count, padded] [side data * slot_count, padded] [frame 0] [frame 1] ... [frame n-1]
+// with side data areas `side_data_capacity` apart, starting at `side_data_offset`, frames `frame_stride` apart, starting at `frames_offset` from the ring,
+// and rows `row_stride` apart within a frame.
+//
+// Everything that more than one process writes is a lock-free atomic, which is
+// address-free and therefore safe across processes.
+namespace app {
+constexpr uint32_t SHM_MAGIC        = 0x70616d63; // "cmap"
+constexpr uint16_t SHM_VERSION      = 6;
+constexpr size_t MAX_CONSUMERS      = 32;
+constexpr size_t CONSUMER_NAME_SIZE = 24;
+/// bounded by the width of `consumer_slot_t::pinned_mask`
+constexpr size_t MAX_SLOTS          = 64;
+/// upper bound of the side data area of a slot
+constexpr size_t MAX_SIDE_DATA_SIZE = 1 << 20;
+constexpr uint64_t NS_PER_MS        = 1'000'000;
+constexpr uint64_t NS_PER_S         = 1'000'000'000;
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+inline uint64_t monotonic_ns() {
+	timespec ts{};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * NS_PER_S + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+/// `CLOCK_MONOTONIC` timestamps of a frame in nanoseconds; 0 if unknown
+struct frame_times_t {
+	/// when the source captured the frame, if the backend reports it; otherwise when the read started
+	uint64_t capture_ns;
+	/// when the frame was read from the source
+	uint64_t grabbed_ns;
+	/// when the frame was complete in shared memory
+	uint64_t published_ns;
+};
+
+/// a reader registered in the shared memory header; one cache line each
+struct alignas(64) consumer_slot_t {
+	/// 0 if the slot is free; claimed with compare-exchange
+	std::atomic<uint32_t> pid;
+	/// `pid_namespace()` of the consumer; 0 if unknown. `pid` only names a
+	/// process to a producer in the same namespace
+	std::atomic<uint32_t> pid_ns;
+	/// `frame_count` of the last frame the consumer has read
+	std::atomic<uint64_t> last_frame_count;
+	/// bit `i` is set while the consumer pins ring slot `i`; lets the producer
+	/// release the pins of a consumer that died
+	std::atomic<uint64_t> pinned_mask;
+	/// `CLOCK_MONOTONIC` in nanoseconds, refreshed by the consumer with compare-exchange.
+	/// `UINT64_MAX` for a freed slot, so a consumer claiming it isn't pruned
+	/// before its first heartbeat lands, and for one being pruned, so the
+	/// consumer's next heartbeat fails instead of writing into a reused slot
+	std::atomic<uint64_t> heartbeat_ns;
+	/// NUL terminated unless it's exactly `CONSUMER_NAME_SIZE` long
+	char name[CONSUMER_NAME_SIZE];
+};
+static_assert(sizeof(consumer_slot_t) == 64);
+
+/// geometry of the frames in the ring; mirrors `frame_info_t` without depending on OpenCV
+struct frame_shape_t {
+	uint32_t width;
+	uint32_t height;
+	uint8_t channels;
+	/// OpenCV depth, e.g. `CV_8U`
+	uint8_t depth;
+	/// `channel_order_t` of frames with 3 or more channels; 0 (BGR) otherwise
+	uint8_t channel_order;
+	uint8_t reserved;
+	uint32_t reserved2;
+	/// `width * channels * elemSize * height`; rows in the ring may be padded beyond that
+	uint64_t buffer_size;
+};
+static_assert(sizeof(frame_shape_t) == 24);
+
+struct shm_header_t {
+	/// `SHM_MAGIC`, written last by the producer once the header is valid
+	uint32_t magic;
+	uint16_t version;
+	uint16_t max_consumers;
+	/// offset of the first ring slot from the start of the object; page aligned
+	uint64_t data_offset;
+	uint32_t slot_count;
+	/// upper bound of slots pinned at the same time, over all consumers; 0 disables leasing
+	uint32_t max_pinned;
+	/// distance between two frames in the ring
+	uint64_t frame_stride;
+	/// index of the slot holding the most recently published frame
+	std::atomic<uint32_t> latest_slot;
+	std::atomic<uint32_t> pinned_total;
+	/// bumped whenever the ring is laid out again, odd while that is in progress;
+	/// consumers remap when it changes
+	std::atomic<uint32_t> generation;
+	/// distance between two rows of a frame; at least `width * channels * elemSize`
+	uint32_t row_stride;
+	/// offset of the first frame from the start of the ring, after the slot headers
+	uint64_t frames_offset;
+	/// `frame_count + 1` of the frame in `latest_slot`, so that frame 0 counts;
+	/// 0 until the first frame is published
+	std::atomic<uint64_t> latest_frame_count;
+	/// frames in every ring slot; written with the ring layout
+	frame_shape_t shape;
+	/// offset of the first side data area from the start of the ring
+	uint64_t side_data_offset;
+	/// size of the side data area of every slot, and the distance between two of them; 0 if disabled
+	uint32_t side_data_capacity;
+	alignas(64) consumer_slot_t consumers[MAX_CONSUMERS];
+};
+static_assert(offsetof(shm_header_t, row_stride) == 44);
+static_assert(offsetof(shm_header_t, latest_frame_count) == 56);
+static_assert(offsetof(shm_header_t, shape) == 64);
+static_assert(offsetof(shm_header_t, side_data_offset) == 88);
+static_assert(offsetof(shm_header_t, consumers) == 128);
+
+/// sent along with the file descriptor of an anonymous object, see `fd_server`
+struct __attribute__((packed)) shm_descriptor_t {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t reserved;
+	uint64_t data_offset;
+	/// size of the object when the descriptor was sent; it never shrinks
+	uint64_t size;
+};
+
+/// header of a ring slot; the headers are packed at the start of the ring, apart from the frames
+struct alignas(64) frame_slot_t {
+	/// seqlock; odd while the producer writes the slot
+	std::atomic<uint64_t> seq;
+	/// `frame_count` of the frame in the slot
+	std::atomic<uint64_t> frame_count;
+	/// number of consumers pinning the slot; the producer never writes a pinned slot
+	std::atomic<uint32_t> pins;
+	/// bytes of side data records of the frame in the slot
+	std::atomic<uint32_t> side_data_size;
+	/// `frame_times_t` of the frame in the slot
+	std::atomic<uint64_t> capture_ns;
+	std::atomic<uint64_t> grabbed_ns;
+	std::atomic<uint64_t> published_ns;
+};
+static_assert(sizeof(frame_slot_t) == 64);
+
+/// `ring` points at `data_offset` in the object
+inline frame_slot_t &ring_slot(void *ring, uint32_t index) {
+	return static_cast<frame_slot_t *>(ring)[index];
+}
+
+inline uint8_t *frame_data(const shm_header_t &header, void *ring, uint32_t index) {
+	return static_cast<uint8_t *>(ring) + header.frames_offset + index * header.frame_stride;
+}
+
+inline std::span<uint8_t> side_data_area(const shm_header_t &header, void *ring, uint32_t index) {
+	return {static_cast<uint8_t *>(ring) + header.side_data_offset + index * header.side_data_capacity,
+			header.side_data_capacity};
+}
+
+/// `alignment` is a power of two
+constexpr uint64_t align_up(uint64_t n, uint64_t alignment) {
+	return (n + alignment - 1) & ~(alignment - 1);
+}
+
+/// how a ring is laid out in memory; written to the header by `init_ring`
+struct ring_geometry_t {
+	uint32_t slot_count;
+	uint32_t max_pinned;
+	uint32_t row_stride;
+	uint64_t side_data_offset;
+	uint32_t side_data_capacity;
+	uint64_t frames_offset;
+	uint64_t frame_stride;
+
+	/// bytes to map at `data_offset`
+	[[nodiscard]]
+	uint64_t size() const {
+		return frames_offset + slot_count * frame_stride;
+	}
+};
+
+/// pad rows to `row_alignment` and start every frame on `frame_alignment` (both powers of two);
+/// frame starts are aligned relative to the ring, which itself starts on a page.
+/// every slot gets `side_data_size` bytes of side data, rounded up to a cache line
+inline ring_geometry_t make_ring_geometry(uint32_t slot_count, uint32_t max_pinned,
+										  uint64_t row_bytes, uint64_t rows,
+										  uint64_t row_alignment, uint64_t frame_alignment,
+										  uint64_t side_data_size = 0) {
+	const auto row_stride         = align_up(row_bytes, row_alignment);
+	const auto side_data_offset   = slot_count * sizeof(frame_slot_t);
+	const auto side_data_capacity = align_up(side_data_size, alignof(frame_slot_t));
+	return ring_geometry_t{
+		.slot_count         = slot_count,
+		.max_pinned         = max_pinned,
+		.row_stride         = static_cast<uint32_t>(row_stride),
+		.side_data_offset   = side_data_offset,
+		.side_data_capacity = static_cast<uint32_t>(side_data_capacity),
+		.frames_offset      = align_up(side_data_offset + slot_count * side_data_capacity, frame_alignment),
+		.frame_stride       = align_up(row_stride * rows, frame_alignment),
+	};
+}
+
+/// size reserved for `shm_header_t`, rounded up to the page size so the ring can be mapped on its own
+inline size_t shm_data_offset(size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE))) {
+	return (sizeof(shm_header_t) + page_size - 1) / page_size * page_size;
+}
+
+/// inode of the PID namespace of the calling process, truncated like `consumer_slot_t::pid_ns`; 0 on failure
+inline uint32_t pid_namespace() {
+	struct stat st{};
+	if (stat("/proc/self/ns/pid", &st) == -1) {
+		return 0;
+	}
+	return static_cast<uint32_t>(st.st_ino);
+}
+
+/// consumer side; claim a free slot or return `nullptr` when all of them are taken
+inline consumer_slot_t *register_consumer(shm_header_t &header, uint32_t pid, std::string_view name) {
+	for (auto &slot : header.consumers) {
+		uint32_t expected = 0;
+		if (slot.pid.compare_exchange_strong(expected, pid, std::memory_order::acq_rel)) {
+			const auto n = std::min(name.size(), CONSUMER_NAME_SIZE);
+			memset(slot.name, 0, CONSUMER_NAME_SIZE);
+			memcpy(slot.name, name.data(), n);
+			slot.pid_ns.store(pid_namespace(), std::memory_order::relaxed);
+			slot.last_frame_count.store(0, std::memory_order::relaxed);
+			slot.heartbeat_ns.store(monotonic_ns(), std::memory_order::release);
+			return &slot;
+		}
+	}
+	return nullptr;
+}
+
+/// consumer side; call after reading a frame, and periodically while idle
+/// @return false, leaving the slot alone, if the producer has pruned it in the meantime; register again.
+/// it might belong to another consumer by now
+inline bool heartbeat(consumer_slot_t &slot, uint32_t pid, uint64_t frame_count) {
+	auto beat = slot.heartbeat_ns.load(std::memory_order::acquire);
+	// the producer takes `UINT64_MAX` with compare-exchange before freeing the slot, so once the
+	// exchange succeeds the slot stays ours until this heartbeat goes stale
+	do {
+		if (beat == UINT64_MAX or slot.pid.load(std::memory_order::acquire) != pid) {
+			return false;
+		}
+	} while (not slot.heartbeat_ns.compare_exchange_weak(beat, monotonic_ns(), std::memory_order::acq_rel));
+	slot.last_frame_count.store(frame_count, std::memory_order::relaxed);
+	return true;
+}
+
+/// end every lease with `unpin_slot` first
+inline void unregister_consumer(consumer_slot_t &slot) {
+	slot.heartbeat_ns.store(UINT64_MAX, std::memory_order::relaxed);
+	slot.pid_ns.store(0, std::memory_order::relaxed);
+	slot.pid.store(0, std::memory_order::release);
+}
+
+struct consumer_info_t {
+	uint32_t pid;
+	std::string name;
+	uint64_t last_frame_count;
+	uint64_t heartbeat_age_ns;
+};
+
+/// producer side; snapshot of the registered consumers
+inline std::vector<consumer_info_t> list_consumers(const shm_header_t &header) {
+	std::vector<consumer_info_t> ret;
+	const auto now = monotonic_ns();
+	for (const auto &slot : header.consumers) {
+		const auto pid = slot.pid.load(std::memory_order::acquire);
+		if (pid == 0) {
+			continue;
+		}
+		const auto beat = slot.heartbeat_ns.load(std::memory_order::acquire);
+		ret.push_back(consumer_info_t{
+			.pid              = pid,
+			.name             = std::string{slot.name, strnlen(slot.name, CONSUMER_NAME_SIZE)},
+			.last_frame_count = slot.last_frame_count.load(std::memory_order::relaxed),
+			.heartbeat_age_ns = now > beat ? now - beat : 0,
+		});
+	}
+	return ret;
+}
+
+/// drop the pins recorded in `consumer.pinned_mask`. Every pin is counted
+/// only while its bit is set, so whoever clears the bit releases the pin.
+inline void release_pins(shm_header_t &header, void *ring, consumer_slot_t &consumer, uint64_t mask = UINT64_MAX) {
+	const auto held = consumer.pinned_mask.fetch_and(~mask, std::memory_order::acq_rel) & mask;
+	for (uint32_t i = 0; i < MAX_SLOTS; ++i) {
+		if ((held & (uint64_t{1} << i)) == 0) {
+			continue;
+		}
+		ring_slot(ring, i).pins.fetch_sub(1, std::memory_order::release);
+		header.pinned_total.fetch_sub(1, std::memory_order::release);
+	}
+}
+
+/// producer side; release the slots of consumers that are gone or haven't sent a heartbeat within `timeout_ns`,
+/// together with the ring slots they still pin.
+///
+/// the process check is only a shortcut for consumers in the producer's PID namespace;
+/// one in another namespace, or one that didn't record it, is pruned by its heartbeat alone.
+/// @return number of pruned slots
+inline size_t prune_consumers(shm_header_t &header, void *ring, uint64_t timeout_ns) {
+	size_t pruned  = 0;
+	const auto now = monotonic_ns();
+	const auto ns  = pid_namespace();
+	for (auto &slot : header.consumers) {
+		auto pid = slot.pid.load(std::memory_order::acquire);
+		if (pid == 0) {
+			continue;
+		}
+		auto beat           = slot.heartbeat_ns.load(std::memory_order::acquire);
+		const bool stale    = beat != UINT64_MAX and now > beat and now - beat > timeout_ns;
+		const bool is_local = ns != 0 and slot.pid_ns.load(std::memory_order::relaxed) == ns;
+		const bool is_gone  = is_local and kill(static_cast<pid_t>(pid), 0) == -1 and errno == ESRCH;
+		if (not(stale or is_gone)) {
+			continue;
+		}
+		// fails if the consumer's heartbeat lands first; it's alive then
+		if (not slot.heartbeat_ns.compare_exchange_strong(beat, UINT64_MAX, std::memory_order::acq_rel)) {
+			continue;
+		}
+		// before the slot is freed; a new consumer claiming it starts without pins
+		release_pins(header, ring, slot);
+		slot.pid_ns.store(0, std::memory_order::relaxed);
+		if (slot.pid.compare_exchange_strong(pid, 0, std::memory_order::acq_rel)) {
+			pruned += 1;
+		}
+	}
+	return pruned;
+}
+
+/// producer side; lay out the ring as described by `geometry`, for frames of `shape`.
+///
+/// `ring` must map `geometry.size()` bytes. The previous content and every
+/// lease are dropped; consumers learn about it from the bumped `generation`.
+///
+/// the pin counters of slots that already existed are never reset: a consumer
+/// pinning concurrently may still add to them and take it back afterwards, and
+/// a reset in between would leave the slot pinned forever.
+inline void init_ring(shm_header_t &header, void *ring, const ring_geometry_t &geometry, const frame_shape_t &shape) {
+	// bumped first, so a consumer pinning concurrently notices and backs off
+	header.generation.fetch_add(1, std::memory_order::acq_rel);
+	for (auto &consumer : header.consumers) {
+		release_pins(header, ring, consumer);
+	}
+	const auto previous_slot_count = header.slot_count;
+	header.slot_count    = geometry.slot_count;
+	header.max_pinned    = geometry.max_pinned;
+	header.row_stride    = geometry.row_stride;
+	header.frames_offset = geometry.frames_offset;
+	header.frame_stride  = geometry.frame_stride;
+	header.shape         = shape;
+	header.side_data_offset   = geometry.side_data_offset;
+	header.side_data_capacity = geometry.side_data_capacity;
+	for (uint32_t i = 0; i < geometry.slot_count; ++i) {
+		auto &slot = ring_slot(ring, i);
+		// was frame data until now; no consumer can have touched it
+		if (i >= previous_slot_count) {
+			slot.seq.store(0, std::memory_order::relaxed);
+			slot.pins.store(0, std::memory_order::relaxed);
+		}
+		slot.frame_count.store(0, std::memory_order::relaxed);
+		slot.side_data_size.store(0, std::memory_order::relaxed);
+		slot.capture_ns.store(0, std::memory_order::relaxed);
+		slot.grabbed_ns.store(0, std::memory_order::relaxed);
+		slot.published_ns.store(0, std::memory_order::relaxed);
+	}
+	header.latest_slot.store(0, std::memory_order::relaxed);
+	header.latest_frame_count.store(0, std::memory_order::relaxed);
+	header.generation.fetch_add(1, std::memory_order::release);
+}
+
+/// producer side; claim the oldest slot that no consumer pins, and mark it as being written.
+///
+/// the latest slot is never handed out while there is more than one slot, so
+/// a reader of the latest frame always finds it intact.
+/// @return `std::nullopt` if every candidate is pinned; drop the frame
+inline std::optional<uint32_t> begin_write(shm_header_t &header, void *ring) {
+	const auto n      = header.slot_count;
+	const auto latest = header.latest_slot.load(std::memory_order::relaxed);
+	for (uint32_t k = 1; k <= n; ++k) {
+		const auto i = (latest + k) % n;
+		if (i == latest and n > 1) {
+			continue;
+		}
+		auto &slot     = ring_slot(ring, i);
+		const auto seq = slot.seq.load(std::memory_order::relaxed);
+		// pairs with `pin_latest`; either this sees the pin, or the pinner sees the odd sequence
+		slot.seq.store(seq + 1, std::memory_order::seq_cst);
+		if (slot.pins.load(std::memory_order::seq_cst) != 0) {
+			slot.seq.store(seq, std::memory_order::relaxed);
+			continue;
+		}
+		// the frame is written with plain stores, which may otherwise become visible before the
+		// odd sequence on a weakly ordered CPU, and a reader would accept them under the old one
+		std::atomic_thread_fence(std::memory_order::release);
+		return i;
+	}
+	return std::nullopt;
+}
+
+/// producer side; publish the slot claimed with `begin_write`, along with
+/// `side_data_size` bytes of records written to its `side_data_area`
+inline void end_write(shm_header_t &header, void *ring, uint32_t index, uint64_t frame_count, const frame_times_t &times,
+					  uint32_t side_data_size = 0) {
+	auto &slot = ring_slot(ring, index);
+	slot.frame_count.store(frame_count, std::memory_order::relaxed);
+	slot.side_data_size.store(side_data_size, std::memory_order::relaxed);
+	slot.capture_ns.store(times.capture_ns, std::memory_order::relaxed);
+	slot.grabbed_ns.store(times.grabbed_ns, std::memory_order::relaxed);
+	slot.published_ns.store(times.published_ns, std::memory_order::relaxed);
+	slot.seq.store(slot.seq.load(std::memory_order::relaxed) + 1, std::memory_order::release);
+	header.latest_frame_count.store(frame_count + 1, std::memory_order::relaxed);
+	header.latest_slot.store(index, std::memory_order::release);
+}
+
+/// consumer side; lease the latest slot so the producer won't overwrite it until `unpin_slot`.
+///
+/// fails when leasing is disabled, `max_pinned` slots are already leased, the
+/// consumer holds that slot already, or the producer is rewriting the ring.
+/// @return index of the leased slot
+inline std::optional<uint32_t> pin_latest(shm_header_t &header, void *ring, consumer_slot_t &consumer) {
+	const auto generation = header.generation.load(std::memory_order::acquire);
+	if (generation % 2 != 0 or header.max_pinned == 0) {
+		return std::nullopt;
+	}
+	if (header.pinned_total.fetch_add(1, std::memory_order::acq_rel) >= header.max_pinned) {
+		header.pinned_total.fetch_sub(1, std::memory_order::release);
+		return std::nullopt;
+	}
+	const auto index = header.latest_slot.load(std::memory_order::acquire);
+	const auto bit   = uint64_t{1} << index;
+	if ((consumer.pinned_mask.load(std::memory_order::acquire) & bit) != 0) {
+		header.pinned_total.fetch_sub(1, std::memory_order::release);
+		return std::nullopt;
+	}
+	auto &slot = ring_slot(ring, index);
+	slot.pins.fetch_add(1, std::memory_order::seq_cst);
+	const bool is_writing = slot.seq.load(std::memory_order::seq_cst) % 2 != 0;
+	if (is_writing or header.generation.load(std::memory_order::acquire) != generation) {
+		// not in `pinned_mask` yet, so nobody else drops these
+		slot.pins.fetch_sub(1, std::memory_order::release);
+		header.pinned_total.fetch_sub(1, std::memory_order::release);
+		return std::nullopt;
+	}
+	// from here on `init_ring` or `prune_consumers` may drop the pin through the mask
+	if ((consumer.pinned_mask.fetch_or(bit, std::memory_order::acq_rel) & bit) != 0) {
+		// another thread of this consumer leased the slot meanwhile
+		slot.pins.fetch_sub(1, std::memory_order::release);
+		header.pinned_total.fetch_sub(1, std::memory_order::release);
+		return std::nullopt;
+	}
+	if (header.generation.load(std::memory_order::acquire) != generation) {
+		release_pins(header, ring, consumer, bit);
+		return std::nullopt;
+	}
+	return index;
+}
+
+/// consumer side; end a lease taken with `pin_latest`
+inline void unpin_slot(shm_header_t &header, void *ring, consumer_slot_t &consumer, uint32_t index) {
+	release_pins(header, ring, consumer, uint64_t{1} << index);
+}
+
+/// producer side; number of consumers with a heartbeat within `timeout_ns`
+inline size_t count_live_consumers(const shm_header_t &header, uint64_t timeout_ns) {
+	size_t n       = 0;
+	const auto now = monotonic_ns();
+	for (const auto &slot : header.consumers) {
+		if (slot.pid.load(std::memory_order::acquire) == 0) {
+			continue;
+		}
+		const auto beat = slot.heartbeat_ns.load(std::memory_order::acquire);
+		if (now <= beat or now - beat <= timeout_ns) {
+			n += 1;
+		}
+	}
+	return n;
+}
+
+/// well-known types of side data records; `user` and above are free for applications
+enum class side_data_type_t : uint16_t {
+	/// `double`, `CAP_PROP_EXPOSURE` as the backend reports it
+	exposure = 1,
+	/// `double`, `CAP_PROP_GAIN` as the backend reports it
+	gain = 2,
+	/// `double[3]`; latitude and longitude in degrees, altitude in meters
+	gps = 3,
+	/// object detections; the encoding is agreed on between producer and consumers
+	detections = 4,
+	user = 0x8000,
+};
+
+/// a record in the side data area of a slot, followed by `length` bytes of
+/// value and padding up to the next multiple of 8
+struct side_data_record_t {
+	uint16_t type;
+	uint16_t reserved;
+	uint32_t length;
+};
+static_assert(sizeof(side_data_record_t) == 8);
+
+/// producer side; appends records to the side data area of a slot between
+/// `begin_write` and `end_write`, which takes `size()`
+class side_data_writer {
+public:
+	explicit side_data_writer(std::span<uint8_t> area) : area_(area) {}
+
+	/// @return false if the record doesn't fit in what is left of the area; nothing is written then
+	bool append(uint16_t type, std::span<const uint8_t> value) {
+		const auto next = used_ + sizeof(side_data_record_t) + align_up(value.size(), sizeof(side_data_record_t));
+		if (next > area_.size() or value.size() > UINT32_MAX) {
+			return false;
+		}
+		const auto record = side_data_record_t{
+			.type     = type,
+			.reserved = 0,
+			.length   = static_cast<uint32_t>(value.size()),
+		};
+		memcpy(area_.data() + used_, &record, sizeof(side_data_record_t));
+		memcpy(area_.data() + used_ + sizeof(side_data_record_t), value.data(), value.size());
+		used_ = next;
+		return true;
+	}
+
+	template <typename T>
+		requires std::is_trivially_copyable_v<T>
+	bool append(side_data_type_t type, const T &value) {
+		return append(static_cast<uint16_t>(type), std::span{reinterpret_cast<const uint8_t *>(&value), sizeof(T)});
+	}
+
+	[[nodiscard]]
+	uint32_t size() const {
+		return static_cast<uint32_t>(used_);
+	}
+
+private:
+	std::span<uint8_t> area_;
+	size_t used_ = 0;
+};
+
+struct side_data_view_t {
+	uint16_t type;
+	std::span<const uint8_t> value;
+};
+
+/// consumer side; the records in the first `size` bytes of a side data area.
+/// a truncated record ends the list
+inline std::vector<side_data_view_t> parse_side_data(std::span<const uint8_t> area, uint32_t size) {
+	std::vector<side_data_view_t> ret;
+	size_t offset = 0;
+	const auto end = std::min<size_t>(size, area.size());
+	while (offset + sizeof(side_data_record_t) <= end) {
+		side_data_record_t record;
+		memcpy(&record, area.data() + offset, sizeof(side_data_record_t));
+		offset += sizeof(side_data_record_t);
+		if (record.length > end - offset) {
+			break;
+		}
+		ret.push_back(side_data_view_t{
+			.type  = record.type,
+			.value = area.subspan(offset, record.length),
+		});
+		offset += align_up(record.length, sizeof(side_data_record_t));
+	}
+	return ret;
+}
+}
@@ -0,0 +1,19 @@
+#include "side_data.hpp"
+
+namespace app {
+namespace {
+	std::vector<side_data_source_fn> &sources() {
+		// constructed on first use, so static initializers of other translation units can add to it
+		static std::vector<side_data_source_fn> ret;
+		return ret;
+	}
+}
+
+void add_side_data_source(side_data_source_fn fn) {
+	sources().push_back(std::move(fn));
+}
+
+const std::vector<side_data_source_fn> &side_data_sources() {
+	return sources();
+}
+}
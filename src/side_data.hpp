@@ -0,0 +1,22 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <opencv2/core.hpp>
+#include "shm_layout.hpp"
+
+// Hooks for in-process code attaching side data records to the frames.
+namespace app {
+/// appends records about `frame` to `writer`. Runs on the capture thread between
+/// `begin_write` and `end_write`, once per frame, so it should be quick
+using side_data_source_fn = std::function<void(side_data_writer &writer, const cv::Mat &frame)>;
+
+/// add a source run for every frame after the built-in exposure and gain records, in the
+/// order they were added. Call it before the capture loop starts, e.g. from a static
+/// initializer of a translation unit linked into the producer. Records only land while
+/// `side_data_size` leaves room for them
+void add_side_data_source(side_data_source_fn fn);
+
+/// every source added so far
+const std::vector<side_data_source_fn> &side_data_sources();
+}
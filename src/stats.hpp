@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include "common.hpp"
+
+namespace app {
+/// rolling statistics of the publish loop, shared with the control endpoint.
+///
+/// the capture loop records once per frame and the control thread takes a
+/// snapshot on request, so a mutex is cheap enough here.
+class stream_stats {
+public:
+	using clock_t = std::chrono::steady_clock;
+	/// number of recent frames fps and latency percentiles are computed over
+	static constexpr size_t WINDOW = 1024;
+
+	struct snapshot_t {
+		uint64_t frame_count = 0;
+		uint64_t published   = 0;
+		uint64_t dropped     = 0;
+		double fps           = 0;
+		/// grab completion to publish completion, in microseconds
+		double latency_p50_us = 0;
+		double latency_p90_us = 0;
+		double latency_p99_us = 0;
+		double latency_max_us = 0;
+		std::optional<frame_info_t> info;
+	};
+
+	/// @param grabbed time point right after the frame is read from the source
+	/// @param published time point right after the synchronization message is sent
+	void record_published(uint64_t frame_count, const frame_info_t &info, clock_t::time_point grabbed, clock_t::time_point published) {
+		std::lock_guard lock{mutex_};
+		const auto i     = published_ % WINDOW;
+		latency_us_[i]   = std::chrono::duration<double, std::micro>(published - grabbed).count();
+		published_at_[i] = published;
+		frame_count_     = frame_count;
+		info_            = info;
+		published_ += 1;
+	}
+
+	/// a frame was read from the source but not published
+	void record_dropped() {
+		std::lock_guard lock{mutex_};
+		dropped_ += 1;
+	}
+
+	[[nodiscard]]
+	snapshot_t snapshot() {
+		std::lock_guard lock{mutex_};
+		auto s        = snapshot_t{};
+		s.frame_count = frame_count_;
+		s.published   = published_;
+		s.dropped     = dropped_;
+		s.info        = info_;
+		const auto n  = std::min<uint64_t>(published_, WINDOW);
+		if (n == 0) {
+			return s;
+		}
+		if (n > 1) {
+			const auto newest = published_at_[(published_ - 1) % WINDOW];
+			const auto oldest = published_at_[(published_ - n) % WINDOW];
+			const auto span   = std::chrono::duration<double>(newest - oldest).count();
+			s.fps             = span > 0 ? static_cast<double>(n - 1) / span : 0;
+		}
+		auto sorted = latency_us_;
+		std::sort(sorted.begin(), sorted.begin() + n);
+		const auto percentile = [&sorted, n](double p) {
+			return sorted[std::min<size_t>(n - 1, static_cast<size_t>(p * static_cast<double>(n)))];
+		};
+		s.latency_p50_us = percentile(0.50);
+		s.latency_p90_us = percentile(0.90);
+		s.latency_p99_us = percentile(0.99);
+		s.latency_max_us = sorted[n - 1];
+		return s;
+	}
+
+private:
+	std::mutex mutex_;
+	std::array<double, WINDOW> latency_us_{};
+	std::array<clock_t::time_point, WINDOW> published_at_{};
+	uint64_t published_   = 0;
+	uint64_t dropped_     = 0;
+	uint64_t frame_count_ = 0;
+	std::optional<frame_info_t> info_;
+};
+}
@@ -0,0 +1,314 @@
+#include "subscription.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <spdlog/spdlog.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "fd_server.hpp"
+#include "memory.hpp"
+
+namespace app {
+namespace {
+	bool is_valid_name(std::string_view name) {
+		return not name.empty() and name.size() < SUBSCRIPTION_NAME_SIZE and
+			   std::ranges::all_of(name, [](char c) { return std::isalnum(static_cast<unsigned char>(c)) or c == '_' or c == '-'; });
+	}
+
+	/// the settings of `Config` a subscription ring is laid out with
+	struct ring_settings_t {
+		uint32_t slot_count;
+		uint32_t max_pinned;
+		uint32_t row_alignment;
+		uint32_t frame_alignment;
+		channel_order_t channel_order;
+
+		static ring_settings_t of(const Config &config) {
+			return ring_settings_t{
+				.slot_count      = config.slot_count,
+				.max_pinned      = config.max_pinned,
+				.row_alignment   = config.row_alignment,
+				.frame_alignment = config.frame_alignment,
+				.channel_order   = config.channel_order,
+			};
+		}
+
+		bool operator==(const ring_settings_t &) const = default;
+	};
+}
+
+struct roi_subscriptions::subscription_t {
+	std::string name;
+	std::string object_name;
+	std::string topic;
+	transform_options_t transform;
+	const MemoryConfig &memory;
+	int fd;
+	size_t page_size;
+	size_t data_offset;
+	shm_header_t *header;
+	void *ring         = nullptr;
+	size_t mapped_size = 0;
+	/// what the ring is laid out for; zero before the first frame
+	frame_info_t info{};
+	/// the region lies outside the source frame; reported once, published again once it fits
+	bool is_out_of_frame = false;
+	ring_settings_t settings{};
+	frame_transform stage;
+	/// when a consumer was last seen, or the subscription was made
+	uint64_t live_ns;
+	/// serves `fd` when the object is an anonymous `memfd`
+	std::unique_ptr<fd_server> fds;
+
+	subscription_t(std::string name, std::string object_name, const MemoryConfig &memory, int fd, size_t page_size,
+				   size_t data_offset, shm_header_t *header)
+		: name(std::move(name)), object_name(std::move(object_name)), topic(subscription_topic(this->name)), memory(memory),
+		  fd(fd), page_size(page_size), data_offset(data_offset), header(header), live_ns(monotonic_ns()) {}
+
+	~subscription_t() {
+		fds.reset();
+		if (ring != nullptr) {
+			munmap(ring, mapped_size);
+		}
+		munmap(header, data_offset);
+		close(fd);
+		if (shm_object_unlink(object_name, memory) == -1) {
+			spdlog::warn("failed to unlink `{}`: {}", object_name, strerror(errno));
+		}
+	}
+
+	subscription_t(const subscription_t &)            = delete;
+	subscription_t &operator=(const subscription_t &) = delete;
+
+	/// lay out the ring for `next_info`, growing the object if needed
+	bool layout(const frame_info_t &next_info, const ring_settings_t &next_settings) {
+		const auto row_bytes = uint64_t{next_info.width} * next_info.channels * next_info.pixelWidth();
+		const auto geometry  = make_ring_geometry(next_settings.slot_count, next_settings.max_pinned, row_bytes, next_info.height,
+												  next_settings.row_alignment, next_settings.frame_alignment);
+		const auto size      = (geometry.size() + page_size - 1) / page_size * page_size;
+		if (size > mapped_size) {
+			if (ftruncate(fd, static_cast<off_t>(data_offset + size)) == -1) {
+				spdlog::error("failed to grow `{}`; {} ({})", object_name, strerror(errno), errno);
+				return false;
+			}
+			if (ring != nullptr) {
+				munmap(ring, mapped_size);
+			}
+			ring        = nullptr;
+			mapped_size = 0;
+			auto p      = map_shared(fd, size, static_cast<off_t>(data_offset), memory);
+			if (p == MAP_FAILED) {
+				spdlog::error("failed to mmap `{}`; {} ({})", object_name, strerror(errno), errno);
+				return false;
+			}
+			ring        = p;
+			mapped_size = size;
+		}
+		init_ring(*header, ring, geometry,
+				  frame_shape_t{
+					  .width         = next_info.width,
+					  .height        = next_info.height,
+					  .channels      = next_info.channels,
+					  .depth         = next_info.depth,
+					  .channel_order = static_cast<uint8_t>(next_info.channels >= 3 ? next_settings.channel_order : channel_order_t::bgr),
+					  .reserved      = 0,
+					  .reserved2     = 0,
+					  .buffer_size   = next_info.buffer_size,
+				  });
+		info     = next_info;
+		settings = next_settings;
+		spdlog::info("subscription `{}` laid out for {}x{}; generation={}", name, uint32_t{info.width}, uint32_t{info.height},
+					 header->generation.load(std::memory_order::relaxed));
+		return true;
+	}
+};
+
+roi_subscriptions::roi_subscriptions(std::string base, MemoryConfig memory) : base_(std::move(base)), memory_(std::move(memory)) {}
+
+roi_subscriptions::~roi_subscriptions() = default;
+
+std::expected<std::string, std::string> roi_subscriptions::subscribe(std::string_view name, const transform_options_t &transform) {
+	using ue_t = std::unexpected<std::string>;
+	if (not is_valid_name(name)) {
+		return ue_t{std::format("a subscription name is 1 to {} letters, digits, `_` or `-`", SUBSCRIPTION_NAME_SIZE - 1)};
+	}
+	std::lock_guard lock{mutex_};
+	if (const auto whole = cv::Rect{0, 0, source_size_.width, source_size_.height};
+		transform.roi and source_size_.area() > 0 and (*transform.roi & whole) != *transform.roi) {
+		return ue_t{std::format("the region must lie within the {}x{} frame", source_size_.width, source_size_.height)};
+	}
+	if (const auto it = subscriptions_.find(std::string{name}); it != subscriptions_.end()) {
+		// laid out again with the next frame if the geometry changes
+		it->second->transform = transform;
+		spdlog::info("subscription `{}` changed", name);
+		return it->second->object_name;
+	}
+	if (subscriptions_.size() >= MAX_SUBSCRIPTIONS) {
+		return ue_t{std::format("at most {} subscriptions", MAX_SUBSCRIPTIONS)};
+	}
+
+	const auto object_name = subscription_object_name(base_, name);
+	const auto fd          = shm_object_open(object_name, memory_);
+	if (fd == -1) {
+		return ue_t{std::format("failed to create `{}`: {}", object_name, strerror(errno))};
+	}
+	const auto page_size   = backing_page_size(memory_);
+	const auto data_offset = shm_data_offset(page_size);
+	void *p                = MAP_FAILED;
+	if (ftruncate(fd, static_cast<off_t>(data_offset)) == 0) {
+		p = map_shared(fd, data_offset, 0, memory_);
+	}
+	if (p == MAP_FAILED) {
+		const auto reason = std::string{strerror(errno)};
+		close(fd);
+		shm_object_unlink(object_name, memory_);
+		return ue_t{std::format("failed to map `{}`: {}", object_name, reason)};
+	}
+	// as the producer's own header; the object might be left over from a crashed producer
+	auto header           = new (p) shm_header_t{};
+	header->version       = SHM_VERSION;
+	header->max_consumers = MAX_CONSUMERS;
+	header->data_offset   = data_offset;
+	for (auto &slot : header->consumers) {
+		slot.heartbeat_ns.store(UINT64_MAX, std::memory_order::relaxed);
+	}
+	std::atomic_ref{header->magic}.store(SHM_MAGIC, std::memory_order::release);
+
+	auto sub       = std::make_unique<subscription_t>(std::string{name}, object_name, memory_, fd, page_size, data_offset, header);
+	sub->transform = transform;
+	if (memory_.fd_socket) {
+		const auto path = subscription_fd_socket(*memory_.fd_socket, name);
+		try {
+			sub->fds = std::make_unique<fd_server>(path, fd, data_offset);
+		} catch (const std::system_error &e) {
+			return ue_t{std::format("failed to listen on `{}`: {}", path, e.what())};
+		}
+	}
+	subscriptions_.emplace(sub->name, std::move(sub));
+	spdlog::info("subscription `{}` in `{}`", name, object_name);
+	return object_name;
+}
+
+bool roi_subscriptions::unsubscribe(std::string_view name) {
+	std::lock_guard lock{mutex_};
+	if (subscriptions_.erase(std::string{name}) == 0) {
+		return false;
+	}
+	spdlog::info("subscription `{}` removed", name);
+	return true;
+}
+
+std::optional<std::string> roi_subscriptions::fd_socket(std::string_view name) const {
+	if (not memory_.fd_socket) {
+		return std::nullopt;
+	}
+	return subscription_fd_socket(*memory_.fd_socket, name);
+}
+
+std::vector<subscription_info_t> roi_subscriptions::list(uint64_t timeout_ns) const {
+	std::lock_guard lock{mutex_};
+	auto ret = std::vector<subscription_info_t>{};
+	for (const auto &[name, sub] : subscriptions_) {
+		ret.push_back(subscription_info_t{
+			.name           = name,
+			.object_name    = sub->object_name,
+			.fd_socket      = fd_socket(name),
+			.transform      = sub->transform,
+			.info           = sub->info,
+			.live_consumers = app::count_live_consumers(*sub->header, timeout_ns),
+		});
+	}
+	return ret;
+}
+
+void roi_subscriptions::publish(const cv::Mat &frame, uint64_t frame_count, const frame_times_t &times, const Config &config, zmq::socket_t &sock) {
+	std::lock_guard lock{mutex_};
+	const auto settings = ring_settings_t::of(config);
+	source_size_        = frame.size();
+	const auto whole    = cv::Rect{0, 0, source_size_.width, source_size_.height};
+	for (auto &[name, sub] : subscriptions_) {
+		// regions are of the source frame, undistorted if the producer undistorts;
+		// the producer's own `roi` and `output_size` don't apply
+		auto transform      = sub->transform;
+		transform.undistort = config.undistort;
+		// `crop_of` would fall back to the whole frame, at full cost
+		if (const bool is_out_of_frame = transform.roi and (*transform.roi & whole) != *transform.roi;
+			is_out_of_frame != sub->is_out_of_frame) {
+			sub->is_out_of_frame = is_out_of_frame;
+			if (is_out_of_frame) {
+				spdlog::error("region of subscription `{}` lies outside the {}x{} frame; stop publishing it", name, whole.width, whole.height);
+			} else {
+				spdlog::info("region of subscription `{}` fits the frame again", name);
+			}
+		}
+		if (sub->is_out_of_frame) {
+			continue;
+		}
+		if (const auto info = transform.info_of(frame);
+			memcmp(&info, &sub->info, sizeof(frame_info_t)) != 0 or settings != sub->settings) {
+			if (not sub->layout(info, settings)) {
+				continue;
+			}
+		}
+		const auto index = begin_write(*sub->header, sub->ring);
+		if (not index) {
+			continue;
+		}
+		// regions are small next to the frame; they stay in the cache for the subscriber
+		sub->stage.write(frame, transform, frame_data(*sub->header, sub->ring, *index), sub->header->row_stride,
+						 copy_options_t{
+							 .non_temporal_threshold = 0,
+							 .swap_rb                = config.channel_order == channel_order_t::rgb,
+						 });
+		auto sub_times         = times;
+		sub_times.published_ns = monotonic_ns();
+		end_write(*sub->header, sub->ring, *index, frame_count, sub_times);
+
+		const auto msg = sync_message_v2_t{
+			.sequence     = frame_count,
+			.info         = sub->info,
+			.capture_ns   = sub_times.capture_ns,
+			.grabbed_ns   = sub_times.grabbed_ns,
+			.published_ns = sub_times.published_ns,
+		};
+		try {
+			sock.send(zmq::buffer(sub->topic), zmq::send_flags::sndmore);
+			sock.send(zmq::buffer(reinterpret_cast<const uint8_t *>(&msg), sizeof(sync_message_v2_t)), zmq::send_flags::none);
+		} catch (const zmq::error_t &e) {
+			spdlog::error("failed to announce subscription `{}`: {}", name, e.what());
+		}
+	}
+}
+
+size_t roi_subscriptions::prune(uint64_t timeout_ns) {
+	std::lock_guard lock{mutex_};
+	const auto now = monotonic_ns();
+	return std::erase_if(subscriptions_, [&](const auto &entry) {
+		auto &sub = *entry.second;
+		if (sub.ring != nullptr) {
+			prune_consumers(*sub.header, sub.ring, timeout_ns);
+		}
+		if (app::count_live_consumers(*sub.header, timeout_ns) > 0) {
+			sub.live_ns = now;
+			return false;
+		}
+		if (now - sub.live_ns < timeout_ns) {
+			return false;
+		}
+		spdlog::info("subscription `{}` has no consumer; remove it", sub.name);
+		return true;
+	});
+}
+
+size_t roi_subscriptions::count_live_consumers(uint64_t timeout_ns) const {
+	std::lock_guard lock{mutex_};
+	size_t n = 0;
+	for (const auto &[name, sub] : subscriptions_) {
+		n += app::count_live_consumers(*sub->header, timeout_ns);
+	}
+	return n;
+}
+}
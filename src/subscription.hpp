@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <zmq.hpp>
+#include "config.hpp"
+#include "shm_layout.hpp"
+#include "transform.hpp"
+
+// Regions of the frames requested by consumers at runtime, each published
+// into a small shared memory object of its own.
+namespace app {
+constexpr auto ROI_TOPIC_MAGIC          = 0x7f;
+constexpr size_t MAX_SUBSCRIPTIONS      = 16;
+/// bounded like a consumer name; the name is part of the object name and the topic
+constexpr size_t SUBSCRIPTION_NAME_SIZE = CONSUMER_NAME_SIZE;
+
+/// object name of subscription `name` of the producer `base`
+inline std::string subscription_object_name(std::string_view base, std::string_view name) {
+	return std::format("{}_roi_{}", base, name);
+}
+
+/// socket serving the `memfd` of subscription `name` when the producer's is served on `fd_socket`
+inline std::string subscription_fd_socket(std::string_view fd_socket, std::string_view name) {
+	return std::format("{}_roi_{}", fd_socket, name);
+}
+
+/// ZMQ topic of subscription `name`; terminated, so that one name never matches another as a prefix
+inline std::string subscription_topic(std::string_view name) {
+	auto topic = std::string{static_cast<char>(ROI_TOPIC_MAGIC)};
+	topic.append(name);
+	topic.push_back('\0');
+	return topic;
+}
+
+struct subscription_info_t {
+	std::string name;
+	std::string object_name;
+	/// with `MemoryConfig::fd_socket`
+	std::optional<std::string> fd_socket;
+	transform_options_t transform;
+	/// geometry of the frames in its ring; zero until the first frame
+	frame_info_t info;
+	size_t live_consumers;
+};
+
+/// the subscriptions of one producer.
+///
+/// a subscription is a shared memory object with the same layout as the
+/// producer's (`shm_header_t` and a ring), holding the frames cropped and
+/// scaled as the subscriber asked, and announced with `sync_message_v2_t`
+/// on `subscription_topic`. Existing consumers attach to it like to the
+/// producer's object and never map the full frames.
+///
+/// `subscribe` and `unsubscribe` are called from the control thread, the rest
+/// from the capture thread.
+class roi_subscriptions {
+public:
+	/// @param base object name of the producer; subscription objects are named after it
+	/// @param memory of the producer; subscription objects are allocated the same way
+	roi_subscriptions(std::string base, MemoryConfig memory);
+	~roi_subscriptions();
+
+	roi_subscriptions(const roi_subscriptions &)            = delete;
+	roi_subscriptions &operator=(const roi_subscriptions &) = delete;
+
+	/// create subscription `name`, or change the region of an existing one.
+	/// the object exists with a valid header when it returns, so the subscriber can attach right away.
+	/// `transform.roi` is in the coordinates of the source frame and must lie within it
+	/// @return the object name, or why it was refused
+	std::expected<std::string, std::string> subscribe(std::string_view name, const transform_options_t &transform);
+
+	/// remove subscription `name` and unlink its object
+	/// @return false if there is no such subscription
+	bool unsubscribe(std::string_view name);
+
+	/// socket serving the object of subscription `name`; only with `MemoryConfig::fd_socket`
+	[[nodiscard]]
+	std::optional<std::string> fd_socket(std::string_view name) const;
+
+	[[nodiscard]]
+	std::vector<subscription_info_t> list(uint64_t timeout_ns) const;
+
+	/// write `frame` into every subscription, with the ring settings and channel order of `config`,
+	/// and announce it on `sock`. A subscription whose region no longer lies within `frame` is skipped
+	/// until it does again
+	void publish(const cv::Mat &frame, uint64_t frame_count, const frame_times_t &times, const Config &config, zmq::socket_t &sock);
+
+	/// prune the dead consumers of every subscription, and drop the subscriptions
+	/// without a live consumer for `timeout_ns`, e.g. because the subscriber crashed
+	/// @return the number of dropped subscriptions
+	size_t prune(uint64_t timeout_ns);
+
+	/// live consumers over all subscriptions
+	[[nodiscard]]
+	size_t count_live_consumers(uint64_t timeout_ns) const;
+
+private:
+	struct subscription_t;
+
+	std::string base_;
+	MemoryConfig memory_;
+	/// of the last published frame; empty before the first one
+	cv::Size source_size_;
+	mutable std::mutex mutex_;
+	std::unordered_map<std::string, std::unique_ptr<subscription_t>> subscriptions_;
+};
+}
@@ -0,0 +1,106 @@
+#include "synthetic.hpp"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include "shm_layout.hpp"
+
+namespace app {
+synthetic_capture::synthetic_capture(const synthetic_options_t &options) : options_(options) {
+	const auto width    = static_cast<int>(options.width);
+	const auto height   = static_cast<int>(options.height);
+	const auto channels = static_cast<int>(options.channels);
+	if (static_cast<size_t>(width) * channels * cv_depth_to_size(options.depth) < sizeof(synthetic_stamp_t)) {
+		throw invalid_argument(std::format("a synthetic frame needs rows of at least {} bytes for the stamp", sizeof(synthetic_stamp_t)));
+	}
+	// exact in every depth, so a consumer can rebuild the frame and compare it bit for bit
+	auto pattern = cv::Mat{height, width * channels, CV_32S};
+	for (int y = 0; y < height; ++y) {
+		auto *row = pattern.ptr<int32_t>(y);
+		for (int k = 0; k < width * channels; ++k) {
+			row[k] = (k + y) % 256;
+		}
+	}
+	pattern.convertTo(frame_, options.depth);
+	frame_   = frame_.reshape(channels);
+	next_at_ = std::chrono::steady_clock::now();
+}
+
+bool synthetic_capture::isOpened() const {
+	return not frame_.empty();
+}
+
+void synthetic_capture::release() {
+	frame_.release();
+}
+
+bool synthetic_capture::grab() {
+	if (frame_.empty()) {
+		return false;
+	}
+	if (options_.fps > 0) {
+		const auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / options_.fps));
+		std::this_thread::sleep_until(next_at_);
+		// a reader that fell behind gets the next frame on time rather than a burst of late ones
+		next_at_ = std::max(next_at_, std::chrono::steady_clock::now() - interval) + interval;
+	}
+	stamp_ = synthetic_stamp_t{
+		.magic        = SYNTHETIC_STAMP_MAGIC,
+		.reserved     = 0,
+		.sequence     = sequence_,
+		.timestamp_ns = monotonic_ns(),
+	};
+	std::memcpy(frame_.data, &stamp_, sizeof(stamp_));
+	sequence_ += 1;
+	return true;
+}
+
+bool synthetic_capture::retrieve(cv::OutputArray image, int) {
+	if (frame_.empty() or sequence_ == 0) {
+		image.release();
+		return false;
+	}
+	// a header of the buffer; copying would put a memcpy back into what this source leaves out
+	image.assign(frame_);
+	return true;
+}
+
+bool synthetic_capture::read(cv::OutputArray image) {
+	if (grab()) {
+		return retrieve(image);
+	}
+	image.release();
+	return false;
+}
+
+cv::VideoCapture &synthetic_capture::operator>>(cv::Mat &image) {
+	if (grab()) {
+		image = frame_;
+	} else {
+		image.release();
+	}
+	return *this;
+}
+
+bool synthetic_capture::set(int, double) {
+	// nothing to seek or configure; the `[synthetic]` table is reloaded instead
+	return false;
+}
+
+double synthetic_capture::get(int prop) const {
+	switch (prop) {
+	case cv::CAP_PROP_FRAME_WIDTH:
+		return options_.width;
+	case cv::CAP_PROP_FRAME_HEIGHT:
+		return options_.height;
+	case cv::CAP_PROP_FPS:
+		return options_.fps;
+	case cv::CAP_PROP_POS_FRAMES:
+		return static_cast<double>(sequence_);
+	case cv::CAP_PROP_POS_MSEC:
+		return static_cast<double>(stamp_.timestamp_ns) / static_cast<double>(NS_PER_MS);
+	default:
+		// in particular no `CAP_PROP_FRAME_COUNT`, so the source is live
+		return 0;
+	}
+}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+#include "common.hpp"
+
+// A built-in source of generated frames, to measure the shared memory path
+// without a capture backend and to check what consumers read bit for bit.
+namespace app {
+/// "CVSY"
+constexpr uint32_t SYNTHETIC_STAMP_MAGIC = 0x59535643;
+
+/// written over the start of the first row of every synthetic frame
+struct synthetic_stamp_t {
+	uint32_t magic;
+	uint32_t reserved;
+	/// frames generated before this one, including the ones grabbed and dropped while paused
+	uint64_t sequence;
+	/// `CLOCK_MONOTONIC` of the frame, in nanoseconds; also reported as `CAP_PROP_POS_MSEC`
+	uint64_t timestamp_ns;
+};
+static_assert(sizeof(synthetic_stamp_t) == 24);
+
+/// `[synthetic]` table
+struct synthetic_options_t {
+	uint32_t width    = 1920;
+	uint32_t height   = 1080;
+	/// one of `CV_8U`, `CV_16U` and `CV_32F`
+	int depth         = CV_8U;
+	uint32_t channels = 3;
+	/// frames per second, paced like a live camera; 0 generates them as fast as they are read
+	double fps        = 30;
+
+	bool operator==(const synthetic_options_t &) const = default;
+};
+
+/// a live source of `options.width` x `options.height` frames.
+///
+/// element `k` of row `y` is `(k + y) % 256`, in the depth of the frame, except
+/// for the `synthetic_stamp_t` at the start of the first row. the pattern is
+/// rendered once; a frame only rewrites the stamp, so reading one costs next to
+/// nothing and the rest of the pipeline is all that is measured.
+///
+/// `retrieve` hands out the internal buffer, like most backends do; the next
+/// `grab` changes the stamp of the frame returned before.
+class synthetic_capture final : public cv::VideoCapture {
+public:
+	/// @throws invalid_argument if the first row can't hold the stamp
+	explicit synthetic_capture(const synthetic_options_t &options);
+
+	bool isOpened() const override;
+	void release() override;
+	bool grab() override;
+	bool retrieve(cv::OutputArray image, int flag = 0) override;
+	bool read(cv::OutputArray image) override;
+	using cv::VideoCapture::operator>>;
+	cv::VideoCapture &operator>>(cv::Mat &image) override;
+	bool set(int prop, double value) override;
+	double get(int prop) const override;
+
+private:
+	synthetic_options_t options_;
+	cv::Mat frame_;
+	/// of the next frame; nothing to retrieve while 0
+	uint64_t sequence_ = 0;
+	synthetic_stamp_t stamp_{};
+	std::chrono::steady_clock::time_point next_at_;
+};
+}
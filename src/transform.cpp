@@ -0,0 +1,115 @@
+#include "transform.hpp"
+#include <algorithm>
+#include <opencv2/calib3d.hpp>
+
+namespace app {
+cv::Rect transform_options_t::crop_of(const cv::Mat &frame) const {
+	const auto whole = cv::Rect{0, 0, frame.cols, frame.rows};
+	if (not roi) {
+		return whole;
+	}
+	// a region outside the frame, e.g. after the source renegotiated a smaller resolution
+	const auto clipped = *roi & whole;
+	return clipped.empty() ? whole : clipped;
+}
+
+frame_info_t transform_options_t::info_of(const cv::Mat &frame) const {
+	const auto size = output_size ? *output_size : crop_of(frame).size();
+	return frame_info_t{
+		.width       = static_cast<uint32_t>(size.width),
+		.height      = static_cast<uint32_t>(size.height),
+		.channels    = static_cast<uint8_t>(frame.channels()),
+		.depth       = static_cast<uint8_t>(frame.depth()),
+		.buffer_size = static_cast<uint64_t>(size.area()) * frame.elemSize(),
+	};
+}
+
+void frame_transform::remap(const cv::Mat &src, const transform_options_t &transform, cv::Mat &out, const copy_options_t &options) {
+	const auto size = out.size();
+	if (map1_.empty() or map_source_ != src.size() or map_transform_ != transform) {
+		// the camera matrix of the undistorted frame is the source's; shifting and scaling
+		// it to the region makes the tables produce the output pixels directly
+		const auto &undistort       = *transform.undistort;
+		const auto [fx, fy, cx, cy] = undistort.intrinsics;
+
+		const auto crop          = transform.crop_of(src);
+		const auto sx            = static_cast<double>(size.width) / crop.width;
+		const auto sy            = static_cast<double>(size.height) / crop.height;
+		const auto camera        = cv::Matx33d{fx, 0, cx, 0, fy, cy, 0, 0, 1};
+		const auto output_camera = cv::Matx33d{fx * sx, 0, (cx - crop.x + 0.5) * sx - 0.5,
+											   0, fy * sy, (cy - crop.y + 0.5) * sy - 0.5,
+											   0, 0, 1};
+		const auto distortion    = cv::Mat{undistort.distortion};
+		if (undistort.fisheye) {
+			cv::fisheye::initUndistortRectifyMap(camera, distortion, cv::Matx33d::eye(), output_camera, size, CV_16SC2, map1_, map2_);
+		} else {
+			cv::initUndistortRectifyMap(camera, distortion, cv::noArray(), output_camera, size, CV_16SC2, map1_, map2_);
+		}
+		map_source_    = src.size();
+		map_transform_ = transform;
+	}
+	// `remap` has no area interpolation
+	const auto interpolation = transform.interpolation == cv::INTER_AREA ? cv::INTER_LINEAR : transform.interpolation;
+	const auto rows          = static_cast<size_t>(size.height);
+	// every output pixel only depends on its own table entries, so bands of rows are independent
+	const auto remap_rows = [&](size_t begin, size_t end) {
+		const auto b = static_cast<int>(begin), e = static_cast<int>(end);
+		auto band    = out.rowRange(b, e);
+		cv::remap(src, band, map1_.rowRange(b, e), map2_.rowRange(b, e), interpolation, cv::BORDER_CONSTANT);
+	};
+	const auto total = out.total() * out.elemSize();
+	const auto bands = options.pool != nullptr and total >= options.parallel_threshold ? std::min(options.pool->size(), rows) : 1;
+	if (bands <= 1) {
+		remap_rows(0, rows);
+		return;
+	}
+	options.pool->parallel_for(bands, [&](size_t band) {
+		remap_rows(band * rows / bands, (band + 1) * rows / bands);
+	});
+}
+
+void frame_transform::write(const cv::Mat &src, const transform_options_t &transform,
+							uint8_t *dst, size_t dst_stride, const copy_options_t &options) {
+	const auto crop = transform.crop_of(src);
+	if (transform.undistort) {
+		const auto size = transform.output_size.value_or(crop.size());
+		if (not options.swap_rb or src.channels() < 3) {
+			auto out = cv::Mat{size, src.type(), dst, dst_stride};
+			remap(src, transform, out, options);
+			return;
+		}
+		scaled_.create(size, src.type());
+		remap(src, transform, scaled_, options);
+		copy_frame(scaled_, dst, dst_stride, options);
+		return;
+	}
+	const auto view = transform.roi ? src(crop) : src;
+	if (not transform.output_size or *transform.output_size == crop.size()) {
+		copy_frame(view, dst, dst_stride, options);
+		return;
+	}
+	if (not options.swap_rb or src.channels() < 3) {
+		// `resize` keeps the buffer of a destination that already has the right size and type
+		auto out = cv::Mat{*transform.output_size, src.type(), dst, dst_stride};
+		cv::resize(view, out, out.size(), 0, 0, transform.interpolation);
+		return;
+	}
+	cv::resize(view, scaled_, *transform.output_size, 0, 0, transform.interpolation);
+	copy_frame(scaled_, dst, dst_stride, options);
+}
+
+const cv::Mat &frame_transform::apply(const cv::Mat &src, const transform_options_t &transform) {
+	const auto crop = transform.crop_of(src);
+	if (transform.undistort) {
+		scaled_.create(transform.output_size.value_or(crop.size()), src.type());
+		remap(src, transform, scaled_, copy_options_t{});
+		return scaled_;
+	}
+	view_ = transform.roi ? src(crop) : src;
+	if (not transform.output_size or *transform.output_size == crop.size()) {
+		return view_;
+	}
+	cv::resize(view_, scaled_, *transform.output_size, 0, 0, transform.interpolation);
+	return scaled_;
+}
+}
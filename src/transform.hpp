@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <opencv2/imgproc.hpp>
+#include "common.hpp"
+#include "copy.hpp"
+
+// Undistortion, cropping and scaling of the source frames, done while writing them into the ring.
+namespace app {
+static const std::unordered_map<std::string, int> interpolation_map = {
+	{"nearest", cv::INTER_NEAREST},
+	{"linear", cv::INTER_LINEAR},
+	{"cubic", cv::INTER_CUBIC},
+	{"area", cv::INTER_AREA},
+	{"lanczos4", cv::INTER_LANCZOS4},
+};
+
+inline std::string_view interpolation_to_string(const int interpolation) {
+	for (const auto &[key, value] : interpolation_map) {
+		if (value == interpolation) {
+			return key;
+		}
+	}
+	throw invalid_argument(std::format("invalid interpolation value: `{}`", interpolation));
+}
+
+inline int interpolation_from_string(const std::string_view s) {
+	for (const auto &[key, value] : interpolation_map) {
+		if (key == s) {
+			return value;
+		}
+	}
+	throw invalid_argument(std::format("invalid interpolation key: `{}`", s));
+}
+
+/// lens model of the source, to undistort the frames with
+struct undistort_options_t {
+	/// `fx`, `fy`, `cx` and `cy` of the camera matrix, in pixels of the source frames
+	std::array<double, 4> intrinsics;
+	/// `k1, k2, p1, p2[, k3[, k4, k5, k6]]`, or `k1, k2, k3, k4` with `fisheye`
+	std::vector<double> distortion;
+	/// the equidistant model of `cv::fisheye` instead of the pinhole one
+	bool fisheye = false;
+
+	bool operator==(const undistort_options_t &) const = default;
+};
+
+struct transform_options_t {
+	/// undistort the frames first; `roi` and `output_size` then apply to the undistorted frame,
+	/// which keeps the size and camera matrix of the source
+	std::optional<undistort_options_t> undistort;
+	/// region of the source frame to publish; the whole frame if empty.
+	/// clipped to the frame
+	std::optional<cv::Rect> roi;
+	/// scale the region to this size; unscaled if empty
+	std::optional<cv::Size> output_size;
+	/// `cv::InterpolationFlags` used for scaling
+	int interpolation = cv::INTER_LINEAR;
+
+	/// the region of `frame` that is published
+	[[nodiscard]]
+	cv::Rect crop_of(const cv::Mat &frame) const;
+
+	/// geometry of `frame` once cropped and scaled; what the ring is laid out for
+	[[nodiscard]]
+	frame_info_t info_of(const cv::Mat &frame) const;
+
+	[[nodiscard]]
+	bool is_identity() const {
+		return not undistort and not roi and not output_size;
+	}
+
+	bool operator==(const transform_options_t &) const = default;
+};
+
+/// undistorts, crops and scales frames as part of writing them, see `write`.
+///
+/// a crop is only a view of the source, so the copy reads the region's rows and nothing else.
+/// scaling writes the destination straight from the source, the rows split across
+/// OpenCV's threads. undistortion folds the crop and scale into fixed-point `remap`
+/// tables, computed once per source size and options, and remaps in row bands on the
+/// copy threads. only a frame that is scaled or undistorted and also needs its channels
+/// swapped goes through an intermediate buffer, at the output size.
+class frame_transform {
+public:
+	/// write `src`, cropped and scaled as in `transform`, to `dst` with rows `dst_stride` apart.
+	/// unscaled frames go through `copy_frame` with `options`
+	void write(const cv::Mat &src, const transform_options_t &transform,
+			   uint8_t *dst, size_t dst_stride, const copy_options_t &options);
+
+	/// `src` cropped and scaled, for the stages that take a frame rather than write one;
+	/// valid until the next call
+	const cv::Mat &apply(const cv::Mat &src, const transform_options_t &transform);
+
+private:
+	/// remap `src` into `out` (of the output size) in row bands on `pool`
+	void remap(const cv::Mat &src, const transform_options_t &transform, cv::Mat &out, const copy_options_t &options);
+
+	cv::Mat view_;
+	cv::Mat scaled_;
+	/// `CV_16SC2` coordinates and `CV_16UC1` interpolation weights, for `map_source_` and `map_transform_`
+	cv::Mat map1_;
+	cv::Mat map2_;
+	cv::Size map_source_;
+	transform_options_t map_transform_;
+};
+}
@@ -0,0 +1,86 @@
+#include "worker_pool.hpp"
+#include <cerrno>
+#include <cstring>
+#include <spdlog/spdlog.h>
+#include "numa.hpp"
+
+namespace app {
+worker_pool::worker_pool(size_t thread_count, const std::vector<uint32_t> &cpus) {
+	const auto n = thread_count > 1 ? thread_count - 1 : 0;
+	threads_.reserve(n);
+	for (size_t i = 0; i < n; ++i) {
+		if (cpus.empty()) {
+			threads_.emplace_back([this] { worker_loop(); });
+			continue;
+		}
+		threads_.emplace_back([this, cpu = cpus[i % cpus.size()]] {
+			if (not set_cpu_affinity({cpu})) {
+				spdlog::warn("failed to pin worker thread to CPU {}; {} ({})", cpu, strerror(errno), errno);
+			}
+			worker_loop();
+		});
+	}
+}
+
+worker_pool::~worker_pool() {
+	{
+		std::lock_guard lock{mutex_};
+		stopping_ = true;
+	}
+	wake_cv_.notify_all();
+	for (auto &t : threads_) {
+		t.join();
+	}
+}
+
+void worker_pool::parallel_for(size_t task_count, const std::function<void(size_t)> &fn) {
+	if (threads_.empty() || task_count <= 1) {
+		for (size_t i = 0; i < task_count; ++i) {
+			fn(i);
+		}
+		return;
+	}
+	{
+		std::lock_guard lock{mutex_};
+		task_       = &fn;
+		task_count_ = task_count;
+		next_task_.store(0, std::memory_order::relaxed);
+		active_ = threads_.size();
+		generation_ += 1;
+	}
+	wake_cv_.notify_all();
+	run_tasks();
+	std::unique_lock lock{mutex_};
+	done_cv_.wait(lock, [this] { return active_ == 0; });
+	task_ = nullptr;
+}
+
+void worker_pool::run_tasks() {
+	size_t i;
+	while ((i = next_task_.fetch_add(1, std::memory_order::relaxed)) < task_count_) {
+		(*task_)(i);
+	}
+}
+
+void worker_pool::worker_loop() {
+	uint64_t seen = 0;
+	while (true) {
+		{
+			std::unique_lock lock{mutex_};
+			wake_cv_.wait(lock, [this, seen] { return stopping_ || generation_ != seen; });
+			if (stopping_) {
+				return;
+			}
+			seen = generation_;
+		}
+		run_tasks();
+		{
+			std::lock_guard lock{mutex_};
+			active_ -= 1;
+			if (active_ == 0) {
+				done_cv_.notify_one();
+			}
+		}
+	}
+}
+}
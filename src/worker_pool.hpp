@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace app {
+/// a small set of persistent threads for data-parallel work on a frame.
+///
+/// threads are created once and parked on a condition variable between jobs,
+/// so there is no per-frame thread creation. the calling thread takes part
+/// in every job as well.
+class worker_pool {
+public:
+	/// @param thread_count total parallelism, including the calling thread
+	/// @param cpus pin worker `i` to `cpus[i % cpus.size()]`; unpinned if empty
+	explicit worker_pool(size_t thread_count, const std::vector<uint32_t> &cpus = {});
+	~worker_pool();
+
+	worker_pool(const worker_pool &)            = delete;
+	worker_pool &operator=(const worker_pool &) = delete;
+
+	/// run `fn(index)` for every `index` in `[0, task_count)` and block until all of them returned
+	void parallel_for(size_t task_count, const std::function<void(size_t)> &fn);
+
+	/// total parallelism, including the calling thread
+	[[nodiscard]]
+	size_t size() const {
+		return threads_.size() + 1;
+	}
+
+private:
+	void worker_loop();
+	void run_tasks();
+
+	std::vector<std::thread> threads_;
+	std::mutex mutex_;
+	std::condition_variable wake_cv_;
+	std::condition_variable done_cv_;
+	const std::function<void(size_t)> *task_ = nullptr;
+	size_t task_count_                       = 0;
+	std::atomic<size_t> next_task_{0};
+	/// workers that have not finished the current job yet
+	size_t active_       = 0;
+	uint64_t generation_ = 0;
+	bool stopping_       = false;
+};
+}
@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "dispatch.hpp"
+
+using namespace app;
+
+namespace {
+/// the levels this CPU runs, `scalar` included
+std::vector<simd_level_t> supported_levels() {
+	std::vector<simd_level_t> ret;
+	for (auto level = simd_level_t::scalar; level <= detect_simd_level();
+		 level      = static_cast<simd_level_t>(static_cast<int>(level) + 1)) {
+		ret.push_back(level);
+	}
+	return ret;
+}
+
+std::vector<uint8_t> random_bytes(size_t n, uint32_t seed) {
+	std::mt19937 gen{seed};
+	std::vector<uint8_t> ret(n);
+	for (auto &b : ret) {
+		b = static_cast<uint8_t>(gen());
+	}
+	return ret;
+}
+
+/// odd and unaligned lengths around every vector width, and a larger one
+const size_t LENGTHS[] = {0, 1, 2, 3, 5, 7, 15, 17, 31, 33, 63, 65, 127, 129, 1023, 4099};
+/// start of the data within its buffer, so the kernels see unaligned pointers too
+const size_t OFFSETS[] = {0, 1, 3};
+
+class KernelTest : public testing::TestWithParam<simd_level_t> {};
+
+std::string level_name(const testing::TestParamInfo<simd_level_t> &info) {
+	auto name = std::string{simd_level_to_string(info.param)};
+	std::erase(name, '.');
+	return name;
+}
+}
+
+TEST_P(KernelTest, XorBytesMatchesScalar) {
+	const auto &scalar = kernels_for(simd_level_t::scalar);
+	const auto &k      = kernels_for(GetParam());
+	for (const auto n : LENGTHS) {
+		for (const auto offset : OFFSETS) {
+			// one byte past the end catches overruns, and keeps empty inputs off null pointers
+			const auto a = random_bytes(n + offset + 1, n);
+			const auto b = random_bytes(n + offset + 1, n + 1);
+			std::vector<uint8_t> expected(n + offset + 1, 0xaa), actual(expected);
+			scalar.xor_bytes(expected.data() + offset, a.data() + offset, b.data() + offset, n);
+			k.xor_bytes(actual.data() + offset, a.data() + offset, b.data() + offset, n);
+			EXPECT_EQ(actual, expected) << "n = " << n << ", offset = " << offset;
+			for (size_t i = 0; i < n; ++i) {
+				ASSERT_EQ(expected[offset + i], a[offset + i] ^ b[offset + i]);
+			}
+			// in place, as the delta encoder calls it
+			auto in_place = a;
+			k.xor_bytes(in_place.data() + offset, in_place.data() + offset, b.data() + offset, n);
+			EXPECT_TRUE(std::equal(expected.begin() + offset, expected.end() - 1, in_place.begin() + offset));
+			EXPECT_EQ(actual.back(), 0xaa);
+		}
+	}
+}
+
+TEST_P(KernelTest, SwapRb8uc3MatchesScalar) {
+	const auto &scalar = kernels_for(simd_level_t::scalar);
+	const auto &k      = kernels_for(GetParam());
+	for (const auto pixels : LENGTHS) {
+		for (const auto offset : OFFSETS) {
+			const auto src = random_bytes(pixels * 3 + offset + 1, pixels);
+			std::vector<uint8_t> expected(pixels * 3 + offset + 1, 0xaa), actual(expected);
+			scalar.swap_rb_8uc3(expected.data() + offset, src.data() + offset, pixels);
+			k.swap_rb_8uc3(actual.data() + offset, src.data() + offset, pixels);
+			EXPECT_EQ(actual, expected) << "pixels = " << pixels << ", offset = " << offset;
+			for (size_t i = 0; i < pixels; ++i) {
+				const auto *s = src.data() + offset + i * 3;
+				const auto *d = expected.data() + offset + i * 3;
+				ASSERT_EQ(d[0], s[2]);
+				ASSERT_EQ(d[1], s[1]);
+				ASSERT_EQ(d[2], s[0]);
+			}
+			EXPECT_EQ(actual.back(), 0xaa);
+		}
+	}
+}
+
+TEST_P(KernelTest, SwapRb8uc4MatchesScalar) {
+	const auto &scalar = kernels_for(simd_level_t::scalar);
+	const auto &k      = kernels_for(GetParam());
+	for (const auto pixels : LENGTHS) {
+		for (const auto offset : OFFSETS) {
+			const auto src = random_bytes(pixels * 4 + offset + 1, pixels);
+			std::vector<uint8_t> expected(pixels * 4 + offset + 1, 0xaa), actual(expected);
+			scalar.swap_rb_8uc4(expected.data() + offset, src.data() + offset, pixels);
+			k.swap_rb_8uc4(actual.data() + offset, src.data() + offset, pixels);
+			EXPECT_EQ(actual, expected) << "pixels = " << pixels << ", offset = " << offset;
+			for (size_t i = 0; i < pixels; ++i) {
+				const auto *s = src.data() + offset + i * 4;
+				const auto *d = expected.data() + offset + i * 4;
+				ASSERT_EQ(d[0], s[2]);
+				ASSERT_EQ(d[1], s[1]);
+				ASSERT_EQ(d[2], s[0]);
+				ASSERT_EQ(d[3], s[3]);
+			}
+			EXPECT_EQ(actual.back(), 0xaa);
+		}
+	}
+}
+
+TEST_P(KernelTest, StreamCopyMatchesMemcpy) {
+	const auto &k = kernels_for(GetParam());
+	for (const auto n : LENGTHS) {
+		for (const auto offset : OFFSETS) {
+			const auto src = random_bytes(n + offset + 1, n);
+			std::vector<uint8_t> dst(n + offset + 1, 0xaa);
+			k.stream_copy(dst.data() + offset, src.data() + offset, n);
+			k.fence();
+			EXPECT_TRUE(std::equal(src.begin() + offset, src.end() - 1, dst.begin() + offset))
+				<< "n = " << n << ", offset = " << offset;
+			EXPECT_EQ(dst.back(), 0xaa);
+		}
+	}
+}
+
+INSTANTIATE_TEST_SUITE_P(Levels, KernelTest, testing::ValuesIn(supported_levels()), level_name);
+
+TEST(Dispatch, KernelsReportTheirLevel) {
+	for (const auto level : supported_levels()) {
+		EXPECT_EQ(kernels_for(level).level, level);
+	}
+}
+
+TEST(Dispatch, BindFallsBackToDetected) {
+	EXPECT_EQ(bind_kernels(simd_level_t::scalar), simd_level_t::scalar);
+	EXPECT_EQ(kernels().level, simd_level_t::scalar);
+	EXPECT_EQ(bind_kernels(simd_level_t::avx512), std::min(simd_level_t::avx512, detect_simd_level()));
+	EXPECT_EQ(bind_kernels(), detect_simd_level());
+}
+
+TEST(Dispatch, LevelNamesRoundTrip) {
+	for (const auto &[name, level] : simd_level_map) {
+		EXPECT_EQ(simd_level_from_string(name), level);
+		EXPECT_EQ(simd_level_to_string(level), name);
+	}
+	EXPECT_THROW(simd_level_from_string("neon"), invalid_argument);
+}
@@ -0,0 +1,430 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include "shm_layout.hpp"
+
+using namespace app;
+
+namespace {
+/// above any `pid_max`, so no process has it
+constexpr uint32_t OTHER_PID = 0x7ffffff0;
+/// room for every ring of these tests, so one can be laid out again with more slots
+constexpr size_t RING_SIZE   = 1 << 20;
+
+/// a header and a ring as the producer sets them up in memory
+struct ring_fixture_t {
+	shm_header_t *header;
+	ring_geometry_t geometry;
+	void *ring;
+
+	ring_fixture_t(uint32_t slot_count, uint32_t max_pinned)
+		: header(new (std::aligned_alloc(64, sizeof(shm_header_t))) shm_header_t{}),
+		  geometry(make_ring_geometry(slot_count, max_pinned, 30, 4, 64, 4096)),
+		  ring(std::aligned_alloc(4096, RING_SIZE)) {
+		header->version       = SHM_VERSION;
+		header->max_consumers = MAX_CONSUMERS;
+		for (auto &slot : header->consumers) {
+			slot.heartbeat_ns.store(UINT64_MAX, std::memory_order::relaxed);
+		}
+		init_ring(*header, ring, geometry, shape());
+	}
+
+	~ring_fixture_t() {
+		header->~shm_header_t();
+		std::free(header);
+		std::free(ring);
+	}
+
+	static frame_shape_t shape() {
+		return frame_shape_t{
+			.width         = 10,
+			.height        = 4,
+			.channels      = 3,
+			.depth         = 0,
+			.channel_order = 0,
+			.reserved      = 0,
+			.reserved2     = 0,
+			.buffer_size   = 120,
+		};
+	}
+
+	void publish(uint64_t frame_count) {
+		const auto index = begin_write(*header, ring);
+		ASSERT_TRUE(index.has_value());
+		end_write(*header, ring, *index, frame_count, frame_times_t{1, 2, 3});
+	}
+};
+}
+
+TEST(RingGeometry, AlignsRowsAndFrames) {
+	const auto g = make_ring_geometry(3, 2, 1920 * 3, 1080, 64, 4096, 100);
+	EXPECT_EQ(g.slot_count, 3U);
+	EXPECT_EQ(g.max_pinned, 2U);
+	EXPECT_EQ(g.row_stride, 5760U);
+	EXPECT_EQ(g.side_data_offset, 3 * sizeof(frame_slot_t));
+	// rounded up to a cache line
+	EXPECT_EQ(g.side_data_capacity, 128U);
+	EXPECT_EQ(g.frames_offset % 4096, 0U);
+	EXPECT_GE(g.frames_offset, g.side_data_offset + 3 * g.side_data_capacity);
+	EXPECT_EQ(g.frame_stride % 4096, 0U);
+	EXPECT_GE(g.frame_stride, uint64_t{5760} * 1080);
+	EXPECT_EQ(g.size(), g.frames_offset + 3 * g.frame_stride);
+}
+
+TEST(RingGeometry, PadsRows) {
+	const auto g = make_ring_geometry(1, 0, 30, 4, 64, 64);
+	EXPECT_EQ(g.row_stride, 64U);
+	EXPECT_EQ(g.side_data_capacity, 0U);
+	EXPECT_EQ(g.frames_offset, sizeof(frame_slot_t));
+	EXPECT_EQ(g.frame_stride, 256U);
+}
+
+TEST(RingGeometry, DataOffsetIsPageAligned) {
+	EXPECT_EQ(shm_data_offset(4096) % 4096, 0U);
+	EXPECT_GE(shm_data_offset(4096), sizeof(shm_header_t));
+	EXPECT_EQ(shm_data_offset(2 << 20), size_t{2} << 20);
+}
+
+TEST(InitRing, WritesLayoutAndBumpsGeneration) {
+	ring_fixture_t f{4, 2};
+	auto &h = *f.header;
+	EXPECT_EQ(h.generation.load(), 2U);
+	EXPECT_EQ(h.slot_count, 4U);
+	EXPECT_EQ(h.max_pinned, 2U);
+	EXPECT_EQ(h.row_stride, f.geometry.row_stride);
+	EXPECT_EQ(h.frames_offset, f.geometry.frames_offset);
+	EXPECT_EQ(h.frame_stride, f.geometry.frame_stride);
+	EXPECT_EQ(h.shape.buffer_size, 120U);
+	EXPECT_EQ(h.latest_frame_count.load(), 0U);
+	EXPECT_EQ(reinterpret_cast<uintptr_t>(frame_data(h, f.ring, 1)) % 4096, 0U);
+	for (uint32_t i = 0; i < 4; ++i) {
+		EXPECT_EQ(ring_slot(f.ring, i).seq.load(), 0U);
+		EXPECT_EQ(ring_slot(f.ring, i).pins.load(), 0U);
+	}
+
+	f.publish(7);
+	init_ring(h, f.ring, f.geometry, ring_fixture_t::shape());
+	EXPECT_EQ(h.generation.load(), 4U);
+	EXPECT_EQ(h.latest_frame_count.load(), 0U);
+	EXPECT_EQ(h.latest_slot.load(), 0U);
+}
+
+TEST(Ring, PublishesWithEvenSequence) {
+	ring_fixture_t f{3, 0};
+	f.publish(0);
+	const auto latest = f.header->latest_slot.load();
+	EXPECT_EQ(f.header->latest_frame_count.load(), 1U);
+	EXPECT_EQ(ring_slot(f.ring, latest).seq.load(), 2U);
+	EXPECT_EQ(ring_slot(f.ring, latest).frame_count.load(), 0U);
+	EXPECT_EQ(ring_slot(f.ring, latest).published_ns.load(), 3U);
+
+	// never hands out the latest slot
+	for (uint64_t n = 1; n < 10; ++n) {
+		const auto previous = f.header->latest_slot.load();
+		const auto index    = begin_write(*f.header, f.ring);
+		ASSERT_TRUE(index.has_value());
+		EXPECT_NE(*index, previous);
+		EXPECT_EQ(ring_slot(f.ring, *index).seq.load() % 2, 1U);
+		end_write(*f.header, f.ring, *index, n, frame_times_t{});
+	}
+}
+
+TEST(Pin, PinnedSlotIsNeverWritten) {
+	ring_fixture_t f{3, 2};
+	auto *consumer = register_consumer(*f.header, getpid(), "test");
+	ASSERT_NE(consumer, nullptr);
+	f.publish(0);
+	const auto pinned = pin_latest(*f.header, f.ring, *consumer);
+	ASSERT_TRUE(pinned.has_value());
+	EXPECT_EQ(f.header->pinned_total.load(), 1U);
+	EXPECT_EQ(ring_slot(f.ring, *pinned).pins.load(), 1U);
+	// already held by this consumer
+	EXPECT_FALSE(pin_latest(*f.header, f.ring, *consumer).has_value());
+
+	for (uint64_t n = 1; n < 10; ++n) {
+		const auto index = begin_write(*f.header, f.ring);
+		ASSERT_TRUE(index.has_value());
+		EXPECT_NE(*index, *pinned);
+		end_write(*f.header, f.ring, *index, n, frame_times_t{});
+	}
+	EXPECT_EQ(ring_slot(f.ring, *pinned).frame_count.load(), 0U);
+	// a refused claim leaves the sequence even
+	EXPECT_EQ(ring_slot(f.ring, *pinned).seq.load() % 2, 0U);
+
+	unpin_slot(*f.header, f.ring, *consumer, *pinned);
+	EXPECT_EQ(f.header->pinned_total.load(), 0U);
+	EXPECT_EQ(ring_slot(f.ring, *pinned).pins.load(), 0U);
+	EXPECT_EQ(consumer->pinned_mask.load(), 0U);
+}
+
+TEST(Pin, AllCandidatesPinned) {
+	ring_fixture_t f{2, 2};
+	auto *consumer = register_consumer(*f.header, getpid(), "test");
+	ASSERT_NE(consumer, nullptr);
+	f.publish(0);
+	const auto first = pin_latest(*f.header, f.ring, *consumer);
+	ASSERT_TRUE(first.has_value());
+	f.publish(1);
+	const auto second = pin_latest(*f.header, f.ring, *consumer);
+	ASSERT_TRUE(second.has_value());
+	EXPECT_NE(*first, *second);
+	EXPECT_FALSE(begin_write(*f.header, f.ring).has_value());
+}
+
+TEST(Pin, RespectsMaxPinned) {
+	ring_fixture_t f{4, 1};
+	auto *a = register_consumer(*f.header, getpid(), "a");
+	auto *b = register_consumer(*f.header, getpid(), "b");
+	ASSERT_NE(a, nullptr);
+	ASSERT_NE(b, nullptr);
+	f.publish(0);
+	EXPECT_TRUE(pin_latest(*f.header, f.ring, *a).has_value());
+	EXPECT_FALSE(pin_latest(*f.header, f.ring, *b).has_value());
+	EXPECT_EQ(f.header->pinned_total.load(), 1U);
+}
+
+TEST(Pin, DisabledWithoutMaxPinned) {
+	ring_fixture_t f{3, 0};
+	auto *consumer = register_consumer(*f.header, getpid(), "test");
+	ASSERT_NE(consumer, nullptr);
+	f.publish(0);
+	EXPECT_FALSE(pin_latest(*f.header, f.ring, *consumer).has_value());
+	EXPECT_EQ(f.header->pinned_total.load(), 0U);
+}
+
+TEST(Pin, RelayoutDropsLeases) {
+	ring_fixture_t f{3, 2};
+	auto *consumer = register_consumer(*f.header, getpid(), "test");
+	ASSERT_NE(consumer, nullptr);
+	f.publish(0);
+	const auto pinned = pin_latest(*f.header, f.ring, *consumer);
+	ASSERT_TRUE(pinned.has_value());
+
+	init_ring(*f.header, f.ring, f.geometry, ring_fixture_t::shape());
+	EXPECT_EQ(f.header->pinned_total.load(), 0U);
+	EXPECT_EQ(ring_slot(f.ring, *pinned).pins.load(), 0U);
+	EXPECT_EQ(consumer->pinned_mask.load(), 0U);
+	// the lease is gone already; a late unpin must not drive the counters below zero
+	unpin_slot(*f.header, f.ring, *consumer, *pinned);
+	EXPECT_EQ(f.header->pinned_total.load(), 0U);
+	EXPECT_EQ(ring_slot(f.ring, *pinned).pins.load(), 0U);
+}
+
+TEST(Pin, RelayoutBetweenPinAndMask) {
+	ring_fixture_t f{3, 2};
+	f.publish(0);
+	const auto index = f.header->latest_slot.load();
+	// `pin_latest` has counted its pin but not set its mask bit yet...
+	f.header->pinned_total.fetch_add(1);
+	ring_slot(f.ring, index).pins.fetch_add(1);
+	init_ring(*f.header, f.ring, f.geometry, ring_fixture_t::shape());
+	// ...then sees the new generation and takes its own pin back
+	ring_slot(f.ring, index).pins.fetch_sub(1);
+	f.header->pinned_total.fetch_sub(1);
+	EXPECT_EQ(f.header->pinned_total.load(), 0U);
+	EXPECT_EQ(ring_slot(f.ring, index).pins.load(), 0U);
+	for (uint64_t n = 0; n < 6; ++n) {
+		f.publish(n);
+	}
+}
+
+TEST(Pin, ConcurrentRelayoutKeepsCountersBalanced) {
+	ring_fixture_t f{3, 2};
+	auto *consumer = register_consumer(*f.header, getpid(), "test");
+	ASSERT_NE(consumer, nullptr);
+	std::atomic<bool> done{false};
+	std::thread reader{[&] {
+		while (not done.load(std::memory_order::relaxed)) {
+			if (const auto index = pin_latest(*f.header, f.ring, *consumer)) {
+				unpin_slot(*f.header, f.ring, *consumer, *index);
+			}
+		}
+	}};
+	for (uint64_t n = 0; n < 100'000; ++n) {
+		if (n % 16 == 0) {
+			init_ring(*f.header, f.ring, f.geometry, ring_fixture_t::shape());
+		}
+		if (const auto index = begin_write(*f.header, f.ring)) {
+			end_write(*f.header, f.ring, *index, n, frame_times_t{});
+		}
+	}
+	done.store(true, std::memory_order::relaxed);
+	reader.join();
+	EXPECT_EQ(f.header->pinned_total.load(), 0U);
+	EXPECT_EQ(consumer->pinned_mask.load(), 0U);
+	for (uint32_t i = 0; i < 3; ++i) {
+		EXPECT_EQ(ring_slot(f.ring, i).pins.load(), 0U) << "slot " << i;
+	}
+}
+
+TEST(Pin, RefusedWhileRelayoutInProgress) {
+	ring_fixture_t f{3, 2};
+	auto *consumer = register_consumer(*f.header, getpid(), "test");
+	ASSERT_NE(consumer, nullptr);
+	f.publish(0);
+	// as `init_ring` leaves it between its two bumps
+	f.header->generation.fetch_add(1);
+	EXPECT_FALSE(pin_latest(*f.header, f.ring, *consumer).has_value());
+	EXPECT_EQ(f.header->pinned_total.load(), 0U);
+	EXPECT_EQ(consumer->pinned_mask.load(), 0U);
+	for (uint32_t i = 0; i < 3; ++i) {
+		EXPECT_EQ(ring_slot(f.ring, i).pins.load(), 0U);
+	}
+}
+
+TEST(Pin, RefusedOnSlotBeingWritten) {
+	ring_fixture_t f{1, 1};
+	auto *consumer = register_consumer(*f.header, getpid(), "test");
+	ASSERT_NE(consumer, nullptr);
+	// the only slot is both latest and being written
+	const auto index = begin_write(*f.header, f.ring);
+	ASSERT_TRUE(index.has_value());
+	EXPECT_FALSE(pin_latest(*f.header, f.ring, *consumer).has_value());
+	EXPECT_EQ(f.header->pinned_total.load(), 0U);
+	EXPECT_EQ(ring_slot(f.ring, *index).pins.load(), 0U);
+}
+
+TEST(Pin, GrowingRingResetsNewSlotsOnly) {
+	ring_fixture_t f{2, 2};
+	auto *consumer = register_consumer(*f.header, getpid(), "test");
+	ASSERT_NE(consumer, nullptr);
+	f.publish(0);
+	f.publish(1);
+	const auto seq = ring_slot(f.ring, 0).seq.load();
+	const auto grown = make_ring_geometry(3, 2, 30, 4, 64, 4096);
+	ASSERT_LE(grown.size(), RING_SIZE);
+	init_ring(*f.header, f.ring, grown, ring_fixture_t::shape());
+	// a reader of the old layout must still see the slot change
+	EXPECT_EQ(ring_slot(f.ring, 0).seq.load(), seq);
+	EXPECT_EQ(ring_slot(f.ring, 2).seq.load(), 0U);
+	EXPECT_EQ(ring_slot(f.ring, 2).pins.load(), 0U);
+	EXPECT_EQ(f.header->slot_count, 3U);
+}
+
+TEST(Consumers, RegisterHeartbeatUnregister) {
+	ring_fixture_t f{2, 1};
+	const auto pid = static_cast<uint32_t>(getpid());
+	auto *slot     = register_consumer(*f.header, pid, "a rather long consumer name");
+	ASSERT_NE(slot, nullptr);
+	EXPECT_EQ(slot->pid.load(), pid);
+	EXPECT_EQ(slot->pid_ns.load(), pid_namespace());
+	EXPECT_NE(slot->heartbeat_ns.load(), UINT64_MAX);
+	EXPECT_TRUE(heartbeat(*slot, pid, 42));
+	EXPECT_EQ(slot->last_frame_count.load(), 42U);
+	EXPECT_EQ(count_live_consumers(*f.header, 1'000'000'000), 1U);
+
+	const auto consumers = list_consumers(*f.header);
+	ASSERT_EQ(consumers.size(), 1U);
+	EXPECT_EQ(consumers[0].pid, pid);
+	EXPECT_EQ(consumers[0].name, std::string("a rather long consumer name").substr(0, CONSUMER_NAME_SIZE));
+	EXPECT_EQ(consumers[0].last_frame_count, 42U);
+
+	unregister_consumer(*slot);
+	EXPECT_EQ(slot->pid.load(), 0U);
+	EXPECT_EQ(slot->heartbeat_ns.load(), UINT64_MAX);
+	EXPECT_TRUE(list_consumers(*f.header).empty());
+	// a free slot is never pruned
+	EXPECT_EQ(prune_consumers(*f.header, f.ring, 0), 0U);
+}
+
+TEST(Consumers, RegistryFull) {
+	ring_fixture_t f{2, 1};
+	for (size_t i = 0; i < MAX_CONSUMERS; ++i) {
+		ASSERT_NE(register_consumer(*f.header, getpid(), "c"), nullptr);
+	}
+	EXPECT_EQ(register_consumer(*f.header, getpid(), "c"), nullptr);
+}
+
+TEST(Consumers, PruneStaleReleasesPinsAndFailsHeartbeat) {
+	ring_fixture_t f{3, 2};
+	const auto pid = static_cast<uint32_t>(getpid());
+	auto *slot     = register_consumer(*f.header, pid, "stale");
+	ASSERT_NE(slot, nullptr);
+	f.publish(0);
+	ASSERT_TRUE(pin_latest(*f.header, f.ring, *slot).has_value());
+	slot->heartbeat_ns.store(monotonic_ns() - 10'000'000'000);
+	// alive by its heartbeat
+	EXPECT_EQ(prune_consumers(*f.header, f.ring, 60'000'000'000), 0U);
+
+	EXPECT_EQ(prune_consumers(*f.header, f.ring, 1'000'000'000), 1U);
+	EXPECT_EQ(slot->pid.load(), 0U);
+	EXPECT_EQ(slot->pid_ns.load(), 0U);
+	EXPECT_EQ(slot->heartbeat_ns.load(), UINT64_MAX);
+	EXPECT_EQ(slot->pinned_mask.load(), 0U);
+	EXPECT_EQ(f.header->pinned_total.load(), 0U);
+
+	// the consumer learns about it from its next heartbeat, which leaves the slot alone
+	EXPECT_FALSE(heartbeat(*slot, pid, 9));
+	EXPECT_EQ(slot->heartbeat_ns.load(), UINT64_MAX);
+	EXPECT_EQ(slot->last_frame_count.load(), 0U);
+	// and registers again
+	auto *again = register_consumer(*f.header, pid, "stale");
+	ASSERT_NE(again, nullptr);
+	EXPECT_TRUE(heartbeat(*again, pid, 9));
+}
+
+TEST(Consumers, HeartbeatFailsOnReusedSlot) {
+	ring_fixture_t f{2, 1};
+	auto *slot = register_consumer(*f.header, OTHER_PID, "other");
+	ASSERT_NE(slot, nullptr);
+	EXPECT_FALSE(heartbeat(*slot, static_cast<uint32_t>(getpid()), 5));
+	EXPECT_EQ(slot->last_frame_count.load(), 0U);
+}
+
+TEST(Consumers, PruneGoneLocalProcess) {
+	ring_fixture_t f{2, 1};
+	if (pid_namespace() == 0) {
+		GTEST_SKIP() << "no /proc/self/ns/pid";
+	}
+	// a pid that doesn't exist in this namespace
+	auto *slot = register_consumer(*f.header, OTHER_PID, "gone");
+	ASSERT_NE(slot, nullptr);
+	EXPECT_EQ(prune_consumers(*f.header, f.ring, 60'000'000'000), 1U);
+	EXPECT_EQ(slot->pid.load(), 0U);
+}
+
+TEST(Consumers, ForeignNamespaceIsPrunedByHeartbeatOnly) {
+	ring_fixture_t f{2, 1};
+	auto *slot = register_consumer(*f.header, OTHER_PID, "foreign");
+	ASSERT_NE(slot, nullptr);
+	// from another namespace, or one that didn't record it
+	slot->pid_ns.store(0);
+	EXPECT_EQ(prune_consumers(*f.header, f.ring, 60'000'000'000), 0U);
+	EXPECT_EQ(slot->pid.load(), OTHER_PID);
+	slot->pid_ns.store(pid_namespace() + 1);
+	EXPECT_EQ(prune_consumers(*f.header, f.ring, 60'000'000'000), 0U);
+
+	slot->heartbeat_ns.store(monotonic_ns() - 10'000'000'000);
+	EXPECT_EQ(prune_consumers(*f.header, f.ring, 1'000'000'000), 1U);
+	EXPECT_EQ(slot->pid.load(), 0U);
+}
+
+TEST(SideData, RoundTrip) {
+	alignas(8) uint8_t area[64]{};
+	side_data_writer writer{area};
+	EXPECT_TRUE(writer.append(side_data_type_t::exposure, 1.5));
+	const uint8_t odd[3] = {1, 2, 3};
+	EXPECT_TRUE(writer.append(static_cast<uint16_t>(side_data_type_t::user), odd));
+	EXPECT_EQ(writer.size(), 32U);
+	// doesn't fit; nothing is written
+	const uint8_t big[40]{};
+	EXPECT_FALSE(writer.append(static_cast<uint16_t>(side_data_type_t::user), big));
+	EXPECT_EQ(writer.size(), 32U);
+
+	const auto records = parse_side_data(area, writer.size());
+	ASSERT_EQ(records.size(), 2U);
+	EXPECT_EQ(records[0].type, static_cast<uint16_t>(side_data_type_t::exposure));
+	double exposure;
+	ASSERT_EQ(records[0].value.size(), sizeof(double));
+	memcpy(&exposure, records[0].value.data(), sizeof(double));
+	EXPECT_EQ(exposure, 1.5);
+	ASSERT_EQ(records[1].value.size(), 3U);
+	EXPECT_EQ(records[1].value[2], 3);
+	// a truncated record ends the list
+	EXPECT_EQ(parse_side_data(area, 26).size(), 1U);
+}
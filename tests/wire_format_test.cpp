@@ -0,0 +1,59 @@
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <gtest/gtest.h>
+#include "common.hpp"
+
+using namespace app;
+
+// `client/cvmmap/layout.py` unpacks v1 messages with `=IHHBBI`
+TEST(WireFormat, SyncMessageV1MatchesPythonLayout) {
+	EXPECT_EQ(sizeof(sync_message_t), 14U);
+	EXPECT_EQ(offsetof(sync_message_t, frame_count), 0U);
+	EXPECT_EQ(offsetof(sync_message_t, info) + offsetof(frame_info_v1_t, width), 4U);
+	EXPECT_EQ(offsetof(sync_message_t, info) + offsetof(frame_info_v1_t, height), 6U);
+	EXPECT_EQ(offsetof(sync_message_t, info) + offsetof(frame_info_v1_t, channels), 8U);
+	EXPECT_EQ(offsetof(sync_message_t, info) + offsetof(frame_info_v1_t, depth), 9U);
+	EXPECT_EQ(offsetof(sync_message_t, info) + offsetof(frame_info_v1_t, buffer_size), 10U);
+
+	const auto msg = sync_message_t{
+		.frame_count = 0x01020304,
+		.info        = {.width = 640, .height = 480, .channels = 3, .depth = 0, .buffer_size = 640 * 480 * 3},
+	};
+	std::array<uint8_t, 14> buf{};
+	ASSERT_EQ(msg.marshal(buf), 14);
+	// little endian, as `=` packs on the hosts we run on
+	const std::array<uint8_t, 14> expected = {0x04, 0x03, 0x02, 0x01, 0x80, 0x02, 0xe0, 0x01,
+											  0x03, 0x00, 0x00, 0x10, 0x0e, 0x00};
+	EXPECT_EQ(buf, expected);
+
+	const auto back = sync_message_t::unmarshal(buf);
+	ASSERT_TRUE(back.has_value());
+	EXPECT_EQ(back->frame_count, msg.frame_count);
+	EXPECT_EQ(back->info.buffer_size, msg.info.buffer_size);
+	EXPECT_FALSE(sync_message_t::unmarshal(std::span{buf}.first(13)).has_value());
+}
+
+TEST(WireFormat, SyncMessageV1RejectsOversizedFrames) {
+	auto info = frame_info_t{.width = 70000, .height = 1, .channels = 1, .depth = 0, .buffer_size = 70000};
+	EXPECT_FALSE(frame_info_v1_t::from(info).has_value());
+	info.width = 640;
+	EXPECT_TRUE(frame_info_v1_t::from(info).has_value());
+}
+
+TEST(WireFormat, SyncMessageV2RoundTrip) {
+	auto msg = sync_message_v2_t{};
+	msg.sequence   = 1ULL << 40;
+	msg.capture_ns = 123;
+	std::array<uint8_t, sizeof(sync_message_v2_t) + 8> buf{};
+	ASSERT_EQ(msg.marshal(buf), static_cast<int>(sizeof(sync_message_v2_t)));
+	auto back = sync_message_v2_t::unmarshal(buf);
+	ASSERT_TRUE(back.has_value());
+	EXPECT_EQ(back->sequence, msg.sequence);
+	EXPECT_EQ(back->capture_ns, 123U);
+
+	// a v1 message is not mistaken for v2
+	buf[0] ^= 0xff;
+	EXPECT_FALSE(sync_message_v2_t::unmarshal(buf).has_value());
+}